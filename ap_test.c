@@ -0,0 +1,147 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+ap_test.c
+*/
+
+// Behaviour tests for the AP: frames from the client's builders go through process_frame() on a worker
+// built without sockets, and each case checks the responses and the worker's counters. Exits nonzero
+// if any check fails.
+//
+// The AP is compiled into this file; the client's builders come from client.c compiled with its main()
+// and AP_MAC renamed, as for microbench (see the Makefile).
+
+#define main ap_main
+#include "server.c"
+#undef main
+
+// Client frame builders, from client.c
+extern const uint8_t CLIENT_MAC[6];
+size_t create_data_frame(uint8_t *buffer, const uint8_t *src_mac, uint16_t duration_id, uint16_t seq_ctrl, int more_fragments);
+size_t create_data_frame_bad_fcs(uint8_t *buffer, const uint8_t *src_mac, uint16_t duration_id, uint16_t seq_ctrl, int more_fragments);
+
+static int failures;
+
+#define CHECK(what, cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s: %s failed\n", what, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+static void test_worker_init(ap_worker_t *worker) {
+    memset(worker, 0, sizeof(*worker));
+    worker->batch_size = DEFAULT_BATCH_SIZE;
+    build_templates(worker);
+    if (station_table_init(&worker->stations, DEFAULT_STATIONS) < 0 ||
+        reasm_init(&worker->reasm, (size_t)DEFAULT_REASSEMBLY_KB * 1024, deliver_msdu, worker,
+                   worker->metrics.reassembly) < 0 ||
+        ps_init(&worker->ps, (size_t)DEFAULT_POWERSAVE_KB * 1024, worker->stations.slots, worker->metrics.powersave) < 0) {
+        perror("Worker allocation failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Hands one frame to the worker; returns the response type and subtype as FC_FIRST_BYTE(), or -1 if none
+static int deliver(ap_worker_t *worker, const uint8_t *frame, size_t len) {
+    static uint8_t send_buffer[MAX_BUFFER_SIZE];
+    struct sockaddr_in src;
+    const uint8_t *response;
+    memset(&src, 0, sizeof(src));
+    if (process_frame(worker, frame, len, &src, send_buffer, &response) == 0) {
+        return -1;
+    }
+    return response[FRAME_ID_LEN];
+}
+
+/*
+* A retransmission whose original was lost is a new frame to the AP and must be delivered; only a
+* retransmission of a frame the AP already received is a duplicate. Covers an unfragmented MSDU and a
+* fragment, the way the client's Step 7 loses one, each after an earlier frame of the station.
+*/
+static void test_retry_after_lost_original(void) {
+    static ap_worker_t worker;
+    uint8_t frame[MAX_BUFFER_SIZE];
+    const int ack = FC_FIRST_BYTE(PROTOCOL_VERSION, TYPE_CONTROL, SUBTYPE_ACK);
+    size_t len;
+    test_worker_init(&worker);
+
+    len = create_data_frame(frame, CLIENT_MAC, 2, SEQ_CTRL(1, 0), 0);
+    CHECK("first frame", deliver(&worker, frame, len) == ack);
+    CHECK("first frame", worker.metrics.reassembly[REASM_COUNT_MSDUS] == 1);
+
+    // The original of the next frame is lost, so the AP first sees its retransmission
+    len = create_data_frame_bad_fcs(frame, CLIENT_MAC, 2, SEQ_CTRL(2, 0), 0);
+    CHECK("lost original", deliver(&worker, frame, len) == -1);
+    len = create_data_frame(frame, CLIENT_MAC, 2, SEQ_CTRL(2, 0), 0);
+    frame_mark_retry(frame, len);
+    CHECK("retry after loss", deliver(&worker, frame, len) == ack);
+    CHECK("retry after loss", worker.metrics.reassembly[REASM_COUNT_MSDUS] == 2);
+    CHECK("retry after loss", worker.metrics.duplicates == 0);
+
+    // Its ACK is lost in turn: the next retransmission is a duplicate, acknowledged but not delivered again
+    CHECK("duplicate", deliver(&worker, frame, len) == ack);
+    CHECK("duplicate", worker.metrics.reassembly[REASM_COUNT_MSDUS] == 2);
+    CHECK("duplicate", worker.metrics.duplicates == 1);
+
+    // Fragment 1 of a two-fragment MSDU is lost and retransmitted; the retry completes the MSDU
+    len = create_data_frame(frame, CLIENT_MAC, 2, SEQ_CTRL(3, 0), 1);
+    CHECK("fragment 0", deliver(&worker, frame, len) == ack);
+    len = create_data_frame_bad_fcs(frame, CLIENT_MAC, 2, SEQ_CTRL(3, 1), 0);
+    CHECK("lost fragment", deliver(&worker, frame, len) == -1);
+    len = create_data_frame(frame, CLIENT_MAC, 2, SEQ_CTRL(3, 1), 0);
+    frame_mark_retry(frame, len);
+    CHECK("fragment retry", deliver(&worker, frame, len) == ack);
+    CHECK("fragment retry", worker.metrics.reassembly[REASM_COUNT_MSDUS] == 3);
+    CHECK("fragment retry", worker.metrics.duplicates == 1);
+}
+
+// Builds a management request from the client's station, with the power management bit set if dozing
+static size_t build_request(uint8_t *buffer, uint8_t subtype, int dozing) {
+    return frame_build(buffer, PROTOCOL_VERSION, TYPE_MANAGEMENT, subtype, FC_TO_DS | (dozing ? FC_POWER_MGMT : 0), 0,
+                       AP_MAC, CLIENT_MAC, AP_MAC, 0, 0, NULL, 0);
+}
+
+/*
+* A station dozes only once the frame announcing it is answered: that response goes out, and only later
+* management responses are held. A frame waking the station is answered directly, ahead of what it releases.
+*/
+static void test_power_save_transitions(void) {
+    static ap_worker_t worker;
+    uint8_t frame[MAX_BUFFER_SIZE];
+    uint8_t released[MAX_BUFFER_SIZE];
+    struct sockaddr_in addr;
+    const int assoc_resp = FC_FIRST_BYTE(PROTOCOL_VERSION, TYPE_MANAGEMENT, SUBTYPE_ASSOC_RESP);
+    const int probe_resp = FC_FIRST_BYTE(PROTOCOL_VERSION, TYPE_MANAGEMENT, SUBTYPE_PROBE_RESP);
+    size_t len;
+    test_worker_init(&worker);
+
+    len = build_request(frame, SUBTYPE_ASSOC_REQ, 1);
+    CHECK("doze", deliver(&worker, frame, len) == assoc_resp);
+    CHECK("doze", worker.metrics.powersave[PS_COUNT_DOZES] == 1);
+    CHECK("doze", worker.metrics.powersave[PS_COUNT_BUFFERED] == 0);
+
+    len = build_request(frame, SUBTYPE_PROBE_REQ, 1);
+    CHECK("dozing", deliver(&worker, frame, len) == -1);
+    CHECK("dozing", worker.metrics.powersave[PS_COUNT_BUFFERED] == 1);
+    CHECK("dozing", next_released_frame(&worker, released, &addr) == 0);
+
+    len = build_request(frame, SUBTYPE_ASSOC_REQ, 0);
+    CHECK("wake", deliver(&worker, frame, len) == assoc_resp);
+    CHECK("wake", worker.metrics.powersave[PS_COUNT_WAKES] == 1);
+    CHECK("wake", next_released_frame(&worker, released, &addr) > 0 && released[FRAME_ID_LEN] == probe_resp);
+    CHECK("wake", next_released_frame(&worker, released, &addr) == 0);
+}
+
+int main(void) {
+    log_level = LOG_ERROR;
+    test_retry_after_lost_original();
+    test_power_save_transitions();
+    if (failures) {
+        fprintf(stderr, "ap_test: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("ap_test: retransmissions and power-save transitions behave\n");
+    return 0;
+}
@@ -0,0 +1,145 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+bench_io.c
+*/
+
+// Closed-loop request/response load against a running AP, used to compare its I/O loops and worker counts.
+// Keeps a fixed number of RTS frames in flight on each flow and counts the CTS responses that come back.
+// Every flow is its own UDP socket, so with -f > 1 SO_REUSEPORT spreads the flows over the AP's workers.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "frame.h"
+
+#define SERVER_IP "127.0.0.1"
+#define SERVER_PORT 8080
+#define MAX_BUFFER_SIZE 2500
+#define DEFAULT_WINDOW 64
+#define DEFAULT_DURATION 3
+#define MAX_FLOWS 64
+
+const uint8_t CLIENT_MAC[6] = {0x12, 0x45, 0xCC, 0xDD, 0xEE, 0x88};
+const uint8_t AP_MAC[6] = {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xDD};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    int window = DEFAULT_WINDOW;
+    int duration = DEFAULT_DURATION;
+    int flows = 1;
+    const char *label = "ap";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "w:d:f:l:")) != -1) {
+        switch (opt) {
+        case 'w':
+            window = atoi(optarg);
+            break;
+        case 'd':
+            duration = atoi(optarg);
+            break;
+        case 'f':
+            flows = atoi(optarg);
+            break;
+        case 'l':
+            label = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-w in_flight_per_flow] [-d seconds] [-f flows] [-l label]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (window < 1 || duration < 1 || flows < 1 || flows > MAX_FLOWS) {
+        fprintf(stderr, "Window and duration must be positive, flows between 1 and %d\n", MAX_FLOWS);
+        exit(EXIT_FAILURE);
+    }
+
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = inet_addr(SERVER_IP);
+    server_addr.sin_port = htons(SERVER_PORT);
+
+    struct pollfd pfds[MAX_FLOWS];
+    int in_flight[MAX_FLOWS];
+    for (int f = 0; f < flows; f++) {
+        pfds[f].fd = socket(AF_INET, SOCK_DGRAM, 0);
+        pfds[f].events = POLLIN;
+        in_flight[f] = 0;
+        if (pfds[f].fd < 0) {
+            perror("Socket creation failed");
+            exit(EXIT_FAILURE);
+        }
+        if (connect(pfds[f].fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+            perror("connect failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    uint8_t send_buffer[MAX_BUFFER_SIZE];
+    uint8_t recv_buffer[MAX_BUFFER_SIZE];
+    size_t frame_size = frame_build(send_buffer, PROTOCOL_VERSION, TYPE_CONTROL, SUBTYPE_RTS, FC_TO_DS, 4,
+                                    AP_MAC, CLIENT_MAC, NULL, 0, 0, NULL, 0);
+
+    unsigned long sent = 0, received = 0, refills = 0;
+    double start = now_seconds();
+    double end = start + duration;
+
+    while (now_seconds() < end) {
+        for (int f = 0; f < flows; f++) {
+            while (in_flight[f] < window) {
+                if (send(pfds[f].fd, send_buffer, frame_size, 0) < 0) {
+                    if (errno == ECONNREFUSED) {
+                        fprintf(stderr, "AP is not running on port %d\n", SERVER_PORT);
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+                }
+                sent++;
+                in_flight[f]++;
+            }
+        }
+
+        if (poll(pfds, flows, 100) == 0) {
+            // Nothing came back in 100 ms: treat every window as lost and refill it
+            refills++;
+            memset(in_flight, 0, sizeof(in_flight));
+            continue;
+        }
+        for (int f = 0; f < flows; f++) {
+            if (!(pfds[f].revents & POLLIN)) {
+                continue;
+            }
+            while (recv(pfds[f].fd, recv_buffer, sizeof(recv_buffer), MSG_DONTWAIT) > 0) {
+                received++;
+                if (in_flight[f] > 0) {
+                    in_flight[f]--;
+                }
+            }
+        }
+    }
+
+    double elapsed = now_seconds() - start;
+    printf("%s: flows=%d window=%d sent=%lu received=%lu timeouts=%lu rate=%.0f responses/s\n",
+           label, flows, window, sent, received, refills, received / elapsed);
+
+    for (int f = 0; f < flows; f++) {
+        close(pfds[f].fd);
+    }
+    return 0;
+}
@@ -5,6 +5,7 @@ COEN 331 Winter 2025: Programming Assignment
 client.c
 */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,270 +15,911 @@ client.c
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <time.h>
-#include <signal.h>
-#include <sys/time.h>
 #include <errno.h>
+#include <stdarg.h>
+#include <poll.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "frame.h"
+#include "log.h"
+#include "metrics.h"
+#include "rto.h"
+#include "evloop.h"
+#include "pcap.h"
 
 #define SERVER_IP "127.0.0.1"
 #define SERVER_PORT 8080
 #define CLIENT_PORT 8081
 #define MAX_BUFFER_SIZE 2500
-#define ACK_TIMEOUT 3
 #define MAX_RETRIES 3
+#define DEFAULT_BURST_FRAMES 5
+#define MAX_OUTSTANDING 4096        // Exchanges the event loop can track at once
+
+// Bulk transfer mode
+#define BULK_MSDU_FRAGMENTS 16      // Fragments per MSDU without a window (fragment numbers are 4 bits)
+#define BULK_CHUNK_SIZE (1 << 20)   // Bytes read at a time from input that cannot be mapped
+
+// Load-generator mode
+#define MAX_LOAD_THREADS 64
+#define MAX_LOAD_STATIONS (1 << 24)
+#define DEFAULT_LOAD_THREADS 1
+#define DEFAULT_LOAD_RATE 10000
+#define DEFAULT_LOAD_DURATION 5
+#define LOAD_SEND_BURST 64          // Most frames sent before the socket is drained again
+#define LOAD_LINGER_NS 200000000ULL // How long to wait for late responses after the run
 
 // Global variables
 int client_socket;
 struct sockaddr_in server_addr;
 socklen_t server_addr_len = sizeof(struct sockaddr_in);
-volatile int waiting_for_response = 0;
-volatile int response_received = 0;
+uint8_t protocol_version = PROTOCOL_VERSION;  // Selects the FCS algorithm, see frame.h
+uint16_t next_seq = 0;                        // Sequence number of the next data MSDU
+rto_t ap_rto;                                 // Retransmission timer for the AP
+evloop_t client_loop;                         // Event loop driving every exchange with the AP
 
-// Signal handler for timeout
-void timeout_handler(int signum) {
-    if (waiting_for_response) {
-        waiting_for_response = 0;
-        response_received = 0;
-    }
+static uint64_t monotonic_us(void) {
+    return evloop_now_us();
 }
 
-// Sets up timer for response timeout
-void setup_timer(int seconds) {
-    struct sigaction sa;
-    struct itimerval timer;
+// MAC addresses for client and AP
+const uint8_t CLIENT_MAC[6] = {0x12, 0x45, 0xCC, 0xDD, 0xEE, 0x88};
+const uint8_t AP_MAC[6] = {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xDD};
 
-    memset(&sa, 0, sizeof(sa));
-    sa.sa_handler = &timeout_handler;
-    sigaction(SIGALRM, &sa, NULL);
+// Prints a progress line once every queued log record is out, so the two streams stay in order
+void print_step(const char *format, ...) {
+    va_list args;
+    log_flush();
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    fflush(stdout);
+}
 
-    timer.it_value.tv_sec = seconds;
-    timer.it_value.tv_usec = 0;
-    timer.it_interval.tv_sec = 0;
-    timer.it_interval.tv_usec = 0;
+// Where send_frame_and_wait() wants the outcome of its exchange
+typedef struct {
+    uint8_t *buffer;
+    size_t *size;
+    int result;
+} wait_result_t;
 
-    setitimer(ITIMER_REAL, &timer, NULL);
+static void wait_done(exchange_t *exchange, int result, const frame_view_t *response) {
+    wait_result_t *wait = exchange->user;
+    wait->result = result;
+    if (result == EXCHANGE_OK && wait->buffer) {
+        *wait->size = response->body_len + FRAME_OVERHEAD;
+        memcpy(wait->buffer, response->body - FRAME_ID_LEN, *wait->size);
+    }
 }
 
-// Cancels active timer
-void cancel_timer() {
-    struct itimerval timer;
-    timer.it_value.tv_sec = 0;
-    timer.it_value.tv_usec = 0;
-    timer.it_interval.tv_sec = 0;
-    timer.it_interval.tv_usec = 0;
-    setitimer(ITIMER_REAL, &timer, NULL);
+// Runs one exchange whose request is already in exchange->frame until it completes
+static int run_exchange(exchange_t *exchange, wait_result_t *wait, const char *frame_name) {
+    exchange->done = wait_done;
+    exchange->user = wait;
+    if (evloop_submit(&client_loop, exchange, frame_name, MAX_RETRIES) < 0) {
+        return -1;
+    }
+    if (evloop_run(&client_loop) < 0) {
+        return -1;
+    }
+    return wait->result == EXCHANGE_OK;
 }
 
-// MAC addresses for client and AP
-const uint8_t CLIENT_MAC[6] = {0x12, 0x45, 0xCC, 0xDD, 0xEE, 0x88};
-const uint8_t AP_MAC[6] = {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xDD};
-
-// Sends frame and waits for response with retry mechanism
+/*
+* Sends frame and waits for response with retry mechanism: the frame is one exchange on the client's
+* event loop, which resends it each time the AP's retransmission timeout passes, up to MAX_RETRIES attempts.
+* Output: 1 if a valid response arrived (copied to response_buffer), 0 if none did, -1 on a socket error
+*/
 int send_frame_and_wait(uint8_t *frame_buffer, size_t frame_size, 
                         uint8_t *response_buffer, size_t *response_size,
                         const char *frame_name) {
-    int retries = 0;
-    response_received = 0;
+    exchange_t exchange;
+    wait_result_t wait = { response_buffer, response_size, EXCHANGE_TIMEOUT };
     *response_size = 0;
 
-    while (retries < MAX_RETRIES && !response_received) {
-        printf("Sending %s (Attempt %d)\n", frame_name, retries + 1);
-        
-        if (sendto(client_socket, frame_buffer, frame_size, 0, 
-                  (struct sockaddr *)&server_addr, server_addr_len) < 0) {
-            perror("sendto failed");
-            return -1;
+    memcpy(exchange.frame, frame_buffer, frame_size);
+    exchange.len = frame_size;
+    return run_exchange(&exchange, &wait, frame_name);
+}
+
+// Creates Association Request frame
+size_t create_association_request(uint8_t *buffer, const uint8_t *src_mac) {
+    // Receiver, transmitter, BSSID
+    return frame_build(buffer, protocol_version, TYPE_MANAGEMENT, SUBTYPE_ASSOC_REQ, FC_TO_DS, 0,
+                       AP_MAC, src_mac, AP_MAC, 0, 0, NULL, 0);
+}
+
+// Creates Probe Request frame
+size_t create_probe_request(uint8_t *buffer, const uint8_t *src_mac) {
+    return frame_build(buffer, protocol_version, TYPE_MANAGEMENT, SUBTYPE_PROBE_REQ, FC_TO_DS, 0,
+                       AP_MAC, src_mac, AP_MAC, 0, 0, NULL, 0);
+}
+
+// Creates RTS frame
+size_t create_rts_frame(uint8_t *buffer, const uint8_t *src_mac, uint16_t duration_id) {
+    return frame_build(buffer, protocol_version, TYPE_CONTROL, SUBTYPE_RTS, FC_TO_DS, duration_id,
+                       AP_MAC, src_mac, NULL, 0, 0, NULL, 0);
+}
+
+// Takes the sequence number of a new data MSDU. Its fragments share it, and only a retransmission of
+// a fragment reuses that fragment's seq_ctrl, so the AP can tell retransmissions from new frames.
+static uint16_t new_msdu_seq(void) {
+    uint16_t seq = next_seq;
+    next_seq = (uint16_t)((next_seq + 1) & (SEQ_MODULO - 1));
+    return seq;
+}
+
+// Creates data frame carrying sequence number and fragment number seq_ctrl
+size_t create_data_frame(uint8_t *buffer, const uint8_t *src_mac, uint16_t duration_id, uint16_t seq_ctrl, int more_fragments) {
+    char payload_data[100];
+    int payload_len = snprintf(payload_data, sizeof(payload_data), "This is frame %d data", SEQ_FRAG(seq_ctrl));
+    
+    return frame_build(buffer, protocol_version, TYPE_DATA, SUBTYPE_DATA, FC_TO_DS | (more_fragments ? FC_MORE_FRAG : 0),
+                       duration_id, AP_MAC, src_mac, AP_MAC, seq_ctrl, 0, payload_data, (size_t)payload_len);
+}
+
+// Creates QoS data frame with the Block Ack ack policy, so the AP holds its acknowledgement
+size_t create_qos_data_frame(uint8_t *buffer, const uint8_t *src_mac, uint16_t duration_id, uint16_t seq_ctrl,
+                             const void *payload, size_t payload_len) {
+    return frame_build(buffer, protocol_version, TYPE_DATA, SUBTYPE_QOS_DATA, FC_TO_DS, duration_id,
+                       AP_MAC, src_mac, AP_MAC, seq_ctrl, QOS_ACK_BLOCK << QOS_ACK_POLICY_SHIFT, payload, payload_len);
+}
+
+// Creates Block Ack Request asking about the frames from start_seq_ctrl on
+size_t create_block_ack_request(uint8_t *buffer, const uint8_t *src_mac, uint16_t duration_id, uint16_t start_seq_ctrl) {
+    uint8_t body[BLOCK_ACK_REQ_BODY_LEN];
+    uint16_t bar_control = 0x0004;          // Compressed bitmap
+    memcpy(body, &bar_control, sizeof(uint16_t));
+    memcpy(body + 2, &start_seq_ctrl, sizeof(uint16_t));
+    
+    return frame_build(buffer, protocol_version, TYPE_CONTROL, SUBTYPE_BLOCK_ACK_REQ, FC_TO_DS, duration_id,
+                       AP_MAC, src_mac, NULL, 0, 0, body, sizeof(body));
+}
+
+// Creates data frame with invalid FCS
+size_t create_data_frame_bad_fcs(uint8_t *buffer, const uint8_t *src_mac, uint16_t duration_id, uint16_t seq_ctrl, int more_fragments) {
+    size_t size = create_data_frame(buffer, src_mac, duration_id, seq_ctrl, more_fragments);
+    
+    // The FCS sits just before the end frame identifier
+    memset(buffer + size - FRAME_ID_LEN - FRAME_FCS_LEN, 0, FRAME_FCS_LEN);  // Invalid FCS value
+    
+    return size;
+}
+
+// Creates one fragment of a bulk transfer MSDU, with its payload copied straight from the input
+static size_t create_data_fragment(uint8_t *buffer, uint16_t duration_id, uint16_t seq_ctrl, int more_fragments,
+                                   const uint8_t *payload, size_t payload_len) {
+    return frame_build(buffer, protocol_version, TYPE_DATA, SUBTYPE_DATA, FC_TO_DS | (more_fragments ? FC_MORE_FRAG : 0),
+                       duration_id, AP_MAC, CLIENT_MAC, AP_MAC, seq_ctrl, 0, payload, payload_len);
+}
+
+// What a transfer got acknowledged
+typedef struct {
+    int frames;
+    uint64_t bytes;                     // Payload bytes in the acknowledged frames
+    int retransmissions;
+} transfer_stats_t;
+
+// Per-frame state of a windowed transfer
+#define WINDOW_PENDING 0
+#define WINDOW_ACKED 1
+#define WINDOW_FAILED 2
+typedef struct {
+    uint16_t seq;
+    uint8_t state;
+    uint8_t attempts;
+} window_frame_t;
+
+// A windowed transfer in progress, driven by Block Ack completions on the event loop
+typedef struct {
+    window_frame_t *frames;
+    int count;
+    int window;
+    int base;                           // Oldest frame not yet acknowledged or given up
+    int next;                           // Next frame never sent
+    int since_request;                  // Frames sent since the last Block Ack Request
+    int request_end;                    // Frames before this were sent before the outstanding request; -1 = none
+    transfer_stats_t stats;
+    int error;
+    const uint8_t *data;                // Frame i carries data[i * MAX_PAYLOAD_SIZE...]; NULL = test strings
+    size_t data_len;
+    exchange_t request;                 // The outstanding Block Ack Request
+} window_transfer_t;
+
+// Length of the slice of data that frame number index of a windowed transfer carries
+static size_t window_slice_len(const window_transfer_t *transfer, int index) {
+    size_t offset = (size_t)index * MAX_PAYLOAD_SIZE;
+    return transfer->data_len - offset < MAX_PAYLOAD_SIZE ? transfer->data_len - offset : MAX_PAYLOAD_SIZE;
+}
+
+// Sends data frame number index of a windowed transfer; it gets no response of its own
+static int send_window_frame(window_transfer_t *transfer, int index) {
+    window_frame_t *frame = &transfer->frames[index];
+    uint8_t buffer[MAX_BUFFER_SIZE];
+    size_t size;
+    if (transfer->data) {
+        size = create_qos_data_frame(buffer, CLIENT_MAC, 2, SEQ_CTRL(frame->seq, 0),
+                                     transfer->data + (size_t)index * MAX_PAYLOAD_SIZE, window_slice_len(transfer, index));
+    } else {
+        char payload[100];
+        snprintf(payload, sizeof(payload), "This is frame %d data", index);
+        size = create_qos_data_frame(buffer, CLIENT_MAC, 2, SEQ_CTRL(frame->seq, 0), payload, strlen(payload));
+    }
+    if (frame->attempts > 0) {
+        frame_mark_retry(buffer, size);
+    }
+    frame->attempts++;
+    return evloop_send(&client_loop, buffer, size);
+}
+
+static void window_block_ack(exchange_t *exchange, int result, const frame_view_t *response);
+
+// Asks the AP which frames from the window base on it holds
+static int send_window_request(window_transfer_t *transfer) {
+    transfer->request.len = create_block_ack_request(transfer->request.frame, CLIENT_MAC, 2,
+                                                     SEQ_CTRL(transfer->frames[transfer->base].seq, 0));
+    transfer->request.done = window_block_ack;
+    transfer->request.user = transfer;
+    transfer->request_end = transfer->next;
+    transfer->since_request = 0;
+    return evloop_submit(&client_loop, &transfer->request, "Block Ack Request", MAX_RETRIES);
+}
+
+// Sends new frames while the window has room, asking for a Block Ack every half window and
+// whenever nothing more can be sent
+static void window_fill(window_transfer_t *transfer) {
+    int request_every = transfer->window / 2 > 0 ? transfer->window / 2 : 1;
+    while (transfer->next < transfer->count && transfer->next < transfer->base + transfer->window) {
+        if (send_window_frame(transfer, transfer->next) < 0) {
+            transfer->error = 1;
+            return;
         }
+        transfer->next++;
+        transfer->since_request++;
+        if (transfer->request_end < 0 && transfer->since_request >= request_every &&
+            send_window_request(transfer) < 0) {
+            transfer->error = 1;
+            return;
+        }
+    }
+    if (transfer->request_end < 0 && transfer->base < transfer->count && send_window_request(transfer) < 0) {
+        transfer->error = 1;
+    }
+}
 
-        waiting_for_response = 1;
-        setup_timer(ACK_TIMEOUT);
-        
-        ssize_t recv_size = recvfrom(client_socket, response_buffer, MAX_BUFFER_SIZE, 0, 
-                               (struct sockaddr *)&server_addr, &server_addr_len);
-        
-        if (recv_size > 0) {
-            udp_payload *payload = (udp_payload *)response_buffer;
-            
-            // Validate frame identifiers and FCS
-            if (payload->start_frame_id != START_FRAME_ID || payload->end_frame_id != END_FRAME_ID) {
-                printf("Invalid frame identifiers in response\n");
-                continue;
+// Block Ack Request completion: acknowledge what the bitmap holds, resend what it lost, slide the window
+static void window_block_ack(exchange_t *exchange, int result, const frame_view_t *response) {
+    window_transfer_t *transfer = exchange->user;
+    int request_end = transfer->request_end;
+    uint16_t start_seq_ctrl;
+    uint64_t bitmap;
+
+    transfer->request_end = -1;
+    if (result != EXCHANGE_OK) {
+        LOG(EV_CLIENT_NO_BA);
+        return;                         // Nothing is left outstanding, so the event loop returns
+    }
+    memcpy(&start_seq_ctrl, response->payload + 2, sizeof(uint16_t));
+    memcpy(&bitmap, response->payload + 4, sizeof(uint64_t));
+    uint16_t start = SEQ_NUM(start_seq_ctrl);
+    LOG(EV_CLIENT_RX_BA, start, bitmap);
+
+    for (int i = transfer->base; i < transfer->next; i++) {
+        window_frame_t *frame = &transfer->frames[i];
+        if (frame->state != WINDOW_PENDING) {
+            continue;
+        }
+        uint16_t offset = (uint16_t)((frame->seq - start) & (SEQ_MODULO - 1));
+        if (offset < BLOCK_ACK_WINDOW && (bitmap >> offset) & 1) {
+            frame->state = WINDOW_ACKED;
+            transfer->stats.frames++;
+            if (transfer->data) {
+                transfer->stats.bytes += window_slice_len(transfer, i);
             }
-            
-            uint32_t calculated_fcs = getCheckSumValue(&payload->frame, sizeof(ieee80211_frame), 0, 4);
-            if (calculated_fcs != payload->frame.fcs) {
-                printf("FCS Error in response\n");
+        } else if (i < request_end) {
+            // Sent before the request but not held by the AP: lost, resend just this one
+            if (frame->attempts >= MAX_RETRIES) {
+                LOG(EV_CLIENT_GIVE_UP, frame->seq, frame->attempts);
+                frame->state = WINDOW_FAILED;
                 continue;
             }
-            
-            *response_size = recv_size;
-            response_received = 1;
-            waiting_for_response = 0;
-            cancel_timer();
-            printf("Valid response received for %s\n", frame_name);
-            return 1;
-        } else {
-            // Handle recvfrom errors, including timer interrupts
-            if (errno == EINTR) {
-                // This is expected when our timer expires, don't print an error
-                printf("Timer expired waiting for response to %s\n", frame_name);
-            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                printf("Socket timeout waiting for response to %s\n", frame_name);
-            } else {
-                perror("recvfrom failed with error");
+            LOG(EV_CLIENT_RETRANSMIT, frame->seq, frame->attempts + 1);
+            if (send_window_frame(transfer, i) < 0) {
+                transfer->error = 1;
+                return;
             }
+            transfer->stats.retransmissions++;
+            transfer->since_request++;
         }
-        
-        // Only cancel the timer if it's still active
-        cancel_timer();
-        
-        // Always increment the retry counter once per loop iteration
-        retries++;
     }
+    while (transfer->base < transfer->count && transfer->frames[transfer->base].state != WINDOW_PENDING) {
+        transfer->base++;
+    }
+    window_fill(transfer);
+}
 
-    if (retries >= MAX_RETRIES) {
-        printf("No ACK received from AP.\n");
+/*
+* Sends count data frames with up to window (at most BLOCK_ACK_WINDOW) of them in flight, keyed by
+* sequence number. The AP records them without answering; every half window the client sends a
+* Block Ack Request and the AP replies with a bitmap of what it holds. Frames sent before that request
+* and missing from the bitmap are retransmitted on their own (selective repeat); a lost Block Ack is
+* recovered by the event loop resending the request after the AP's retransmission timeout.
+* With data, frame i carries the i-th MAX_PAYLOAD_SIZE slice of it as an unfragmented MSDU.
+* Output: 0, or -1 on a socket error. *stats gets what was acknowledged and how many frames were resent.
+*/
+int send_window(const uint8_t *data, size_t data_len, int count, int window, transfer_stats_t *stats) {
+    window_transfer_t transfer;
+    memset(&transfer, 0, sizeof(transfer));
+    transfer.frames = calloc(count, sizeof(window_frame_t));
+    transfer.count = count;
+    transfer.window = window;
+    transfer.request_end = -1;
+    transfer.data = data;
+    transfer.data_len = data_len;
+    if (!transfer.frames) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        transfer.frames[i].seq = (uint16_t)((next_seq + i) & (SEQ_MODULO - 1));
+    }
+    next_seq = (uint16_t)((next_seq + count) & (SEQ_MODULO - 1));
+
+    window_fill(&transfer);
+    if (!transfer.error && evloop_run(&client_loop) < 0) {
+        transfer.error = 1;
+    }
+
+    free(transfer.frames);
+    *stats = transfer.stats;
+    return transfer.error ? -1 : 0;
+}
+
+/*
+* Sends len bytes of data as MSDUs of up to BULK_MSDU_FRAGMENTS fragments, each fragment one
+* MAX_PAYLOAD_SIZE slice. The fragments of an MSDU share its sequence number and count up in the
+* fragment number of seq_ctrl, all but the last have more_fragments set, and duration_id shrinks
+* with the fragments left as in Step 6. Each fragment is built in the exchange's own frame buffer and
+* waits for its ACK; an MSDU is abandoned at the first fragment that stays unacknowledged.
+* With a window the data goes through send_window() instead, one unfragmented MSDU per slice,
+* since Block Ack covers whole MSDUs.
+* Output: 0, or -1 on a socket error. The acknowledged frames and bytes are added to *stats.
+*/
+static int send_bulk(const uint8_t *data, size_t len, int window, transfer_stats_t *stats) {
+    int count = (int)((len + MAX_PAYLOAD_SIZE - 1) / MAX_PAYLOAD_SIZE);
+    if (window > 0) {
+        transfer_stats_t window_stats;
+        if (send_window(data, len, count, window, &window_stats) < 0) {
+            return -1;
+        }
+        stats->frames += window_stats.frames;
+        stats->bytes += window_stats.bytes;
+        stats->retransmissions += window_stats.retransmissions;
         return 0;
     }
-    
-    return 1;
+
+    exchange_t exchange;
+    size_t response_size;
+    wait_result_t wait = { NULL, &response_size, EXCHANGE_TIMEOUT };
+    for (int first = 0; first < count; first += BULK_MSDU_FRAGMENTS) {
+        int fragments = count - first < BULK_MSDU_FRAGMENTS ? count - first : BULK_MSDU_FRAGMENTS;
+        uint16_t seq = new_msdu_seq();
+        for (int i = 0; i < fragments; i++) {
+            size_t offset = (size_t)(first + i) * MAX_PAYLOAD_SIZE;
+            size_t slice = len - offset < MAX_PAYLOAD_SIZE ? len - offset : MAX_PAYLOAD_SIZE;
+            exchange.len = create_data_fragment(exchange.frame, 2 * (fragments - i), SEQ_CTRL(seq, i),
+                                                i < fragments - 1, data + offset, slice);
+            int acked = run_exchange(&exchange, &wait, "Bulk Data Fragment");
+            if (acked < 0) {
+                return -1;
+            }
+            stats->retransmissions += exchange.attempts - 1;
+            if (!acked) {
+                break;
+            }
+            stats->frames++;
+            stats->bytes += slice;
+        }
+    }
+    return 0;
 }
 
-// Creates Association Request frame
-size_t create_association_request(uint8_t *buffer) {
-    ieee80211_frame frame;
-    memset(&frame, 0, sizeof(ieee80211_frame));
-    
-    // Set frame control fields
-    frame.frame_control.protocol_version = 0;
-    frame.frame_control.type = 0;           // Management frame
-    frame.frame_control.subtype = 0;        // Association Request
-    frame.frame_control.to_ds = 1;
-    frame.frame_control.from_ds = 0;
-    
-    // Set addresses
-    memcpy(frame.addr1, AP_MAC, 6);         // Receiver
-    memcpy(frame.addr2, CLIENT_MAC, 6);     // Transmitter
-    memcpy(frame.addr3, AP_MAC, 6);         // BSSID
-    
-    // Calculate FCS
-    frame.fcs = getCheckSumValue(&frame, sizeof(ieee80211_frame), 0, 4);
-    
-    // Create UDP payload
-    udp_payload payload;
-    payload.start_frame_id = START_FRAME_ID;
-    memcpy(&payload.frame, &frame, sizeof(ieee80211_frame));
-    payload.end_frame_id = END_FRAME_ID;
-    
-    memcpy(buffer, &payload, sizeof(udp_payload));
-    
-    return sizeof(udp_payload);
+/*
+* Bulk transfer mode: sends the contents of path ("-" for stdin) to the AP and reports the sustained
+* payload throughput. A regular file is mapped and sent in one pass; anything else is read and sent
+* BULK_CHUNK_SIZE bytes at a time, a whole number of fragments, so MSDUs never straddle two reads.
+* Output: 0 if every byte was acknowledged, 1 if some were not, -1 on an input or socket error
+*/
+int run_bulk_transfer(const char *path, int window) {
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    struct stat st;
+    transfer_stats_t stats = { 0, 0, 0 };
+    uint64_t total = 0;
+    int result = 0;
+
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        return -1;
+    }
+    print_step("Sending %s%s...\n", fd == STDIN_FILENO ? "stdin" : path,
+               window > 0 ? " with Block Ack" : " as fragmented MSDUs");
+    uint64_t start = monotonic_us();
+    uint8_t *map = S_ISREG(st.st_mode) && st.st_size > 0 ?
+                   mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    if (map != MAP_FAILED) {
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        total = st.st_size;
+        result = send_bulk(map, st.st_size, window, &stats);
+        munmap(map, st.st_size);
+    } else {
+        uint8_t *chunk = malloc(BULK_CHUNK_SIZE);
+        if (!chunk) {
+            perror("malloc");
+            result = -1;
+        }
+        while (result == 0) {
+            size_t filled = 0;
+            ssize_t n = 1;
+            while (filled < BULK_CHUNK_SIZE && (n = read(fd, chunk + filled, BULK_CHUNK_SIZE - filled)) > 0) {
+                filled += n;
+            }
+            if (n < 0) {
+                perror(path);
+                result = -1;
+                break;
+            }
+            total += filled;
+            if (filled > 0 && send_bulk(chunk, filled, window, &stats) < 0) {
+                result = -1;
+            }
+            if (n == 0) {
+                break;
+            }
+        }
+        free(chunk);
+    }
+    uint64_t elapsed_us = monotonic_us() - start;
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    if (result < 0) {
+        return -1;
+    }
+
+    double seconds = elapsed_us / 1e6;
+    print_step("%lu of %lu bytes acknowledged in %d frames, %d retransmissions\n",
+               (unsigned long)stats.bytes, (unsigned long)total, stats.frames, stats.retransmissions);
+    print_step("%.3f s, %.2f MB/s, %.0f frames/s\n", seconds,
+               seconds > 0 ? stats.bytes / seconds / 1e6 : 0.0, seconds > 0 ? stats.frames / seconds : 0.0);
+    return stats.bytes == total ? 0 : 1;
 }
 
-// Creates Probe Request frame
-size_t create_probe_request(uint8_t *buffer) {
-    ieee80211_frame frame;
-    memset(&frame, 0, sizeof(ieee80211_frame));
-    
-    frame.frame_control.protocol_version = 0;
-    frame.frame_control.type = 0;
-    frame.frame_control.subtype = 4;        // Probe Request
-    frame.frame_control.to_ds = 1;
-    frame.frame_control.from_ds = 0;
-    
-    memcpy(frame.addr1, AP_MAC, 6);
-    memcpy(frame.addr2, CLIENT_MAC, 6);
-    memcpy(frame.addr3, AP_MAC, 6);
-    
-    frame.fcs = getCheckSumValue(&frame, sizeof(ieee80211_frame), 0, 4);
-    
-    udp_payload payload;
-    payload.start_frame_id = START_FRAME_ID;
-    memcpy(&payload.frame, &frame, sizeof(ieee80211_frame));
-    payload.end_frame_id = END_FRAME_ID;
-    
-    memcpy(buffer, &payload, sizeof(udp_payload));
-    
-    return sizeof(udp_payload);
+/*
+* Load-generator mode: N virtual stations spread over worker threads, each thread with its own UDP
+* socket so SO_REUSEPORT spreads them over the AP's workers. Every thread sends open-loop at its share
+* of the offered rate, visiting its stations round-robin and picking the frame type from the mix.
+* A station has at most one request outstanding; the response is matched back to it through addr1,
+* and a request still unanswered when the station's turn comes round again counts as lost.
+*/
+enum { MIX_ASSOC, MIX_PROBE, MIX_RTS, MIX_DATA, NUM_MIX };
+static const char *mix_names[NUM_MIX] = { "assoc", "probe", "rts", "data" };
+
+typedef struct {
+    int stations;
+    int threads;
+    double rate;                // Offered frames per second, all threads together
+    int duration;               // Seconds
+    int mix[NUM_MIX];           // Relative weight of each frame type
+} load_config_t;
+
+typedef struct {
+    const load_config_t *config;
+    int id;
+    int socket_fd;
+    uint32_t first_station;
+    uint32_t num_stations;
+    uint64_t *sent_ns;          // Per-station send time of the outstanding request, 0 if none
+    uint64_t rng;
+    uint64_t sent, received, lost, invalid, send_errors;
+    uint64_t rtt_count, rtt_total_ns, rtt_max_ns;
+    uint64_t rtt_ns[HIST_BUCKETS];
+    pthread_t thread;
+} load_worker_t;
+
+static uint64_t load_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
 }
 
-// Creates RTS frame
-size_t create_rts_frame(uint8_t *buffer, uint16_t duration_id) {
-    ieee80211_frame frame;
-    memset(&frame, 0, sizeof(ieee80211_frame));
-    
-    frame.frame_control.protocol_version = 0;
-    frame.frame_control.type = 1;           // Control frame
-    frame.frame_control.subtype = 11;       // RTS
-    frame.frame_control.to_ds = 1;
-    frame.frame_control.from_ds = 0;
-    
-    frame.duration_id = duration_id;
-    
-    memcpy(frame.addr1, AP_MAC, 6);
-    memcpy(frame.addr2, CLIENT_MAC, 6);
-    memcpy(frame.addr3, AP_MAC, 6);
-    
-    frame.fcs = getCheckSumValue(&frame, sizeof(ieee80211_frame), 0, 4);
-    
-    udp_payload payload;
-    payload.start_frame_id = START_FRAME_ID;
-    memcpy(&payload.frame, &frame, sizeof(ieee80211_frame));
-    payload.end_frame_id = END_FRAME_ID;
-    
-    memcpy(buffer, &payload, sizeof(udp_payload));
-    
-    return sizeof(udp_payload);
+static uint64_t xorshift64(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
 }
 
-// Creates data frame
-size_t create_data_frame(uint8_t *buffer, uint16_t duration_id, int fragment_number, int more_fragments) {
-    ieee80211_frame frame;
-    memset(&frame, 0, sizeof(ieee80211_frame));
-    
-    frame.frame_control.protocol_version = 0;
-    frame.frame_control.type = 2;           // Data frame
-    frame.frame_control.subtype = 0;        // Data
-    frame.frame_control.to_ds = 1;
-    frame.frame_control.from_ds = 0;
-    frame.frame_control.more_frag = more_fragments;
-    
-    frame.duration_id = duration_id;
-    
-    memcpy(frame.addr1, AP_MAC, 6);
-    memcpy(frame.addr2, CLIENT_MAC, 6);
-    memcpy(frame.addr3, AP_MAC, 6);
-    
-    frame.seq_ctrl = fragment_number;
-    
-    // Add payload data
-    char payload_data[100];
-    snprintf(payload_data, sizeof(payload_data), "This is frame %d data", fragment_number);
-    memcpy(frame.payload, payload_data, strlen(payload_data));
-    
-    frame.fcs = getCheckSumValue(&frame, sizeof(ieee80211_frame), 0, 4);
-    
-    udp_payload payload;
-    payload.start_frame_id = START_FRAME_ID;
-    memcpy(&payload.frame, &frame, sizeof(ieee80211_frame));
-    payload.end_frame_id = END_FRAME_ID;
-    
-    memcpy(buffer, &payload, sizeof(udp_payload));
-    
-    return sizeof(udp_payload);
+// Virtual stations use locally administered addresses 02:00:<station index, big endian>
+static void station_mac(uint32_t index, uint8_t *mac) {
+    mac[0] = 0x02;
+    mac[1] = 0x00;
+    mac[2] = (uint8_t)(index >> 24);
+    mac[3] = (uint8_t)(index >> 16);
+    mac[4] = (uint8_t)(index >> 8);
+    mac[5] = (uint8_t)index;
 }
 
-// Creates data frame with invalid FCS
-size_t create_data_frame_bad_fcs(uint8_t *buffer, uint16_t duration_id, int fragment_number, int more_fragments) {
-    size_t size = create_data_frame(buffer, duration_id, fragment_number, more_fragments);
-    
-    udp_payload *payload = (udp_payload *)buffer;
-    payload->frame.fcs = 0x00000000;  // Invalid FCS value
-    
-    return size;
+// Output: the station index encoded in mac, or -1 if it is not a virtual station address
+static long station_index(const uint8_t *mac) {
+    if (mac[0] != 0x02 || mac[1] != 0x00) {
+        return -1;
+    }
+    return ((long)mac[2] << 24) | ((long)mac[3] << 16) | ((long)mac[4] << 8) | (long)mac[5];
+}
+
+// Parses "assoc=1,probe=1,rts=4,data=4"; types left out get weight 0
+static int parse_mix(const char *text, int *mix) {
+    char copy[128];
+    char *save = NULL;
+    int total = 0;
+
+    snprintf(copy, sizeof(copy), "%s", text);
+    memset(mix, 0, NUM_MIX * sizeof(int));
+    for (char *item = strtok_r(copy, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(item, '=');
+        int m;
+        if (!eq) {
+            return -1;
+        }
+        *eq = '\0';
+        for (m = 0; m < NUM_MIX && strcmp(item, mix_names[m]) != 0; m++) {
+        }
+        if (m == NUM_MIX || atoi(eq + 1) < 0) {
+            return -1;
+        }
+        mix[m] = atoi(eq + 1);
+        total += mix[m];
+    }
+    return total > 0 ? 0 : -1;
 }
 
-int main() {
+// Builds the next request for a station with one of the existing frame builders
+static size_t build_load_frame(load_worker_t *worker, uint32_t station, uint8_t *buffer) {
+    const int *mix = worker->config->mix;
+    int total = mix[MIX_ASSOC] + mix[MIX_PROBE] + mix[MIX_RTS] + mix[MIX_DATA];
+    int pick = (int)(xorshift64(&worker->rng) % (uint64_t)total);
+    uint8_t mac[MAC_ADDR_LEN];
+
+    station_mac(station, mac);
+    if ((pick -= mix[MIX_ASSOC]) < 0) {
+        return create_association_request(buffer, mac);
+    }
+    if ((pick -= mix[MIX_PROBE]) < 0) {
+        return create_probe_request(buffer, mac);
+    }
+    if ((pick -= mix[MIX_RTS]) < 0) {
+        return create_rts_frame(buffer, mac, 4);
+    }
+    return create_data_frame(buffer, mac, 2, SEQ_CTRL(0, 0), 0);
+}
+
+// Reads every queued response and matches it to its station
+static void drain_responses(load_worker_t *worker, uint8_t *buffer) {
+    ssize_t size;
+    while ((size = recv(worker->socket_fd, buffer, MAX_BUFFER_SIZE, MSG_DONTWAIT)) > 0) {
+        uint64_t now = load_now_ns();
+        frame_view_t view;
+        long station;
+
+        if (frame_parse(buffer, size, &view) != FRAME_OK) {
+            worker->invalid++;
+            continue;
+        }
+        int bad_fcs = frame_fcs(&view) != view.fcs;
+        PCAP_CAPTURE(buffer, size, bad_fcs);
+        if (bad_fcs) {
+            worker->invalid++;
+            continue;
+        }
+        station = station_index(view.addr1);
+        if (station < worker->first_station || station >= (long)(worker->first_station + worker->num_stations) ||
+            worker->sent_ns[station - worker->first_station] == 0) {
+            worker->invalid++;      // Not ours, or a late answer to a request already counted lost
+            continue;
+        }
+
+        uint64_t rtt = now - worker->sent_ns[station - worker->first_station];
+        worker->sent_ns[station - worker->first_station] = 0;
+        worker->received++;
+        worker->rtt_ns[hist_bucket(rtt)]++;
+        worker->rtt_count++;
+        worker->rtt_total_ns += rtt;
+        if (rtt > worker->rtt_max_ns) {
+            worker->rtt_max_ns = rtt;
+        }
+    }
+}
+
+static void *load_worker_main(void *arg) {
+    load_worker_t *worker = arg;
+    const load_config_t *config = worker->config;
+    uint64_t interval = (uint64_t)(1e9 * config->threads / config->rate);
+    uint64_t start = load_now_ns();
+    uint64_t end = start + (uint64_t)config->duration * 1000000000ULL;
+    uint64_t next_send = start;
+    uint32_t next_station = 0;
+    uint8_t send_buffer[MAX_BUFFER_SIZE];
+    uint8_t recv_buffer[MAX_BUFFER_SIZE];
+    struct pollfd pfd = { .fd = worker->socket_fd, .events = POLLIN };
+
+    if (interval == 0) {
+        interval = 1;
+    }
+
+    for (;;) {
+        uint64_t now = load_now_ns();
+        if (now >= end) {
+            break;
+        }
+
+        // Send everything that is due, a burst at a time if the thread has fallen behind
+        for (int burst = 0; next_send <= now && burst < LOAD_SEND_BURST; burst++) {
+            uint32_t slot = next_station;
+            size_t frame_size;
+
+            next_station = next_station + 1 == worker->num_stations ? 0 : next_station + 1;
+            if (worker->sent_ns[slot] != 0) {
+                worker->lost++;
+            }
+            frame_size = build_load_frame(worker, worker->first_station + slot, send_buffer);
+            worker->sent_ns[slot] = load_now_ns();
+            if (send(worker->socket_fd, send_buffer, frame_size, 0) < 0) {
+                worker->sent_ns[slot] = 0;
+                worker->send_errors++;
+            } else {
+                PCAP_CAPTURE(send_buffer, frame_size, 0);
+                worker->sent++;
+            }
+            next_send += interval;
+        }
+
+        // Sleep until the next send is due or a response arrives
+        now = load_now_ns();
+        uint64_t wait = next_send > now ? next_send - now : 0;
+        if (now + wait > end) {
+            wait = end > now ? end - now : 0;
+        }
+        struct timespec timeout = { .tv_sec = wait / 1000000000ULL, .tv_nsec = wait % 1000000000ULL };
+        if (ppoll(&pfd, 1, &timeout, NULL) > 0) {
+            drain_responses(worker, recv_buffer);
+        }
+    }
+
+    // Give responses still in flight a moment, then count the rest as lost
+    uint64_t linger_end = load_now_ns() + LOAD_LINGER_NS;
+    for (uint64_t now = load_now_ns(); now < linger_end; now = load_now_ns()) {
+        uint64_t wait = linger_end - now;
+        struct timespec timeout = { .tv_sec = wait / 1000000000ULL, .tv_nsec = wait % 1000000000ULL };
+        if (ppoll(&pfd, 1, &timeout, NULL) > 0) {
+            drain_responses(worker, recv_buffer);
+        }
+    }
+    for (uint32_t s = 0; s < worker->num_stations; s++) {
+        if (worker->sent_ns[s] != 0) {
+            worker->lost++;
+        }
+    }
+    return NULL;
+}
+
+// Percentile in microseconds; bucket bounds are rounded up, so cap them at the largest value seen
+static double rtt_percentile_us(const load_worker_t *total, double percentile) {
+    uint64_t ns = hist_percentile(total->rtt_ns, total->rtt_count, percentile);
+    return (ns < total->rtt_max_ns ? ns : total->rtt_max_ns) / 1e3;
+}
+
+// Runs the load test and prints the report. Output: process exit status
+int run_load_test(const load_config_t *config) {
+    load_worker_t *workers = calloc(config->threads, sizeof(load_worker_t));
+    uint64_t *sent_ns = calloc(config->stations, sizeof(uint64_t));
+    if (!workers || !sent_ns) {
+        perror("calloc failed");
+        return EXIT_FAILURE;
+    }
+
+    printf("UDP Client load test against AP at %s:%d\n", SERVER_IP, ntohs(server_addr.sin_port));
+    printf("FCS: %s\n", protocol_version == PROTOCOL_VERSION_CRC32 ? "CRC-32" : "legacy checksum");
+    printf("Stations: %d, threads: %d, offered rate: %.0f frames/s, duration: %d s, mix:",
+           config->stations, config->threads, config->rate, config->duration);
+    for (int m = 0; m < NUM_MIX; m++) {
+        printf(" %s=%d", mix_names[m], config->mix[m]);
+    }
+    printf("\n");
+    fflush(stdout);
+
+    // Stations are split into contiguous ranges, one per thread
+    uint32_t first = 0;
+    for (int t = 0; t < config->threads; t++) {
+        load_worker_t *worker = &workers[t];
+        worker->config = config;
+        worker->id = t;
+        worker->first_station = first;
+        worker->num_stations = config->stations / config->threads + (t < config->stations % config->threads);
+        worker->sent_ns = sent_ns + first;
+        worker->rng = 0x9E3779B97F4A7C15ULL * (uint64_t)(t + 1);
+        first += worker->num_stations;
+
+        worker->socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (worker->socket_fd < 0) {
+            perror("Socket creation failed");
+            return EXIT_FAILURE;
+        }
+        if (connect(worker->socket_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+            perror("connect failed");
+            return EXIT_FAILURE;
+        }
+    }
+
+    uint64_t start = load_now_ns();
+    for (int t = 0; t < config->threads; t++) {
+        if (pthread_create(&workers[t].thread, NULL, load_worker_main, &workers[t]) != 0) {
+            perror("pthread_create failed");
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Combine the per-thread results
+    load_worker_t total;
+    memset(&total, 0, sizeof(total));
+    for (int t = 0; t < config->threads; t++) {
+        load_worker_t *worker = &workers[t];
+        pthread_join(worker->thread, NULL);
+        close(worker->socket_fd);
+        total.sent += worker->sent;
+        total.received += worker->received;
+        total.lost += worker->lost;
+        total.invalid += worker->invalid;
+        total.send_errors += worker->send_errors;
+        total.rtt_count += worker->rtt_count;
+        total.rtt_total_ns += worker->rtt_total_ns;
+        if (worker->rtt_max_ns > total.rtt_max_ns) {
+            total.rtt_max_ns = worker->rtt_max_ns;
+        }
+        for (int b = 0; b < HIST_BUCKETS; b++) {
+            total.rtt_ns[b] += worker->rtt_ns[b];
+        }
+    }
+    double elapsed = (load_now_ns() - start) / 1e9 - LOAD_LINGER_NS / 1e9;
+
+    printf("\n--- Load Test Results ---\n");
+    printf("Sent: %lu frames (%.0f frames/s)\n", (unsigned long)total.sent, total.sent / elapsed);
+    printf("Received: %lu responses (%.0f responses/s)\n", (unsigned long)total.received, total.received / elapsed);
+    printf("Lost: %lu (%.2f%%), invalid or late responses: %lu, send errors: %lu\n",
+           (unsigned long)total.lost, total.sent ? 100.0 * total.lost / total.sent : 0.0,
+           (unsigned long)total.invalid, (unsigned long)total.send_errors);
+    printf("RTT (us): mean=%.1f p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f max=%.1f\n",
+           total.rtt_count ? total.rtt_total_ns / 1e3 / total.rtt_count : 0.0,
+           rtt_percentile_us(&total, 50),
+           rtt_percentile_us(&total, 90),
+           rtt_percentile_us(&total, 99),
+           rtt_percentile_us(&total, 99.9),
+           total.rtt_max_ns / 1e3);
+
+    free(sent_ns);
+    free(workers);
+    return total.received > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[]) {
+    int level = LOG_DEFAULT_LEVEL;
+    const char *raw_log_path = NULL;
+    load_config_t load = { 0, DEFAULT_LOAD_THREADS, DEFAULT_LOAD_RATE, DEFAULT_LOAD_DURATION, { 1, 1, 4, 4 } };
+    int window = 0;
+    int burst_frames = DEFAULT_BURST_FRAMES;
+    const char *bulk_path = NULL;
+    const char *pcap_path = NULL;
+    int ap_port = SERVER_PORT;
+    int opt;
+    while ((opt = getopt(argc, argv, "cvqL:P:W:N:f:n:t:r:d:m:p:")) != -1) {
+        switch (opt) {
+        case 'c':
+            protocol_version = PROTOCOL_VERSION_CRC32;
+            break;
+        case 'v':
+            level = LOG_DEBUG;
+            break;
+        case 'q':
+            level = LOG_WARN;
+            break;
+        case 'L':
+            raw_log_path = optarg;
+            break;
+        case 'P':
+            pcap_path = optarg;
+            break;
+        case 'W':
+            window = atoi(optarg);
+            break;
+        case 'N':
+            burst_frames = atoi(optarg);
+            break;
+        case 'f':
+            bulk_path = optarg;
+            break;
+        case 'n':
+            load.stations = atoi(optarg);
+            break;
+        case 't':
+            load.threads = atoi(optarg);
+            break;
+        case 'r':
+            load.rate = atof(optarg);
+            break;
+        case 'd':
+            load.duration = atoi(optarg);
+            break;
+        case 'm':
+            if (parse_mix(optarg, load.mix) < 0) {
+                fprintf(stderr, "Invalid mix '%s', expected e.g. assoc=1,probe=1,rts=4,data=4\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'p':
+            ap_port = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-c] [-v | -q] [-L raw_log] [-P capture] [-p port] [-W window] [-N frames] [-f file] [-n stations [-t threads] [-r rate] [-d seconds] [-m mix]]\n", argv[0]);
+            fprintf(stderr, "  -c  use the IEEE 802.11 CRC-32 FCS\n");
+            fprintf(stderr, "  -v  log every frame; -q  log only warnings and errors\n");
+            fprintf(stderr, "  -L  write binary log records to raw_log instead of text (decode with logdump)\n");
+            fprintf(stderr, "  -P  write every frame sent and received to a pcap capture file\n");
+            fprintf(stderr, "  -p  send to this port instead of the AP's %d, e.g. an impair relay in front of it\n", SERVER_PORT);
+            fprintf(stderr, "  -W  send Step 6 with up to window frames in flight, acknowledged by Block Ack (1-%d)\n", BLOCK_ACK_WINDOW);
+            fprintf(stderr, "  -N  number of data frames in Step 6 (default %d)\n", DEFAULT_BURST_FRAMES);
+            fprintf(stderr, "  -f  send file (- for stdin) as fragmented data frames instead of the scripted run, with -W over Block Ack\n");
+            fprintf(stderr, "  -n  load-generator mode with this many virtual stations instead of the scripted run\n");
+            fprintf(stderr, "  -t  load threads (default %d); -r  offered frames/s (default %d); -d  seconds (default %d)\n",
+                    DEFAULT_LOAD_THREADS, DEFAULT_LOAD_RATE, DEFAULT_LOAD_DURATION);
+            fprintf(stderr, "  -m  frame mix weights (default assoc=1,probe=1,rts=4,data=4)\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (load.stations < 0 || load.stations > MAX_LOAD_STATIONS || load.threads < 1 || load.threads > MAX_LOAD_THREADS ||
+        load.rate <= 0 || load.duration < 1) {
+        fprintf(stderr, "Stations must be at most %d, threads between 1 and %d, rate and duration positive\n",
+                MAX_LOAD_STATIONS, MAX_LOAD_THREADS);
+        exit(EXIT_FAILURE);
+    }
+    if (ap_port <= 0 || ap_port > 65535) {
+        fprintf(stderr, "Port must be between 1 and 65535\n");
+        exit(EXIT_FAILURE);
+    }
+    if (window < 0 || window > BLOCK_ACK_WINDOW || burst_frames < 1) {
+        fprintf(stderr, "Window must be between 0 and %d, frames positive\n", BLOCK_ACK_WINDOW);
+        exit(EXIT_FAILURE);
+    }
+    if (load.stations > 0 && load.stations < load.threads) {
+        load.threads = load.stations;
+    }
+    if (log_init(level, raw_log_path) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    if (pcap_path && pcap_open(pcap_path) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    rto_init(&ap_rto, monotonic_us() ^ ((uint64_t)getpid() << 32));
+
+    // Set up server address
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = inet_addr(SERVER_IP);
+    server_addr.sin_port = htons(ap_port);
+
+    if (load.stations > 0) {
+        return run_load_test(&load);
+    }
+
     // Create and set up socket
     client_socket = socket(AF_INET, SOCK_DGRAM, 0);
     if (client_socket < 0) {
@@ -299,107 +941,136 @@ int main() {
         exit(EXIT_FAILURE);
     }
 
-    // Set up server address
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = inet_addr(SERVER_IP);
-    server_addr.sin_port = htons(SERVER_PORT);
-
     // Buffers
     uint8_t send_buffer[MAX_BUFFER_SIZE];
     uint8_t recv_buffer[MAX_BUFFER_SIZE];
     size_t frame_size, response_size;
 
-    // Set socket timeout
-    struct timeval tv;
-    tv.tv_sec = 4;
-    tv.tv_usec = 0;  // 100ms
-    if (setsockopt(client_socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
-        perror("setsockopt failed");
+    // Every exchange with the AP runs on one event loop
+    if (evloop_init(&client_loop, client_socket, &server_addr, &ap_rto, MAX_OUTSTANDING) < 0) {
+        perror("Event loop setup failed");
         exit(EXIT_FAILURE);
     }
 
-    printf("UDP Client started. Connecting to AP at %s:%d\n", SERVER_IP, SERVER_PORT);
+    printf("UDP Client started. Connecting to AP at %s:%d\n", SERVER_IP, ntohs(server_addr.sin_port));
+    printf("FCS: %s\n", protocol_version == PROTOCOL_VERSION_CRC32 ? "CRC-32" : "legacy checksum");
+
+    if (bulk_path) {
+        // Bulk transfer: associate, then stream the input
+        frame_size = create_association_request(send_buffer, CLIENT_MAC);
+        if (!send_frame_and_wait(send_buffer, frame_size, recv_buffer, &response_size, "Association Request")) {
+            close(client_socket);
+            exit(EXIT_FAILURE);
+        }
+        int result = run_bulk_transfer(bulk_path, window);
+        close(client_socket);
+        return result == 0 ? 0 : EXIT_FAILURE;
+    }
 
     // Step 1: Association Request
-    printf("\n--- Step 1: Association Request ---\n");
-    frame_size = create_association_request(send_buffer);
+    print_step("\n--- Step 1: Association Request ---\n");
+    frame_size = create_association_request(send_buffer, CLIENT_MAC);
     if (!send_frame_and_wait(send_buffer, frame_size, recv_buffer, &response_size, "Association Request")) {
         close(client_socket);
         exit(EXIT_FAILURE);
     }
 
     // Step 2: Probe Request
-    printf("\n--- Step 2: Probe Request ---\n");
-    frame_size = create_probe_request(send_buffer);
+    print_step("\n--- Step 2: Probe Request ---\n");
+    frame_size = create_probe_request(send_buffer, CLIENT_MAC);
     if (!send_frame_and_wait(send_buffer, frame_size, recv_buffer, &response_size, "Probe Request")) {
         close(client_socket);
         exit(EXIT_FAILURE);
     }
 
     // Step 3: RTS
-    printf("\n--- Step 3: RTS Frame ---\n");
-    frame_size = create_rts_frame(send_buffer, 4);
+    print_step("\n--- Step 3: RTS Frame ---\n");
+    frame_size = create_rts_frame(send_buffer, CLIENT_MAC, 4);
     if (!send_frame_and_wait(send_buffer, frame_size, recv_buffer, &response_size, "RTS Frame")) {
         close(client_socket);
         exit(EXIT_FAILURE);
     }
 
     // Step 4: Data Frame
-    printf("\n--- Step 4: Data Frame ---\n");
-    frame_size = create_data_frame(send_buffer, 2, 0, 0);
+    print_step("\n--- Step 4: Data Frame ---\n");
+    frame_size = create_data_frame(send_buffer, CLIENT_MAC, 2, SEQ_CTRL(new_msdu_seq(), 0), 0);
     if (!send_frame_and_wait(send_buffer, frame_size, recv_buffer, &response_size, "Data Frame")) {
         close(client_socket);
         exit(EXIT_FAILURE);
     }
 
     // Step 5: Frame with Bad FCS
-    printf("\n--- Step 5: Frame with Bad FCS ---\n");
-    frame_size = create_data_frame_bad_fcs(send_buffer, 2, 0, 0);
+    print_step("\n--- Step 5: Frame with Bad FCS ---\n");
+    frame_size = create_data_frame_bad_fcs(send_buffer, CLIENT_MAC, 2, SEQ_CTRL(new_msdu_seq(), 0), 0);
     send_frame_and_wait(send_buffer, frame_size, recv_buffer, &response_size, "Frame with Bad FCS");
     
     // Step 6: Multiple Frame Procedure
-    printf("\n--- Step 6: Multiple Frame Procedure ---\n");
-    printf("Sending RTS for multiple frames...\n");
-    frame_size = create_rts_frame(send_buffer, 12);
+    print_step("\n--- Step 6: Multiple Frame Procedure ---\n");
+    print_step("Sending RTS for multiple frames...\n");
+    frame_size = create_rts_frame(send_buffer, CLIENT_MAC, 12);
     if (!send_frame_and_wait(send_buffer, frame_size, recv_buffer, &response_size, "RTS for Multiple Frames")) {
         close(client_socket);
         exit(EXIT_FAILURE);
     }
     
-    // Send 5 fragmented frames
-    printf("Sending 5 fragmented frames...\n");
-    for (int i = 0; i < 5; i++) {
-        int more_fragments = (i < 4) ? 1 : 0;
-        uint16_t duration = 10 - (i * 2);
-        
-        frame_size = create_data_frame(send_buffer, duration, i, more_fragments);
-        if (!send_frame_and_wait(send_buffer, frame_size, recv_buffer, &response_size, 
-                               "Fragmented Data Frame")) {
-            printf("No ACK Received for Frame No.%d\n", i+1);
+    uint64_t burst_start = monotonic_us();
+    int burst_acked = 0;
+    if (window > 0) {
+        // Pipelined: up to window frames in flight, acknowledged together by Block Ack
+        transfer_stats_t stats;
+        print_step("Sending %d frames with a window of %d...\n", burst_frames, window);
+        if (send_window(NULL, 0, burst_frames, window, &stats) < 0) {
+            close(client_socket);
+            exit(EXIT_FAILURE);
+        }
+        burst_acked = stats.frames;
+        print_step("%d retransmissions\n", stats.retransmissions);
+    } else {
+        // Stop-and-wait: one ACK per fragment, a new MSDU every BULK_MSDU_FRAGMENTS fragments
+        print_step("Sending %d fragmented frames...\n", burst_frames);
+        uint16_t seq = 0;
+        for (int i = 0; i < burst_frames; i++) {
+            int fragment = i % BULK_MSDU_FRAGMENTS;
+            int more_fragments = (i < burst_frames - 1 && fragment < BULK_MSDU_FRAGMENTS - 1) ? 1 : 0;
+            uint16_t duration = 2 * (burst_frames - i);
+            if (fragment == 0) {
+                seq = new_msdu_seq();
+            }
+            
+            frame_size = create_data_frame(send_buffer, CLIENT_MAC, duration, SEQ_CTRL(seq, fragment), more_fragments);
+            if (!send_frame_and_wait(send_buffer, frame_size, recv_buffer, &response_size, 
+                                   "Fragmented Data Frame")) {
+                print_step("No ACK Received for Frame No.%d\n", i+1);
+            } else {
+                burst_acked++;
+            }
         }
     }
+    uint64_t burst_us = monotonic_us() - burst_start;
+    print_step("%d of %d frames acknowledged in %.3f ms (%.0f frames/s)\n", burst_acked, burst_frames,
+               burst_us / 1000.0, burst_us > 0 ? burst_acked * 1e6 / burst_us : 0.0);
     
     // Step 7: Frames with Errors
-    printf("\n--- Step 7: Multiple Frames with Errors ---\n");
+    print_step("\n--- Step 7: Multiple Frames with Errors ---\n");
     
     // First frame is correct
-    printf("Sending 1 correct frame and 4 frames with errors...\n");
-    frame_size = create_data_frame(send_buffer, 2, 0, 1);
+    print_step("Sending 1 correct frame and 4 frames with errors...\n");
+    uint16_t errors_seq = new_msdu_seq();
+    frame_size = create_data_frame(send_buffer, CLIENT_MAC, 2, SEQ_CTRL(errors_seq, 0), 1);
     if (!send_frame_and_wait(send_buffer, frame_size, recv_buffer, &response_size, 
                            "Correct Data Frame")) {
-        printf("No ACK Received for Frame No.1\n");
+        print_step("No ACK Received for Frame No.1\n");
     }
     
     // Four frames with errors
     for (int i = 1; i < 5; i++) {
         int more_fragments = (i < 4) ? 1 : 0;
         
-        frame_size = create_data_frame_bad_fcs(send_buffer, 2, i, more_fragments);
+        frame_size = create_data_frame_bad_fcs(send_buffer, CLIENT_MAC, 2, SEQ_CTRL(errors_seq, i), more_fragments);
         
         if (!send_frame_and_wait(send_buffer, frame_size, recv_buffer, &response_size, 
                                "Data Frame with Bad FCS")) {
-            printf("No ACK Received for Frame No.%d\n", i+1);
+            print_step("No ACK Received for Frame No.%d\n", i+1);
         }
     }
     
@@ -0,0 +1,428 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+evloop.c
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include "evloop.h"
+#include "log.h"
+#include "pcap.h"
+
+#define EVLOOP_RECV_SIZE 2500
+#define EXCHANGE_KEY_USED (1ULL << 63)
+
+uint64_t evloop_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// Wall clock in nanoseconds, the clock of the kernel's SO_TIMESTAMPNS receive timestamps
+static uint64_t wall_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+// Dispatch key: station address, then the response type and subtype
+static inline uint64_t exchange_key(const uint8_t *station, uint8_t type, uint8_t subtype) {
+    uint64_t key = 0;
+    memcpy(&key, station, MAC_ADDR_LEN);
+    return key | ((uint64_t)type << 48) | ((uint64_t)subtype << 50) | EXCHANGE_KEY_USED;
+}
+
+static inline uint32_t exchange_slot(const evloop_t *loop, uint64_t key) {
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & loop->mask;
+}
+
+// Output: 0 and the response type/subtype the AP sends for this request, or -1 if it sends none
+static int expected_response(const frame_view_t *view, uint8_t *type, uint8_t *subtype) {
+    frame_control_t fc = view->frame_control;
+    if (fc.type == TYPE_MANAGEMENT && fc.subtype == SUBTYPE_ASSOC_REQ) {
+        *type = TYPE_MANAGEMENT;
+        *subtype = SUBTYPE_ASSOC_RESP;
+    } else if (fc.type == TYPE_MANAGEMENT && fc.subtype == SUBTYPE_PROBE_REQ) {
+        *type = TYPE_MANAGEMENT;
+        *subtype = SUBTYPE_PROBE_RESP;
+    } else if (fc.type == TYPE_CONTROL && fc.subtype == SUBTYPE_RTS) {
+        *type = TYPE_CONTROL;
+        *subtype = SUBTYPE_CTS;
+    } else if (fc.type == TYPE_CONTROL && fc.subtype == SUBTYPE_BLOCK_ACK_REQ) {
+        *type = TYPE_CONTROL;
+        *subtype = SUBTYPE_BLOCK_ACK;
+    } else if (fc.type == TYPE_DATA &&
+               (!(fc.subtype & SUBTYPE_QOS_DATA) ||
+                ((view->qos_ctrl >> QOS_ACK_POLICY_SHIFT) & 0x3) == QOS_ACK_NORMAL)) {
+        *type = TYPE_CONTROL;
+        *subtype = SUBTYPE_ACK;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+* Creates the epoll instance and timerfd and sizes the heap and dispatch table for capacity
+* outstanding exchanges. The socket is switched to non-blocking mode and asked for receive timestamps.
+* Output: 0 on success, -1 on failure
+*/
+int evloop_init(evloop_t *loop, int socket_fd, const struct sockaddr_in *dest, rto_t *rto, uint32_t capacity) {
+    uint32_t slots = 2;
+    while (slots < 2 * (uint64_t)capacity) {
+        slots <<= 1;
+    }
+
+    memset(loop, 0, sizeof(*loop));
+    loop->socket_fd = socket_fd;
+    loop->dest = *dest;
+    loop->rto = rto;
+    loop->capacity = capacity;
+    loop->mask = slots - 1;
+    loop->heap = calloc(capacity, sizeof(exchange_t *));
+    loop->keys = calloc(slots, sizeof(uint64_t));
+    loop->slots = calloc(slots, sizeof(exchange_t *));
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    loop->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (!loop->heap || !loop->keys || !loop->slots || loop->epoll_fd < 0 || loop->timer_fd < 0) {
+        evloop_free(loop);
+        return -1;
+    }
+
+    fcntl(socket_fd, F_SETFL, fcntl(socket_fd, F_GETFL) | O_NONBLOCK);
+    int on = 1;
+    setsockopt(socket_fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+    struct epoll_event event = { .events = EPOLLIN };
+    event.data.fd = socket_fd;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, socket_fd, &event) < 0) {
+        evloop_free(loop);
+        return -1;
+    }
+    event.data.fd = loop->timer_fd;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->timer_fd, &event) < 0) {
+        evloop_free(loop);
+        return -1;
+    }
+    return 0;
+}
+
+void evloop_free(evloop_t *loop) {
+    if (loop->epoll_fd > 0) {
+        close(loop->epoll_fd);
+    }
+    if (loop->timer_fd > 0) {
+        close(loop->timer_fd);
+    }
+    free(loop->heap);
+    free(loop->keys);
+    free(loop->slots);
+    loop->heap = NULL;
+    loop->keys = NULL;
+    loop->slots = NULL;
+}
+
+// Timer heap: exchanges ordered by deadline, each remembering its index
+static void heap_place(evloop_t *loop, size_t index, exchange_t *exchange) {
+    loop->heap[index] = exchange;
+    exchange->heap_index = (int)index;
+}
+
+static void heap_sift_up(evloop_t *loop, size_t index) {
+    exchange_t *exchange = loop->heap[index];
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (loop->heap[parent]->deadline_us <= exchange->deadline_us) {
+            break;
+        }
+        heap_place(loop, index, loop->heap[parent]);
+        index = parent;
+    }
+    heap_place(loop, index, exchange);
+}
+
+static void heap_sift_down(evloop_t *loop, size_t index) {
+    exchange_t *exchange = loop->heap[index];
+    for (;;) {
+        size_t child = 2 * index + 1;
+        if (child >= loop->outstanding) {
+            break;
+        }
+        if (child + 1 < loop->outstanding && loop->heap[child + 1]->deadline_us < loop->heap[child]->deadline_us) {
+            child++;
+        }
+        if (exchange->deadline_us <= loop->heap[child]->deadline_us) {
+            break;
+        }
+        heap_place(loop, index, loop->heap[child]);
+        index = child;
+    }
+    heap_place(loop, index, exchange);
+}
+
+static void heap_remove(evloop_t *loop, exchange_t *exchange) {
+    size_t index = (size_t)exchange->heap_index;
+    exchange_t *last = loop->heap[--loop->outstanding];
+    exchange->heap_index = -1;
+    if (index == loop->outstanding) {
+        return;
+    }
+    heap_place(loop, index, last);
+    heap_sift_up(loop, index);
+    heap_sift_down(loop, (size_t)last->heap_index);
+}
+
+// Dispatch table (linear probing with backward-shift deletion, so there are no tombstones)
+static uint32_t table_find(const evloop_t *loop, uint64_t key) {
+    uint32_t i = exchange_slot(loop, key);
+    while (loop->keys[i] != 0 && loop->keys[i] != key) {
+        i = (i + 1) & loop->mask;
+    }
+    return i;
+}
+
+static void table_remove(evloop_t *loop, uint32_t i) {
+    uint32_t j = i;
+    loop->keys[i] = 0;
+    for (;;) {
+        j = (j + 1) & loop->mask;
+        if (loop->keys[j] == 0) {
+            return;
+        }
+        uint32_t home = exchange_slot(loop, loop->keys[j]);
+        // Move j back into the hole unless its home slot lies cyclically in (i, j]
+        if ((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j))) {
+            loop->keys[i] = loop->keys[j];
+            loop->slots[i] = loop->slots[j];
+            loop->keys[j] = 0;
+            i = j;
+        }
+    }
+}
+
+// Sends a frame that expects no response
+int evloop_send(evloop_t *loop, const uint8_t *frame, size_t len) {
+    if (sendto(loop->socket_fd, frame, len, 0, (const struct sockaddr *)&loop->dest, sizeof(loop->dest)) < 0) {
+        LOG(EV_CLIENT_SEND_ERROR, errno);
+        return -1;
+    }
+    PCAP_CAPTURE(frame, len, 0);
+    return 0;
+}
+
+// Sends the current attempt of an exchange, retry bit set after the first, and sets its deadline from
+// the retransmission timer
+static int exchange_transmit(evloop_t *loop, exchange_t *exchange) {
+    if (exchange->attempts > 0) {
+        frame_mark_retry(exchange->frame, exchange->len);
+    }
+    exchange->attempts++;
+    LOG_S(EV_CLIENT_TX, exchange->name, exchange->attempts);
+    if (exchange->attempts == 1) {
+        exchange->first_sent_ns = wall_now_ns();
+    }
+    exchange->sent_us = evloop_now_us();
+    exchange->timeout_us = rto_timeout_us(loop->rto, exchange->attempts - 1);
+    exchange->deadline_us = exchange->sent_us + exchange->timeout_us;
+    return evloop_send(loop, exchange->frame, exchange->len);
+}
+
+/*
+* Sends the request in exchange->frame (exchange->len bytes) and tracks it until a response arrives
+* or max_attempts attempts have timed out; exchange->done is then called exactly once.
+* Output: 0 on success, -1 if the frame expects no response, the loop is full, an exchange for the
+* same station and response is already outstanding, or the send failed
+*/
+int evloop_submit(evloop_t *loop, exchange_t *exchange, const char *name, int max_attempts) {
+    frame_view_t view;
+    if (loop->outstanding >= loop->capacity || frame_parse(exchange->frame, exchange->len, &view) != FRAME_OK ||
+        view.addr2 == NULL || expected_response(&view, &exchange->response_type, &exchange->response_subtype) < 0) {
+        return -1;
+    }
+    memcpy(exchange->station, view.addr2, MAC_ADDR_LEN);
+
+    uint64_t key = exchange_key(exchange->station, exchange->response_type, exchange->response_subtype);
+    uint32_t slot = table_find(loop, key);
+    if (loop->keys[slot] != 0) {
+        return -1;
+    }
+
+    exchange->name = name;
+    exchange->attempts = 0;
+    exchange->max_attempts = max_attempts;
+    if (exchange_transmit(loop, exchange) < 0) {
+        return -1;
+    }
+    loop->keys[slot] = key;
+    loop->slots[slot] = exchange;
+    loop->outstanding++;
+    heap_place(loop, loop->outstanding - 1, exchange);
+    heap_sift_up(loop, loop->outstanding - 1);
+    return 0;
+}
+
+// Takes an exchange off the heap and out of the table and reports its result
+static void exchange_finish(evloop_t *loop, exchange_t *exchange, int result, const frame_view_t *response) {
+    heap_remove(loop, exchange);
+    table_remove(loop, table_find(loop, exchange_key(exchange->station, exchange->response_type,
+                                                     exchange->response_subtype)));
+    exchange->done(exchange, result, response);
+}
+
+// Retransmits or gives up on every exchange whose deadline has passed
+static int evloop_expire(evloop_t *loop) {
+    uint64_t now = evloop_now_us();
+    while (loop->outstanding > 0 && loop->heap[0]->deadline_us <= now) {
+        exchange_t *exchange = loop->heap[0];
+        LOG_S(EV_CLIENT_TIMER, exchange->name, exchange->timeout_us);
+        if (exchange->attempts >= exchange->max_attempts) {
+            LOG(EV_CLIENT_NO_ACK);
+            exchange_finish(loop, exchange, EXCHANGE_TIMEOUT, NULL);
+            continue;
+        }
+        if (exchange_transmit(loop, exchange) < 0) {
+            return -1;
+        }
+        heap_sift_down(loop, 0);
+    }
+    return 0;
+}
+
+// Kernel receive time of a datagram read with recvmsg(), or 0 if it carries none
+static uint64_t received_ns(struct msghdr *msg) {
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+        }
+    }
+    return 0;
+}
+
+/*
+* Reads every queued datagram and completes the exchanges they answer. Responses carry no sequence
+* number, so one that reached the socket before the matching exchange was first sent is stale: it
+* answers an earlier exchange with the same station and response type, such as a second copy of a
+* retransmitted request, and is dropped instead of completing the new exchange with a bogus RTT sample.
+*/
+static int evloop_receive(evloop_t *loop) {
+    uint8_t buffer[EVLOOP_RECV_SIZE];
+    uint8_t control[CMSG_SPACE(sizeof(struct timespec))];
+    struct iovec iov = { buffer, sizeof(buffer) };
+    struct msghdr msg;
+    ssize_t size;
+    for (;;) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if ((size = recvmsg(loop->socket_fd, &msg, 0)) <= 0) {
+            break;
+        }
+        uint64_t now = evloop_now_us();
+        frame_view_t view;
+
+        // Validate frame identifiers, length and FCS
+        int status = frame_parse(buffer, size, &view);
+        if (status == FRAME_ERR_ID) {
+            LOG(EV_CLIENT_BAD_ID);
+            continue;
+        }
+        if (status != FRAME_OK) {
+            LOG(EV_CLIENT_BAD_LENGTH);
+            continue;
+        }
+        int bad_fcs = frame_fcs(&view) != view.fcs;
+        PCAP_CAPTURE(buffer, size, bad_fcs);
+        if (bad_fcs) {
+            LOG(EV_CLIENT_FCS_ERROR);
+            continue;
+        }
+
+        uint32_t slot = table_find(loop, exchange_key(view.addr1, view.frame_control.type, view.frame_control.subtype));
+        if (loop->keys[slot] == 0) {
+            loop->unmatched++;
+            continue;
+        }
+        exchange_t *exchange = loop->slots[slot];
+        uint64_t arrival_ns = received_ns(&msg);
+        if (arrival_ns != 0 && arrival_ns < exchange->first_sent_ns) {
+            loop->stale++;
+            continue;
+        }
+
+        // Karn's rule: a response to a retransmitted request could belong to any copy, so it is no sample
+        if (exchange->attempts == 1) {
+            rto_sample(loop->rto, (uint32_t)(now - exchange->sent_us));
+            LOG(EV_CLIENT_RTO, now - exchange->sent_us, loop->rto->srtt_us, loop->rto->rttvar_us, loop->rto->rto_us);
+        }
+        LOG_S(EV_CLIENT_RX_VALID, exchange->name);
+        exchange_finish(loop, exchange, EXCHANGE_OK, &view);
+    }
+    if (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNREFUSED) {
+        LOG(EV_CLIENT_RECV_ERROR, errno);
+        return -1;
+    }
+    return 0;
+}
+
+// Points the timerfd at the earliest deadline, if that changed
+static void evloop_arm_timer(evloop_t *loop) {
+    uint64_t deadline = loop->outstanding > 0 ? loop->heap[0]->deadline_us : 0;
+    if (deadline == loop->armed_us) {
+        return;
+    }
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = deadline / 1000000;
+    spec.it_value.tv_nsec = (deadline % 1000000) * 1000;
+    timerfd_settime(loop->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+    loop->armed_us = deadline;
+}
+
+/*
+* Dispatches socket and timer events until no exchange is outstanding or a callback sets loop->stop.
+* Callbacks may submit new exchanges.
+* Output: 0, or -1 on a socket error
+*/
+int evloop_run(evloop_t *loop) {
+    struct epoll_event events[2];
+    loop->stop = 0;
+    while (loop->outstanding > 0 && !loop->stop) {
+        evloop_arm_timer(loop);
+        int n = epoll_wait(loop->epoll_fd, events, 2, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG(EV_CLIENT_RECV_ERROR, errno);
+            return -1;
+        }
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.fd == loop->socket_fd) {
+                if (evloop_receive(loop) < 0) {
+                    return -1;
+                }
+            } else {
+                uint64_t expirations;
+                if (read(loop->timer_fd, &expirations, sizeof(expirations)) > 0) {
+                    loop->armed_us = 0;
+                }
+                if (evloop_expire(loop) < 0) {
+                    return -1;
+                }
+            }
+        }
+    }
+    return 0;
+}
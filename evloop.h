@@ -0,0 +1,80 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+evloop.h
+*/
+
+#ifndef EVLOOP_H
+#define EVLOOP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+#include "frame.h"
+#include "rto.h"
+
+#define EXCHANGE_FRAME_SIZE FRAME_MAX_WIRE_SIZE
+
+// Exchange results passed to the completion callback
+#define EXCHANGE_OK 0                 // A valid response arrived
+#define EXCHANGE_TIMEOUT -1           // Every attempt timed out
+
+typedef struct exchange exchange_t;
+typedef void (*exchange_done_t)(exchange_t *exchange, int result, const frame_view_t *response);
+
+/*
+* One request/response exchange with the AP, owned by the caller and kept alive until its callback runs.
+* The request is resent from frame[], with the retry bit set, each time its deadline passes. Responses are
+* matched to it by the responder's addr1 (our station address) and the response type and subtype the request expects,
+* and only if they arrived after its first attempt went out.
+*/
+struct exchange {
+    uint8_t frame[EXCHANGE_FRAME_SIZE];
+    size_t len;
+    const char *name;                 // For log messages
+    uint8_t station[MAC_ADDR_LEN];    // Transmitter address of the request
+    uint8_t response_type;
+    uint8_t response_subtype;
+    int attempts;
+    int max_attempts;
+    uint64_t sent_us;                 // When the current attempt went out
+    uint64_t first_sent_ns;           // Wall-clock time of the first attempt, against receive timestamps
+    uint64_t deadline_us;
+    uint32_t timeout_us;
+    int heap_index;                   // Position in the timer heap, -1 when not outstanding
+    exchange_done_t done;
+    void *user;
+};
+
+/*
+* Single-threaded client runtime: one epoll instance watching the socket and a timerfd. Outstanding
+* exchanges sit in a binary min-heap ordered by deadline, and the timerfd is always armed for the
+* earliest one; an open-addressing table finds the exchange a response belongs to.
+*/
+typedef struct {
+    int epoll_fd;
+    int timer_fd;
+    int socket_fd;
+    struct sockaddr_in dest;
+    rto_t *rto;                       // Retransmission timer state for dest
+    exchange_t **heap;
+    size_t outstanding;
+    uint64_t *keys;                   // Dispatch table: response key per slot, 0 = empty
+    exchange_t **slots;
+    uint32_t mask;
+    uint32_t capacity;                // Maximum outstanding exchanges
+    uint64_t armed_us;                // Deadline the timerfd is set for, 0 = disarmed
+    uint64_t unmatched;               // Valid responses that matched no outstanding exchange
+    uint64_t stale;                   // Valid responses that arrived before the exchange they matched was sent
+    int stop;                         // Set by a callback to make evloop_run() return
+} evloop_t;
+
+uint64_t evloop_now_us(void);
+int evloop_init(evloop_t *loop, int socket_fd, const struct sockaddr_in *dest, rto_t *rto, uint32_t capacity);
+void evloop_free(evloop_t *loop);
+int evloop_submit(evloop_t *loop, exchange_t *exchange, const char *name, int max_attempts);
+int evloop_send(evloop_t *loop, const uint8_t *frame, size_t len);
+int evloop_run(evloop_t *loop);
+
+#endif
@@ -0,0 +1,131 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+evloop_test.c
+*/
+
+// Test of the client event loop's response matching against a fake AP on a loopback socket: a delayed
+// ACK for an earlier, retransmitted exchange must not complete the next exchange from the same station
+// or feed the retransmission timer. Exits nonzero if any check fails.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include "evloop.h"
+#include "log.h"
+
+static const uint8_t TEST_AP_MAC[6] = {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xDD};
+static const uint8_t TEST_STATION_MAC[6] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+
+static int failures;
+
+#define CHECK(what, cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s: %s failed\n", what, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+typedef struct {
+    evloop_t *loop;
+    exchange_t *next;                 // Submitted when the first exchange completes
+    int result;                       // Result the exchange completed with, 1 while outstanding
+    uint32_t srtt_us;                 // Smoothed RTT once it completed
+} test_exchange_t;
+
+static test_exchange_t first_state, second_state;
+
+static void test_done(exchange_t *exchange, int result, const frame_view_t *response) {
+    test_exchange_t *state = exchange->user;
+    (void)response;
+    state->result = result;
+    state->srtt_us = state->loop->rto->srtt_us;
+    if (state->next && evloop_submit(state->loop, state->next, "second", 1) < 0) {
+        fprintf(stderr, "second exchange could not be submitted\n");
+        failures++;
+    }
+}
+
+static size_t build_data(uint8_t *buffer, uint16_t seq) {
+    return frame_build(buffer, PROTOCOL_VERSION, TYPE_DATA, SUBTYPE_DATA, FC_TO_DS, 2, TEST_AP_MAC, TEST_STATION_MAC,
+                       TEST_AP_MAC, SEQ_CTRL(seq, 0), 0, "stale ack test", 14);
+}
+
+/*
+* The first data frame is answered twice, as when the AP acknowledges both copies of a retransmitted
+* frame, and both ACKs are queued before the loop reads the first. The first completes the exchange,
+* whose callback submits the next data frame of the same station; the second ACK reached the socket
+* before that frame went out, so it is stale and the next exchange, allowed one attempt, times out.
+*/
+static void test_delayed_stale_ack(void) {
+    struct sockaddr_in ap_addr, client_addr;
+    socklen_t addr_len = sizeof(client_addr);
+    int ap_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int client_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&ap_addr, 0, sizeof(ap_addr));
+    ap_addr.sin_family = AF_INET;
+    ap_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    client_addr = ap_addr;
+    if (ap_fd < 0 || client_fd < 0 || bind(ap_fd, (struct sockaddr *)&ap_addr, sizeof(ap_addr)) < 0 ||
+        bind(client_fd, (struct sockaddr *)&client_addr, sizeof(client_addr)) < 0 ||
+        getsockname(ap_fd, (struct sockaddr *)&ap_addr, &addr_len) < 0 ||
+        getsockname(client_fd, (struct sockaddr *)&client_addr, &addr_len) < 0) {
+        perror("Loopback socket setup failed");
+        exit(EXIT_FAILURE);
+    }
+
+    rto_t rto;
+    evloop_t loop;
+    rto_init(&rto, 331);
+    if (evloop_init(&loop, client_fd, &ap_addr, &rto, 4) < 0) {
+        perror("evloop_init failed");
+        exit(EXIT_FAILURE);
+    }
+
+    static exchange_t first, second;
+    first_state = (test_exchange_t){ &loop, &second, 1, 0 };
+    second_state = (test_exchange_t){ &loop, NULL, 1, 0 };
+    first.len = build_data(first.frame, 1);
+    first.done = test_done;
+    first.user = &first_state;
+    second.len = build_data(second.frame, 2);
+    second.done = test_done;
+    second.user = &second_state;
+    if (evloop_submit(&loop, &first, "first", 1) < 0) {
+        fprintf(stderr, "first exchange could not be submitted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    uint8_t ack[FRAME_MAX_WIRE_SIZE];
+    size_t ack_len = frame_build(ack, PROTOCOL_VERSION, TYPE_CONTROL, SUBTYPE_ACK, FC_FROM_DS, 1,
+                                 TEST_STATION_MAC, NULL, NULL, 0, 0, NULL, 0);
+    for (int i = 0; i < 2; i++) {
+        sendto(ap_fd, ack, ack_len, 0, (struct sockaddr *)&client_addr, sizeof(client_addr));
+    }
+    usleep(10000);                      // Both ACKs are queued before the loop reads the first
+
+    CHECK("delayed stale ack", evloop_run(&loop) == 0);
+    CHECK("delayed stale ack", first_state.result == EXCHANGE_OK);
+    CHECK("delayed stale ack", second_state.result == EXCHANGE_TIMEOUT);
+    CHECK("delayed stale ack", loop.stale == 1);
+    CHECK("delayed stale ack", rto.has_sample && rto.srtt_us == first_state.srtt_us);   // No sample from the stale ACK
+
+    evloop_free(&loop);
+    close(ap_fd);
+    close(client_fd);
+}
+
+int main(void) {
+    log_level = LOG_ERROR;
+    test_delayed_stale_ack();
+    if (failures) {
+        fprintf(stderr, "evloop_test: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("evloop_test: a stale ACK does not complete the next exchange\n");
+    return 0;
+}
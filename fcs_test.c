@@ -0,0 +1,256 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+fcs_test.c
+*/
+
+// Equivalence tests for the FCS. The streaming legacy FCS, fcs_compute(FCS_ALG_LEGACY, ...) and the
+// getCheckSumValue() wrapper, must match the original bit-string implementation, kept below as the
+// reference, bit for bit, so frames keep interoperating with peers that still run it. Every CRC-32
+// kernel this CPU runs must match a bit-at-a-time CRC-32 and the standard check value, and every batch
+// verification kernel must agree with fcs_compute() frame by frame. Exits nonzero if anything mismatches.
+//
+// frame.c is compiled into this file so each kernel can be called directly, not just the one selected
+// for this CPU.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "frame.c"
+
+#define TEST_BUFFERS 300
+#define TEST_MAX_LEN 2400
+#define TEST_CRC32_MAX_LEN 1500         // Every length up to this is checked at every start offset
+#define TEST_CRC32_OFFSETS 16           // Start offsets, to cover every alignment of both kernels
+#define TEST_BATCH_STRIDE (FRAME_MAX_WIRE_SIZE + 3)     // Odd spacing, so batch frames start unaligned
+
+// The original generate32bitChecksum(), unchanged
+static uint32_t reference_hash(const char *valueToConvert) {
+    uint32_t checksum = 0;
+    while (*valueToConvert) {
+        checksum += *valueToConvert++;
+        checksum += (checksum << 10);
+        checksum ^= (checksum >> 6);
+    }
+    checksum += (checksum << 3);
+    checksum ^= (checksum >> 11);
+    checksum += (checksum << 15);
+    return checksum;
+}
+
+// The original getCheckSumValue(): one '0'/'1' character per bit, trimmed, then hashed.
+// Only defined for bytesToSkipFromStart + bytesToSkipFromEnd < size.
+static uint32_t reference_checksum(const void *ptr, size_t size, size_t bytesToSkipFromStart, size_t bytesToSkipFromEnd) {
+    const unsigned char *byte = (const unsigned char *)ptr;
+    char *buffer = malloc(size * 8 + 1);
+    size_t bits = 0;
+    for (size_t i = 0; i < size; i++) {
+        for (int j = 7; j >= 0; j--) {
+            buffer[bits++] = (char)(((byte[i] >> j) & 1) + '0');
+        }
+    }
+    buffer[bits - bytesToSkipFromEnd * 8] = '\0';
+    uint32_t checkSumValue = reference_hash(buffer + bytesToSkipFromStart * 8);
+    free(buffer);
+    return checkSumValue;
+}
+
+// Bit-at-a-time IEEE 802.11 CRC-32, the definition the table and folding kernels must reproduce
+static uint32_t reference_crc32(const uint8_t *data, size_t len) {
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int k = 0; k < 8; k++) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32_POLY : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+static int failures;
+
+static void check(const char *what, const uint8_t *data, size_t size, size_t skip_start, size_t skip_end) {
+    uint32_t expected = reference_checksum(data, size, skip_start, skip_end);
+    uint32_t streamed = fcs_compute(FCS_ALG_LEGACY, data + skip_start, size - skip_start - skip_end);
+    uint32_t wrapped = getCheckSumValue((void *)data, size, skip_start, skip_end);
+    if (streamed != expected || wrapped != expected) {
+        fprintf(stderr, "%s: size=%zu skip=%zu,%zu reference=0x%08X fcs_compute=0x%08X getCheckSumValue=0x%08X\n",
+                what, size, skip_start, skip_end, expected, streamed, wrapped);
+        failures++;
+    }
+}
+
+typedef struct {
+    const char *name;
+    uint32_t (*kernel)(uint32_t, const unsigned char *, size_t);
+} crc32_kernel_t;
+
+/*
+* Checks every CRC-32 kernel this CPU runs, and fcs_compute() with the selected one, against the
+* CRC-32 check value and against reference_crc32() for every length from 0 to TEST_CRC32_MAX_LEN at
+* every start offset. Output: number of kernels checked
+*/
+static int check_crc32(void) {
+    static const uint8_t check_input[] = "123456789";
+    static uint8_t data[TEST_CRC32_MAX_LEN + TEST_CRC32_OFFSETS];
+    crc32_kernel_t kernels[2] = { { "slice8", crc32_slice8 } };
+    int num_kernels = 1;
+#ifdef FCS_HAVE_PCLMUL
+    if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) {
+        kernels[num_kernels++] = (crc32_kernel_t){ "pclmul", crc32_pclmul };
+    }
+#endif
+
+    if (fcs_compute(FCS_ALG_CRC32, check_input, 9) != 0xCBF43926u) {
+        fprintf(stderr, "crc32 %s: check value 0x%08X, expected 0xCBF43926\n", fcs_kernel_name(),
+                fcs_compute(FCS_ALG_CRC32, check_input, 9));
+        failures++;
+    }
+    for (int k = 0; k < num_kernels; k++) {
+        uint32_t crc = ~kernels[k].kernel(0xFFFFFFFFu, check_input, 9);
+        if (crc != 0xCBF43926u) {
+            fprintf(stderr, "crc32 %s: check value 0x%08X, expected 0xCBF43926\n", kernels[k].name, crc);
+            failures++;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)rand();
+    }
+    for (size_t offset = 0; offset < TEST_CRC32_OFFSETS; offset++) {
+        for (size_t len = 0; len <= TEST_CRC32_MAX_LEN; len++) {
+            uint32_t expected = reference_crc32(data + offset, len);
+            for (int k = 0; k < num_kernels; k++) {
+                uint32_t crc = ~kernels[k].kernel(0xFFFFFFFFu, data + offset, len);
+                if (crc != expected) {
+                    fprintf(stderr, "crc32 %s: len=%zu offset=%zu reference=0x%08X kernel=0x%08X\n",
+                            kernels[k].name, len, offset, expected, crc);
+                    failures++;
+                }
+            }
+            if (fcs_compute(FCS_ALG_CRC32, data + offset, len) != expected) {
+                fprintf(stderr, "crc32 fcs_compute: len=%zu offset=%zu reference=0x%08X\n", len, offset, expected);
+                failures++;
+            }
+        }
+    }
+    return num_kernels;
+}
+
+typedef struct {
+    const char *name;
+    uint32_t (*kernel)(const uint8_t *const *, size_t, int);
+    int lanes;
+} batch_kernel_t;
+
+// Runs a batch kernel over count frames, lanes at a time, the way fcs_verify_batch() does
+static uint32_t run_batch_kernel(const batch_kernel_t *kernel, const uint8_t *const bodies[], size_t len, int count) {
+    uint32_t valid = 0;
+    for (int first = 0; first < count; first += kernel->lanes) {
+        int n = count - first < kernel->lanes ? count - first : kernel->lanes;
+        valid |= kernel->kernel(bodies + first, len, n) << first;
+    }
+    return valid;
+}
+
+/*
+* Checks fcs_verify_batch() and every batch kernel this CPU runs against fcs_compute() on each frame,
+* for both algorithms, every batch size up to FCS_BATCH_MAX and body lengths that exercise the kernels'
+* partial final words. Each batch runs once with every FCS correct and once with one frame's FCS wrong.
+* Output: number of legacy batch kernels checked
+*/
+static int check_batches(void) {
+    static const size_t lengths[] = { 0, 1, 2, 3, 4, 5, 7, 8, 13, 24, 63, 64, 100, 1027, FRAME_MAX_WIRE_SIZE - FRAME_OVERHEAD };
+    static uint8_t frames[FCS_BATCH_MAX * TEST_BATCH_STRIDE];
+    const uint8_t *bodies[FCS_BATCH_MAX];
+    batch_kernel_t kernels[2];
+    int num_kernels = 0;
+#ifdef FCS_HAVE_PCLMUL
+    if (__builtin_cpu_supports("avx2")) {
+        kernels[num_kernels++] = (batch_kernel_t){ "avx2", fcs_legacy_batch_avx2, 8 };
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        kernels[num_kernels++] = (batch_kernel_t){ "avx512", fcs_legacy_batch_avx512, 16 };
+    }
+#endif
+
+    for (int i = 0; i < FCS_BATCH_MAX; i++) {
+        bodies[i] = frames + (size_t)i * TEST_BATCH_STRIDE + 1;
+    }
+    for (int alg = FCS_ALG_LEGACY; alg <= FCS_ALG_CRC32; alg++) {
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+            size_t len = lengths[l];
+            for (int count = 1; count <= FCS_BATCH_MAX; count++) {
+                for (int pass = 0; pass < 2; pass++) {
+                    // Every FCS correct, then one wrong in a frame that moves with the length and batch size
+                    int bad_frame = pass == 0 ? -1 : (int)(len % (size_t)count);
+                    uint32_t expected = 0;
+                    for (int i = 0; i < count; i++) {
+                        uint8_t *body = (uint8_t *)bodies[i];
+                        for (size_t b = 0; b < len; b++) {
+                            body[b] = (uint8_t)rand();
+                        }
+                        uint32_t fcs = fcs_compute(alg, body, len);
+                        if (i == bad_frame) {
+                            fcs ^= 1u << (rand() % 32);
+                        } else {
+                            expected |= 1u << i;
+                        }
+                        memcpy(body + len, &fcs, FRAME_FCS_LEN);
+                    }
+
+                    uint32_t valid = fcs_verify_batch(alg, bodies, len, count);
+                    if (valid != expected) {
+                        fprintf(stderr, "batch %s alg=%d: len=%zu count=%d valid=0x%04X expected=0x%04X\n",
+                                fcs_batch_kernel_name(), alg, len, count, valid, expected);
+                        failures++;
+                    }
+                    for (int k = 0; alg == FCS_ALG_LEGACY && k < num_kernels; k++) {
+                        valid = run_batch_kernel(&kernels[k], bodies, len, count);
+                        if (valid != expected) {
+                            fprintf(stderr, "batch %s: len=%zu count=%d valid=0x%04X expected=0x%04X\n",
+                                    kernels[k].name, len, count, valid, expected);
+                            failures++;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return num_kernels;
+}
+
+int main(void) {
+    static uint8_t data[TEST_MAX_LEN];
+    srand(331);
+
+    // The zeroed frame, whole and with the frame identifiers and FCS skipped as the AP does
+    memset(data, 0, sizeof(data));
+    check("zeroed", data, FRAME_MAX_WIRE_SIZE, 0, 0);
+    check("zeroed", data, FRAME_MAX_WIRE_SIZE, FRAME_ID_LEN, FRAME_ID_LEN + FRAME_FCS_LEN);
+
+    for (int i = 0; i < TEST_BUFFERS; i++) {
+        size_t size = 1 + (size_t)rand() % TEST_MAX_LEN;
+        for (size_t b = 0; b < size; b++) {
+            data[b] = (uint8_t)rand();
+        }
+        check("random", data, size, 0, 0);
+        size_t skip_start = (size_t)rand() % size;
+        size_t skip_end = (size_t)rand() % (size - skip_start);
+        check("random skip", data, size, skip_start, skip_end);
+    }
+
+    int crc32_kernels = check_crc32();
+    int batch_kernels = check_batches();
+
+    if (failures) {
+        fprintf(stderr, "fcs_test: %d mismatches\n", failures);
+        return 1;
+    }
+    printf("fcs_test: legacy FCS matches the bit-string reference (%d buffers)\n", TEST_BUFFERS);
+    printf("fcs_test: %d CRC-32 kernels match the bitwise CRC-32 (lengths 0-%d, %d offsets)\n",
+           crc32_kernels, TEST_CRC32_MAX_LEN, TEST_CRC32_OFFSETS);
+    printf("fcs_test: fcs_verify_batch (%s) and %d legacy batch kernels match fcs_compute (batches of 1-%d)\n",
+           fcs_batch_kernel_name(), batch_kernels, FCS_BATCH_MAX);
+    return 0;
+}
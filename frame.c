@@ -13,19 +13,201 @@ frame.c
 #include <unistd.h>
 #include "frame.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FCS_HAVE_PCLMUL 1
+#endif
+
 /*
-* Takes in an input string and generates a 32-bit checksum hash value of type uint32_t
-* This function is internally called by the function getCheckSumValue(); so not to be called directly by
-developer
-* Input type: String
-* Output type: uint32_t
+* IEEE 802.11 CRC-32 (reflected polynomial 0xEDB88320, init and final XOR 0xFFFFFFFF)
+* crc32_tables[] drives the portable slicing-by-8 kernel; the PCLMULQDQ folding kernel is picked at
+* startup when the CPU supports it. Both kernels take and return the raw (pre-inversion) register.
 */
-uint32_t generate32bitChecksum(const char* valueToConvert) {
-    uint32_t checksum = 0;
-    while (*valueToConvert) {
-        checksum += *valueToConvert++;
-        checksum += (checksum << 10);
-        checksum ^= (checksum >> 6);
+#define CRC32_POLY 0xEDB88320u
+
+static uint32_t crc32_tables[8][256];
+
+static uint32_t crc32_slice8(uint32_t crc, const unsigned char *buf, size_t len) {
+    while (len && ((uintptr_t)buf & 7)) {
+        crc = crc32_tables[0][(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+        len--;
+    }
+    while (len >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, buf, 4);
+        memcpy(&hi, buf + 4, 4);
+        lo ^= crc;
+        crc = crc32_tables[7][lo & 0xFF] ^ crc32_tables[6][(lo >> 8) & 0xFF] ^
+              crc32_tables[5][(lo >> 16) & 0xFF] ^ crc32_tables[4][lo >> 24] ^
+              crc32_tables[3][hi & 0xFF] ^ crc32_tables[2][(hi >> 8) & 0xFF] ^
+              crc32_tables[1][(hi >> 16) & 0xFF] ^ crc32_tables[0][hi >> 24];
+        buf += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = crc32_tables[0][(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef FCS_HAVE_PCLMUL
+// Folds 64-byte blocks with carry-less multiplies, then Barrett-reduces to 32 bits.
+// Requires len >= 64; the tail that does not fill a 16-byte lane is finished by slicing-by-8.
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_pclmul(uint32_t crc, const unsigned char *buf, size_t len) {
+    static const uint64_t k1k2[2] __attribute__((aligned(16))) = { 0x0154442bd4, 0x01c6e41596 };
+    static const uint64_t k3k4[2] __attribute__((aligned(16))) = { 0x01751997d0, 0x00ccaa009e };
+    static const uint64_t k5k0[2] __attribute__((aligned(16))) = { 0x0163cd6124, 0x0000000000 };
+    static const uint64_t poly[2] __attribute__((aligned(16))) = { 0x01db710641, 0x01f7011641 };
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    if (len < 64) {
+        return crc32_slice8(crc, buf, len);
+    }
+
+    x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    x0 = _mm_load_si128((const __m128i *)k1k2);
+    buf += 64;
+    len -= 64;
+
+    while (len >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        y5 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+        y6 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+        y7 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+        y8 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+        buf += 64;
+        len -= 64;
+    }
+
+    // Fold the four lanes into one
+    x0 = _mm_load_si128((const __m128i *)k3k4);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    while (len >= 16) {
+        x2 = _mm_loadu_si128((const __m128i *)buf);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        buf += 16;
+        len -= 16;
+    }
+
+    // 128 -> 64 bits
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    x0 = _mm_load_si128((const __m128i *)poly);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    crc = (uint32_t)_mm_extract_epi32(x1, 1);
+
+    return len ? crc32_slice8(crc, buf, len) : crc;
+}
+#endif
+
+static uint32_t (*crc32_kernel)(uint32_t, const unsigned char *, size_t) = crc32_slice8;
+static const char *crc32_kernel_label = "slice8";
+
+// Builds the slicing tables and selects the fastest CRC-32 kernel for this CPU before main() runs
+__attribute__((constructor))
+static void crc32_setup(void) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t crc = n;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32_POLY : crc >> 1;
+        }
+        crc32_tables[0][n] = crc;
+    }
+    for (uint32_t n = 0; n < 256; n++) {
+        for (int k = 1; k < 8; k++) {
+            crc32_tables[k][n] = crc32_tables[0][crc32_tables[k - 1][n] & 0xFF] ^ (crc32_tables[k - 1][n] >> 8);
+        }
+    }
+#ifdef FCS_HAVE_PCLMUL
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) {
+        crc32_kernel = crc32_pclmul;
+        crc32_kernel_label = "pclmul";
+    }
+#endif
+}
+
+// Name of the CRC-32 kernel selected for this CPU
+const char *fcs_kernel_name(void) {
+    return crc32_kernel_label;
+}
+
+/*
+* Streaming Frame Check Sequence engine
+* FCS_ALG_LEGACY: the one-at-a-time hash of the frame written out as a string of ASCII '0'/'1' characters,
+* most significant bit first. Rather than building that string, each byte is expanded into its eight bit
+* characters on the fly and mixed straight into the running state, so no memory is allocated and the cost
+* is linear in the number of bytes hashed.
+* FCS_ALG_CRC32: the standard IEEE 802.11 CRC-32.
+* Usage: fcs_init(), then fcs_update() over one or more byte ranges in order, then fcs_final()
+*/
+void fcs_init(fcs_ctx_t *ctx, int alg) {
+    ctx->alg = (uint8_t)alg;
+    ctx->state = (alg == FCS_ALG_CRC32) ? 0xFFFFFFFFu : 0;
+}
+
+void fcs_update(fcs_ctx_t *ctx, const void *data, size_t len) {
+    const unsigned char *byte = (const unsigned char *)data;
+    if (ctx->alg == FCS_ALG_CRC32) {
+        ctx->state = crc32_kernel(ctx->state, byte, len);
+        return;
+    }
+
+    uint32_t checksum = ctx->state;
+    for (size_t i = 0; i < len; i++) {
+        for (int j = 7; j >= 0; j--) {
+            checksum += '0' + ((byte[i] >> j) & 1);
+            checksum += (checksum << 10);
+            checksum ^= (checksum >> 6);
+        }
+    }
+    ctx->state = checksum;
+}
+
+uint32_t fcs_final(const fcs_ctx_t *ctx) {
+    uint32_t checksum = ctx->state;
+    if (ctx->alg == FCS_ALG_CRC32) {
+        return ~checksum;
     }
     checksum += (checksum << 3);
     checksum ^= (checksum >> 11);
@@ -33,6 +215,189 @@ uint32_t generate32bitChecksum(const char* valueToConvert) {
     return checksum;
 }
 
+// One-shot FCS over a contiguous byte range
+uint32_t fcs_compute(int alg, const void *data, size_t len) {
+    fcs_ctx_t ctx;
+    fcs_init(&ctx, alg);
+    fcs_update(&ctx, data, len);
+    return fcs_final(&ctx);
+}
+
+// FCS of a parsed frame, using the algorithm selected by its protocol_version field
+uint32_t frame_fcs(const frame_view_t *view) {
+    return fcs_compute(view->frame_control.protocol_version, view->body, view->body_len);
+}
+
+/*
+* Batch FCS verification: checks up to FCS_BATCH_MAX frames of one length at once. The legacy hash is a
+* serial chain through every bit of a frame, so one frame cannot use the vector unit, but equal-length
+* frames step through their chains in lockstep, one frame per 32-bit lane. Each lane's bytes are loaded
+* big-endian, so shifting the word left walks its bits in the order the hash consumes them (bytes in
+* order, most significant bit first). CRC-32 frames go through the PCLMULQDQ kernel one at a time,
+* which already runs at memory speed.
+*/
+static uint32_t fcs_load_be32(const uint8_t *p) {
+    uint32_t word;
+    memcpy(&word, p, sizeof(word));
+    return __builtin_bswap32(word);
+}
+
+// The last len % 4 bytes of a frame, packed into the top of a word like fcs_load_be32()
+static uint32_t fcs_load_be_tail(const uint8_t *p, size_t n) {
+    uint32_t word = 0;
+    for (size_t i = 0; i < n; i++) {
+        word |= (uint32_t)p[i] << (24 - 8 * i);
+    }
+    return word;
+}
+
+static uint32_t fcs_load_fcs(const uint8_t *body, size_t len) {
+    uint32_t fcs;
+    memcpy(&fcs, body + len, FRAME_FCS_LEN);
+    return fcs;
+}
+
+static uint32_t fcs_verify_scalar(int alg, const uint8_t *const bodies[], size_t len, int count) {
+    uint32_t valid = 0;
+    for (int i = 0; i < count; i++) {
+        if (fcs_compute(alg, bodies[i], len) == fcs_load_fcs(bodies[i], len)) {
+            valid |= 1u << i;
+        }
+    }
+    return valid;
+}
+
+#ifdef FCS_HAVE_PCLMUL
+// Hashes the top bits of each lane of word, most significant first, into h
+#define FCS_LEGACY_BITS(add, sll, srl, xor, set1, h, word, bits) \
+    for (int b = 0; b < (bits); b++) { \
+        h = add(h, add(srl(word, 31), set1('0'))); \
+        h = add(h, sll(h, 10)); \
+        h = xor(h, srl(h, 6)); \
+        word = sll(word, 1); \
+    }
+
+__attribute__((target("avx2")))
+static uint32_t fcs_legacy_batch_avx2(const uint8_t *const bodies[], size_t len, int count) {
+    const uint8_t *p[8];
+    for (int i = 0; i < 8; i++) {
+        p[i] = bodies[i < count ? i : 0];   // Idle lanes repeat frame 0 and are masked off
+    }
+    __m256i h = _mm256_setzero_si256();
+    __m256i word;
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        word = _mm256_setr_epi32((int)fcs_load_be32(p[0] + i), (int)fcs_load_be32(p[1] + i),
+                                 (int)fcs_load_be32(p[2] + i), (int)fcs_load_be32(p[3] + i),
+                                 (int)fcs_load_be32(p[4] + i), (int)fcs_load_be32(p[5] + i),
+                                 (int)fcs_load_be32(p[6] + i), (int)fcs_load_be32(p[7] + i));
+        FCS_LEGACY_BITS(_mm256_add_epi32, _mm256_slli_epi32, _mm256_srli_epi32, _mm256_xor_si256,
+                        _mm256_set1_epi32, h, word, 32)
+    }
+    if (i < len) {
+        size_t n = len - i;
+        word = _mm256_setr_epi32((int)fcs_load_be_tail(p[0] + i, n), (int)fcs_load_be_tail(p[1] + i, n),
+                                 (int)fcs_load_be_tail(p[2] + i, n), (int)fcs_load_be_tail(p[3] + i, n),
+                                 (int)fcs_load_be_tail(p[4] + i, n), (int)fcs_load_be_tail(p[5] + i, n),
+                                 (int)fcs_load_be_tail(p[6] + i, n), (int)fcs_load_be_tail(p[7] + i, n));
+        FCS_LEGACY_BITS(_mm256_add_epi32, _mm256_slli_epi32, _mm256_srli_epi32, _mm256_xor_si256,
+                        _mm256_set1_epi32, h, word, (int)(8 * n))
+    }
+    h = _mm256_add_epi32(h, _mm256_slli_epi32(h, 3));
+    h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 11));
+    h = _mm256_add_epi32(h, _mm256_slli_epi32(h, 15));
+    __m256i expected = _mm256_setr_epi32((int)fcs_load_fcs(p[0], len), (int)fcs_load_fcs(p[1], len),
+                                         (int)fcs_load_fcs(p[2], len), (int)fcs_load_fcs(p[3], len),
+                                         (int)fcs_load_fcs(p[4], len), (int)fcs_load_fcs(p[5], len),
+                                         (int)fcs_load_fcs(p[6], len), (int)fcs_load_fcs(p[7], len));
+    uint32_t valid = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(h, expected)));
+    return valid & ((1u << count) - 1);
+}
+
+__attribute__((target("avx512f")))
+static uint32_t fcs_legacy_batch_avx512(const uint8_t *const bodies[], size_t len, int count) {
+    const uint8_t *p[16];
+    uint32_t lanes[16];
+    for (int i = 0; i < 16; i++) {
+        p[i] = bodies[i < count ? i : 0];
+    }
+    __m512i h = _mm512_setzero_si512();
+    __m512i word;
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        for (int k = 0; k < 16; k++) {
+            lanes[k] = fcs_load_be32(p[k] + i);
+        }
+        word = _mm512_loadu_si512(lanes);
+        FCS_LEGACY_BITS(_mm512_add_epi32, _mm512_slli_epi32, _mm512_srli_epi32, _mm512_xor_si512,
+                        _mm512_set1_epi32, h, word, 32)
+    }
+    if (i < len) {
+        size_t n = len - i;
+        for (int k = 0; k < 16; k++) {
+            lanes[k] = fcs_load_be_tail(p[k] + i, n);
+        }
+        word = _mm512_loadu_si512(lanes);
+        FCS_LEGACY_BITS(_mm512_add_epi32, _mm512_slli_epi32, _mm512_srli_epi32, _mm512_xor_si512,
+                        _mm512_set1_epi32, h, word, (int)(8 * n))
+    }
+    h = _mm512_add_epi32(h, _mm512_slli_epi32(h, 3));
+    h = _mm512_xor_si512(h, _mm512_srli_epi32(h, 11));
+    h = _mm512_add_epi32(h, _mm512_slli_epi32(h, 15));
+    for (int k = 0; k < 16; k++) {
+        lanes[k] = fcs_load_fcs(p[k], len);
+    }
+    uint32_t valid = _mm512_cmpeq_epi32_mask(h, _mm512_loadu_si512(lanes));
+    return valid & ((1u << count) - 1);
+}
+#endif
+
+static uint32_t (*fcs_legacy_batch)(const uint8_t *const *, size_t, int) = NULL;
+static int fcs_batch_lanes = 1;
+static const char *fcs_batch_label = "scalar";
+
+// Selects the widest legacy batch kernel this CPU runs
+__attribute__((constructor))
+static void fcs_batch_setup(void) {
+#ifdef FCS_HAVE_PCLMUL
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        fcs_legacy_batch = fcs_legacy_batch_avx512;
+        fcs_batch_lanes = 16;
+        fcs_batch_label = "avx512";
+    } else if (__builtin_cpu_supports("avx2")) {
+        fcs_legacy_batch = fcs_legacy_batch_avx2;
+        fcs_batch_lanes = 8;
+        fcs_batch_label = "avx2";
+    }
+#endif
+}
+
+// Name of the legacy batch FCS kernel selected for this CPU
+const char *fcs_batch_kernel_name(void) {
+    return fcs_batch_label;
+}
+
+/*
+* Checks count frames (at most FCS_BATCH_MAX) whose FCS-covered bodies are all len bytes long, each
+* followed directly by its FCS as on the wire, using algorithm alg.
+* Output: bitmask with bit i set if frame i's FCS is correct
+*/
+uint32_t fcs_verify_batch(int alg, const uint8_t *const bodies[], size_t len, int count) {
+    if (count > FCS_BATCH_MAX) {
+        count = FCS_BATCH_MAX;
+    }
+    if (alg != FCS_ALG_LEGACY || fcs_legacy_batch == NULL) {
+        return fcs_verify_scalar(alg, bodies, len, count);
+    }
+    uint32_t valid = 0;
+    for (int first = 0; first < count; first += fcs_batch_lanes) {
+        int n = count - first < fcs_batch_lanes ? count - first : fcs_batch_lanes;
+        valid |= fcs_legacy_batch(bodies + first, len, n) << first;
+    }
+    return valid;
+}
+
 /*
 * This function can be called by the developer to generate a 32-bit checksum directly from the pointer to your
 frame structure
@@ -46,25 +411,180 @@ and end (for crc calculation)
 * Output: uint 32 bit final Check Sum value
 */
 uint32_t getCheckSumValue(void *ptr, size_t size, size_t bytesToSkipFromStart, size_t bytesToSkipFromEnd) {
-    const unsigned char *byte = (const unsigned char *)ptr;
-    // binaryString[] is a logical representation of 1 byte. Each character in it represents 1 bit.
-    char binaryString[9]; // One additional character for the null terminator
-    binaryString[8] = '\0'; // Null terminator definition
-
-    char *buffer = malloc(1); // Allocates space for an empty string (1 byte for the null terminator)
-    buffer[0] = '\0'; // Initializes an empty string
-    for (size_t i = 1; i <= size; i++) {
-        for (int j = 7; j >= 0; j--) {
-            int bit = (byte[i - 1] >> j) & 1;
-            binaryString[7 - j] = bit + '0'; // Converts bit to character '0' or '1'
+    fcs_ctx_t ctx;
+    fcs_init(&ctx, FCS_ALG_LEGACY);
+    if (bytesToSkipFromStart + bytesToSkipFromEnd < size) {
+        fcs_update(&ctx, (const unsigned char *)ptr + bytesToSkipFromStart,
+                   size - bytesToSkipFromStart - bytesToSkipFromEnd);
+    }
+    return fcs_final(&ctx);
+}
+
+// Number of header bytes (frame_control through addr4 or qos_ctrl) carried on the wire for this frame type
+size_t frame_header_len(frame_control_t frame_control) {
+    if (frame_control.type == TYPE_CONTROL) {
+        if (frame_control.subtype == SUBTYPE_CTS || frame_control.subtype == SUBTYPE_ACK) {
+            return 10;                      // frame_control, duration_id, addr1
+        }
+        return 16;                          // + addr2
+    }
+    size_t len = 24;                        // + addr3, seq_ctrl
+    if (frame_control.type == TYPE_DATA) {
+        if (frame_control.to_ds && frame_control.from_ds) {
+            len += MAC_ADDR_LEN;            // + addr4
         }
-        buffer = realloc(buffer, strlen(buffer) + strlen(binaryString) + 1); // Resizes buffer to fit the concatenated
-        strcat(buffer, binaryString);
-    }
-    buffer[strlen(buffer)-(bytesToSkipFromEnd*8)] = '\0';
-    memmove(buffer, buffer + (bytesToSkipFromStart*8), strlen(buffer) - (bytesToSkipFromStart*8) + 1); //+1
-    
-    uint32_t checkSumValue = generate32bitChecksum(buffer);
-    free(buffer); // Freeing memory allocated by malloc.
-    return checkSumValue;
+        if (frame_control.subtype & SUBTYPE_QOS_DATA) {
+            len += sizeof(uint16_t);        // + qos_ctrl
+        }
+    }
+    return len;
+}
+
+// Output: size of the fixed body a control frame carries after its header (0 for most)
+size_t frame_control_body_len(frame_control_t frame_control) {
+    if (frame_control.type != TYPE_CONTROL) {
+        return 0;
+    }
+    if (frame_control.subtype == SUBTYPE_BLOCK_ACK_REQ) {
+        return BLOCK_ACK_REQ_BODY_LEN;
+    }
+    if (frame_control.subtype == SUBTYPE_BLOCK_ACK) {
+        return BLOCK_ACK_BODY_LEN;
+    }
+    return 0;
+}
+
+/*
+* Builds a frame directly into buffer in the compact wire format described in frame.h: the header fields
+* the frame type carries, payload_len bytes of payload and the FCS, using the algorithm that version selects.
+* flags are the FC_* bits of the second Frame Control byte. Addresses the frame type does not carry may be
+* NULL, and a four-address data frame gets an all-zero addr4. Control frames carry only their fixed body
+* (see frame_control_body_len()), so payload_len is ignored for them.
+* Output: number of bytes written, at most FRAME_MAX_WIRE_SIZE, or 0 if payload_len exceeds MAX_PAYLOAD_SIZE
+*/
+size_t frame_build(uint8_t *buffer, uint8_t version, uint8_t type, uint8_t subtype, uint8_t flags,
+                   uint16_t duration_id, const uint8_t *addr1, const uint8_t *addr2, const uint8_t *addr3,
+                   uint16_t seq_ctrl, uint16_t qos_ctrl, const void *payload, size_t payload_len) {
+    uint16_t frame_id = START_FRAME_ID;
+    uint8_t *body = buffer + FRAME_ID_LEN;
+    frame_control_t frame_control;
+
+    body[0] = FC_FIRST_BYTE(version, type, subtype);
+    body[1] = flags;
+    memcpy(&frame_control, body, sizeof(frame_control_t));
+    size_t header_len = frame_header_len(frame_control);
+
+    if (type == TYPE_CONTROL) {
+        payload_len = frame_control_body_len(frame_control);
+    } else if (payload_len > MAX_PAYLOAD_SIZE) {
+        return 0;
+    }
+
+    memcpy(buffer, &frame_id, FRAME_ID_LEN);
+    memcpy(body + 2, &duration_id, sizeof(uint16_t));
+    memcpy(body + 4, addr1, MAC_ADDR_LEN);
+    if (header_len >= 16) {
+        memcpy(body + 10, addr2, MAC_ADDR_LEN);
+    }
+    if (header_len >= 24) {
+        memcpy(body + 16, addr3, MAC_ADDR_LEN);
+        memcpy(body + 22, &seq_ctrl, sizeof(uint16_t));
+    }
+    if (type == TYPE_DATA && (flags & (FC_TO_DS | FC_FROM_DS)) == (FC_TO_DS | FC_FROM_DS)) {
+        memset(body + 24, 0, MAC_ADDR_LEN);
+    }
+    if (type == TYPE_DATA && (subtype & SUBTYPE_QOS_DATA)) {
+        memcpy(body + header_len - sizeof(uint16_t), &qos_ctrl, sizeof(uint16_t));
+    }
+    if (payload_len > 0) {
+        memcpy(body + header_len, payload, payload_len);
+    }
+
+    size_t body_len = header_len + payload_len;
+    uint32_t fcs = fcs_compute(version, body, body_len);
+    memcpy(body + body_len, &fcs, FRAME_FCS_LEN);
+    frame_id = END_FRAME_ID;
+    memcpy(body + body_len + FRAME_FCS_LEN, &frame_id, FRAME_ID_LEN);
+
+    return FRAME_OVERHEAD + body_len;
+}
+
+/*
+* Sets the retry bit of a frame built by frame_build() that is about to be sent again. The FCS is recomputed
+* but keeps whatever error the frame already had, so a frame sent with a bad FCS on purpose stays bad.
+*/
+void frame_mark_retry(uint8_t *buffer, size_t len) {
+    uint8_t *body = buffer + FRAME_ID_LEN;
+    size_t body_len = len - FRAME_OVERHEAD;
+    int alg = body[0] & 0x03;
+    uint32_t fcs;
+    if (body[1] & FC_RETRY) {
+        return;
+    }
+    memcpy(&fcs, body + body_len, FRAME_FCS_LEN);
+    uint32_t error = fcs ^ fcs_compute(alg, body, body_len);
+    body[1] |= FC_RETRY;
+    fcs = fcs_compute(alg, body, body_len) ^ error;
+    memcpy(body + body_len, &fcs, FRAME_FCS_LEN);
+}
+
+/*
+* Parses a received datagram of len bytes without copying it. The payload length is whatever is left
+* between the header and the FCS (at most MAX_PAYLOAD_SIZE), so len must be the exact datagram size
+* returned by recvfrom().
+* The FCS is not checked here; compare view->fcs against frame_fcs(view).
+* Output: FRAME_OK, FRAME_ERR_LENGTH or FRAME_ERR_ID
+*/
+int frame_parse(const uint8_t *buffer, size_t len, frame_view_t *view) {
+    uint16_t start_id, end_id;
+    size_t header_len;
+
+    if (len < FRAME_MIN_WIRE_SIZE || len > FRAME_MAX_WIRE_SIZE) {
+        return FRAME_ERR_LENGTH;
+    }
+    memcpy(&start_id, buffer, FRAME_ID_LEN);
+    memcpy(&end_id, buffer + len - FRAME_ID_LEN, FRAME_ID_LEN);
+    if (start_id != START_FRAME_ID || end_id != END_FRAME_ID) {
+        return FRAME_ERR_ID;
+    }
+
+    memset(view, 0, sizeof(*view));
+    view->body = buffer + FRAME_ID_LEN;
+    view->body_len = len - FRAME_OVERHEAD;
+    memcpy(&view->frame_control, view->body, sizeof(frame_control_t));
+
+    header_len = frame_header_len(view->frame_control);
+    if (view->body_len < header_len) {
+        return FRAME_ERR_LENGTH;
+    }
+    if (view->frame_control.type == TYPE_CONTROL &&
+        view->body_len != header_len + frame_control_body_len(view->frame_control)) {
+        return FRAME_ERR_LENGTH;
+    }
+
+    memcpy(&view->duration_id, view->body + 2, sizeof(uint16_t));
+    view->addr1 = view->body + 4;
+    if (header_len >= 16) {
+        view->addr2 = view->body + 10;
+    }
+    if (header_len >= 24) {
+        view->addr3 = view->body + 16;
+        memcpy(&view->seq_ctrl, view->body + 22, sizeof(uint16_t));
+    }
+    if (view->frame_control.type == TYPE_DATA) {
+        if (view->frame_control.to_ds && view->frame_control.from_ds) {
+            view->addr4 = view->body + 24;
+        }
+        if (view->frame_control.subtype & SUBTYPE_QOS_DATA) {
+            memcpy(&view->qos_ctrl, view->body + header_len - sizeof(uint16_t), sizeof(uint16_t));
+        }
+    }
+    view->payload = view->body + header_len;
+    view->payload_len = view->body_len - header_len;
+    if (view->payload_len > MAX_PAYLOAD_SIZE) {
+        return FRAME_ERR_LENGTH;        // FRAME_MAX_WIRE_SIZE allows for the longest header, not this one
+    }
+    memcpy(&view->fcs, view->body + view->body_len, FRAME_FCS_LEN);
+
+    return FRAME_OK;
 }
\ No newline at end of file
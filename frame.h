@@ -9,13 +9,19 @@ frame.h
 #define FRAME_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 // Frame identifiers
 #define START_FRAME_ID 0xFFFF
 #define END_FRAME_ID 0xFFFF
 
-// Protocol version
-#define PROTOCOL_VERSION 0
+// Protocol version. The version field also tells the receiver which FCS algorithm the sender used.
+#define PROTOCOL_VERSION 0          // Legacy checksum FCS
+#define PROTOCOL_VERSION_CRC32 1    // IEEE 802.11 CRC-32 FCS
+
+// FCS algorithms (numbered to match the protocol version that selects them)
+#define FCS_ALG_LEGACY PROTOCOL_VERSION
+#define FCS_ALG_CRC32 PROTOCOL_VERSION_CRC32
 
 // Frame types
 #define TYPE_MANAGEMENT 0x00
@@ -32,9 +38,30 @@ frame.h
 #define SUBTYPE_RTS 0x0B
 #define SUBTYPE_CTS 0x0C
 #define SUBTYPE_ACK 0x0D
+#define SUBTYPE_BLOCK_ACK_REQ 0x08
+#define SUBTYPE_BLOCK_ACK 0x09
+#define SUBTYPE_PS_POLL 0x0A               // duration_id carries the station's association ID
 
 // Data frame subtypes
 #define SUBTYPE_DATA 0x00
+#define SUBTYPE_QOS_DATA 0x08            // Data subtypes with this bit set carry a QoS Control field
+
+// QoS Control ack policy (bits 5-6)
+#define QOS_ACK_POLICY_SHIFT 5
+#define QOS_ACK_NORMAL 0                 // Acknowledge with an ACK
+#define QOS_ACK_BLOCK 3                  // Recorded by the receiver, acknowledged by a Block Ack on request
+
+// Sequence control: 12-bit sequence number above a 4-bit fragment number
+#define SEQ_MODULO 4096
+#define SEQ_CTRL(seq, frag) ((uint16_t)((((seq) & (SEQ_MODULO - 1)) << 4) | ((frag) & 0x0F)))
+#define SEQ_NUM(seq_ctrl) ((uint16_t)((seq_ctrl) >> 4))
+#define SEQ_FRAG(seq_ctrl) ((uint16_t)((seq_ctrl) & 0x0F))
+
+// Block Ack Request body: bar_control, starting sequence control
+// Block Ack body: ba_control, starting sequence control, bitmap (bit n = starting sequence + n received)
+#define BLOCK_ACK_REQ_BODY_LEN 4
+#define BLOCK_ACK_BODY_LEN 12
+#define BLOCK_ACK_WINDOW 64
 
 // Maximum sizes
 #define MAX_PAYLOAD_SIZE 1024
@@ -42,6 +69,21 @@ frame.h
 
 #define MAC_ADDR_LEN 6
 
+// Frame Control flag bits (second byte of the field), as passed to frame_build()
+#define FC_TO_DS 0x01
+#define FC_FROM_DS 0x02
+#define FC_MORE_FRAG 0x04
+#define FC_RETRY 0x08
+#define FC_POWER_MGMT 0x10
+#define FC_MORE_DATA 0x20
+#define FC_WEP 0x40
+#define FC_ORDER 0x80
+
+// First Frame Control byte (protocol version, type, subtype), the same bytes as the frame_control_t
+// bit-fields, which GCC allocates from the least significant bit
+#define FC_FIRST_BYTE(version, type, subtype) \
+    ((uint8_t)(((version) & 0x03) | ((type) & 0x03) << 2 | ((subtype) & 0x0F) << 4))
+
 // IEEE 802.11 Frame Control field (2 bytes)
 typedef struct __attribute__((packed)) {
     uint8_t protocol_version : 2;
@@ -67,18 +109,84 @@ typedef struct __attribute__((packed)) {
     uint8_t addr3[MAC_ADDR_LEN];      // BSSID
     uint16_t seq_ctrl;                // Sequence control
     uint8_t addr4[MAC_ADDR_LEN];      // Fourth address (optional)
+    uint16_t qos_ctrl;                // QoS Control (QoS data subtypes only)
     uint8_t payload[MAX_PAYLOAD_SIZE];
     uint32_t fcs;                     // Frame Check Sequence
 } ieee80211_frame;
 
-// UDP payload wrapper for IEEE 802.11 frame
-typedef struct __attribute__((packed)) {
-    uint16_t start_frame_id;
-    ieee80211_frame frame;
-    uint16_t end_frame_id;
-} udp_payload;
+/*
+* Wire format of one frame inside a UDP datagram (host byte order, no padding).
+* Only the header fields that exist for the frame type are sent, and the payload is sent at its real length:
+*     start_frame_id      2
+*     frame_control       2
+*     duration_id         2
+*     addr1               6
+*     addr2               6   all frames except CTS and ACK
+*     addr3, seq_ctrl     8   management and data frames
+*     addr4               6   data frames with both to_ds and from_ds set
+*     qos_ctrl            2   QoS data frames
+*     payload             n   management and data frames, n <= MAX_PAYLOAD_SIZE;
+*                             the fixed-size body of Block Ack Request and Block Ack frames
+*     fcs                 4   covers frame_control through the end of the payload
+*     end_frame_id        2
+*/
+#define FRAME_ID_LEN 2
+#define FRAME_FCS_LEN 4
+#define FRAME_MIN_HEADER_LEN 10
+#define FRAME_MAX_HEADER_LEN 32
+#define FRAME_OVERHEAD (2 * FRAME_ID_LEN + FRAME_FCS_LEN)
+#define FRAME_MIN_WIRE_SIZE (FRAME_OVERHEAD + FRAME_MIN_HEADER_LEN)
+#define FRAME_MAX_WIRE_SIZE (FRAME_OVERHEAD + FRAME_MAX_HEADER_LEN + MAX_PAYLOAD_SIZE)
+
+// frame_parse() results
+#define FRAME_OK 0
+#define FRAME_ERR_LENGTH -1      // Datagram too short, too long, or wrong size for its frame type
+#define FRAME_ERR_ID -2          // Start or end frame identifier missing
+
+// Decoded view of a frame in place in a datagram. Fields the frame type does not carry are NULL/0.
+typedef struct {
+    frame_control_t frame_control;
+    uint16_t duration_id;
+    const uint8_t *addr1;
+    const uint8_t *addr2;
+    const uint8_t *addr3;
+    const uint8_t *addr4;
+    uint16_t seq_ctrl;
+    uint16_t qos_ctrl;
+    const uint8_t *payload;
+    size_t payload_len;
+    uint32_t fcs;                     // FCS as received
+    const uint8_t *body;              // First byte covered by the FCS
+    size_t body_len;
+} frame_view_t;
+
+// Most frames one fcs_verify_batch() call checks
+#define FCS_BATCH_MAX 16
 
-// FCS calculation function
+// Streaming FCS state
+typedef struct {
+    uint32_t state;
+    uint8_t alg;
+} fcs_ctx_t;
+
+// FCS calculation functions
+void fcs_init(fcs_ctx_t *ctx, int alg);
+void fcs_update(fcs_ctx_t *ctx, const void *data, size_t len);
+uint32_t fcs_final(const fcs_ctx_t *ctx);
+uint32_t fcs_compute(int alg, const void *data, size_t len);
+uint32_t frame_fcs(const frame_view_t *view);
+const char *fcs_kernel_name(void);
+uint32_t fcs_verify_batch(int alg, const uint8_t *const bodies[], size_t len, int count);
+const char *fcs_batch_kernel_name(void);
 uint32_t getCheckSumValue(void *buffer, size_t size, size_t start, size_t len);
 
+// Wire encoding functions
+size_t frame_header_len(frame_control_t frame_control);
+size_t frame_control_body_len(frame_control_t frame_control);
+size_t frame_build(uint8_t *buffer, uint8_t version, uint8_t type, uint8_t subtype, uint8_t flags,
+                   uint16_t duration_id, const uint8_t *addr1, const uint8_t *addr2, const uint8_t *addr3,
+                   uint16_t seq_ctrl, uint16_t qos_ctrl, const void *payload, size_t payload_len);
+void frame_mark_retry(uint8_t *buffer, size_t len);
+int frame_parse(const uint8_t *buffer, size_t len, frame_view_t *view);
+
 #endif
\ No newline at end of file
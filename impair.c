@@ -0,0 +1,704 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+impair.c
+*/
+
+// UDP relay that sits between stations and the AP and impairs the channel: random and bursty
+// (Gilbert-Elliott) loss, fixed delay with jitter, reordering, duplication and bit errors. Point the
+// client at its port (./client -p 8090) and it forwards to the AP on 8080 and relays the responses back.
+//
+// Every decision comes from a seeded generator, one stream per direction, drawn in the order the
+// packets of that direction arrive; the same seed and the same traffic give the same drops, copies and
+// flipped bits. The relay is one thread on epoll with batched recvmmsg/sendmmsg, and delayed packets
+// wait in a heap of preallocated slots, so it relays far faster than the AP answers.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define SERVER_IP "127.0.0.1"
+#define SERVER_PORT 8080
+#define DEFAULT_LISTEN_PORT 8090
+#define MAX_BUFFER_SIZE 2500
+#define IMPAIR_BATCH 64                 // Datagrams per recvmmsg/sendmmsg
+#define IMPAIR_MAX_FLOWS 1024           // Distinct station sockets; each gets its own socket to the AP
+#define IMPAIR_FLOW_BUCKETS 2048        // Power of two, at least twice IMPAIR_MAX_FLOWS
+#define DEFAULT_QUEUE 8192              // Packets that can be held for delay at once
+#define IMPAIR_SOCKET_BUFFER (4 << 20)
+
+#define DIR_UP 0                        // Station to AP
+#define DIR_DOWN 1                      // AP to station
+
+// What is done to the packets of one direction
+typedef struct {
+    double loss_good;                   // Loss probability in the good state (-l)
+    double loss_bad;                    // Loss probability in the bad state
+    double p_good_bad;                  // Per-packet chance of entering the bad state; 0 = no bursts
+    double p_bad_good;                  // Per-packet chance of leaving it
+    uint64_t delay_ns;
+    uint64_t jitter_ns;                 // Uniform in +-jitter around delay, never below zero
+    double reorder;                     // Chance that a packet is held back by reorder_ns more
+    uint64_t reorder_ns;
+    double duplicate;                   // Chance that a packet is sent twice
+    double ber;                         // Bit error rate over every forwarded bit
+} impair_params_t;
+
+typedef struct {
+    const char *name;
+    int enabled;
+    uint64_t rng;
+    int bad;                            // Gilbert-Elliott state
+    uint64_t clean_bits;                // Bits left before the next bit error
+    uint64_t received;
+    uint64_t bytes;
+    uint64_t forwarded;                 // Copies sent, duplicates included
+    uint64_t lost;
+    uint64_t lost_bad;                  // Of lost, dropped in the bad state
+    uint64_t bursts;                    // Entries into the bad state
+    uint64_t duplicated;
+    uint64_t reordered;
+    uint64_t corrupted;                 // Copies with at least one flipped bit
+    uint64_t bit_flips;
+    uint64_t queue_drops;               // No free slot to hold the copy
+    uint64_t send_drops;                // Socket buffer full or AP not listening
+    uint64_t delay_total_ns;
+} impair_dir_t;
+
+typedef struct {
+    struct sockaddr_in station;
+    int fd;                             // Connected to the AP
+} impair_flow_t;
+
+typedef struct {
+    uint64_t due_ns;
+    uint64_t order;                     // Ties on due_ns leave in arrival order
+    uint32_t flow;
+    uint16_t len;
+    uint8_t dir;
+    uint8_t data[MAX_BUFFER_SIZE];
+} impair_packet_t;
+
+typedef struct {
+    impair_params_t params;
+    impair_dir_t dirs[2];
+    int verbose;
+
+    int listen_fd;
+    int epoll_fd;
+    int timer_fd;
+    uint64_t timer_due_ns;              // 0 = disarmed
+    struct sockaddr_in ap_addr;
+
+    impair_flow_t flows[IMPAIR_MAX_FLOWS];
+    uint32_t flow_count;
+    int32_t flow_buckets[IMPAIR_FLOW_BUCKETS];      // Flow index, -1 = empty
+    uint64_t flows_refused;
+
+    impair_packet_t *slots;
+    uint32_t *free_slots;
+    uint32_t free_count;
+    uint32_t *heap;                     // Slot indices ordered by (due_ns, order)
+    uint32_t heap_len;
+    uint32_t peak_held;
+    uint64_t next_order;
+
+    // Receive batch
+    uint8_t rx_data[IMPAIR_BATCH][MAX_BUFFER_SIZE];
+    struct sockaddr_in rx_addr[IMPAIR_BATCH];
+    struct iovec rx_iov[IMPAIR_BATCH];
+    struct mmsghdr rx_msgs[IMPAIR_BATCH];
+
+    // Send batch: all for one socket, slots freed once it is flushed
+    int tx_fd;
+    int tx_dir;
+    uint32_t tx_slots[IMPAIR_BATCH];
+    struct iovec tx_iov[IMPAIR_BATCH];
+    struct mmsghdr tx_msgs[IMPAIR_BATCH];
+    int tx_count;
+} impair_t;
+
+static impair_t relay;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// xorshift64*
+static uint64_t impair_rand(impair_dir_t *dir) {
+    uint64_t x = dir->rng;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    dir->rng = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static double impair_uniform(impair_dir_t *dir) {
+    return (double)(impair_rand(dir) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int impair_chance(impair_dir_t *dir, double p) {
+    return p > 0 && impair_uniform(dir) < p;
+}
+
+// Clean bits before the next error: geometric with mean 1 / ber, so errors cost nothing per clean bit
+static uint64_t next_clean_bits(impair_dir_t *dir, double ber) {
+    if (ber <= 0) {
+        return UINT64_MAX;
+    }
+    if (ber >= 1) {
+        return 0;
+    }
+    double gap = floor(log(1.0 - impair_uniform(dir)) / log1p(-ber));
+    return gap >= 1.8e19 ? UINT64_MAX : (uint64_t)gap;
+}
+
+// Flips the bits of data that the error process lands on. Output: number of bits flipped
+static unsigned corrupt_bits(impair_dir_t *dir, double ber, uint8_t *data, size_t len) {
+    uint64_t bits = (uint64_t)len * 8;
+    uint64_t pos = 0;
+    unsigned flips = 0;
+    while (dir->clean_bits < bits - pos) {
+        pos += dir->clean_bits;
+        data[pos >> 3] ^= (uint8_t)(0x80 >> (pos & 7));
+        flips++;
+        pos++;
+        dir->clean_bits = next_clean_bits(dir, ber);
+    }
+    if (dir->clean_bits != UINT64_MAX) {
+        dir->clean_bits -= bits - pos;
+    }
+    return flips;
+}
+
+// Steps the Gilbert-Elliott chain one packet and draws the loss. Output: 1 if the packet is lost
+static int channel_loses(impair_dir_t *dir, const impair_params_t *params) {
+    if (dir->bad) {
+        if (impair_chance(dir, params->p_bad_good)) {
+            dir->bad = 0;
+        }
+    } else if (impair_chance(dir, params->p_good_bad)) {
+        dir->bad = 1;
+        dir->bursts++;
+    }
+    if (!impair_chance(dir, dir->bad ? params->loss_bad : params->loss_good)) {
+        return 0;
+    }
+    dir->lost++;
+    dir->lost_bad += dir->bad;
+    return 1;
+}
+
+static int heap_before(const impair_t *r, uint32_t a, uint32_t b) {
+    const impair_packet_t *pa = &r->slots[a];
+    const impair_packet_t *pb = &r->slots[b];
+    return pa->due_ns < pb->due_ns || (pa->due_ns == pb->due_ns && pa->order < pb->order);
+}
+
+static void heap_push(impair_t *r, uint32_t slot) {
+    uint32_t i = r->heap_len++;
+    while (i > 0) {
+        uint32_t parent = (i - 1) / 2;
+        if (!heap_before(r, slot, r->heap[parent])) {
+            break;
+        }
+        r->heap[i] = r->heap[parent];
+        i = parent;
+    }
+    r->heap[i] = slot;
+}
+
+static uint32_t heap_pop(impair_t *r) {
+    uint32_t top = r->heap[0];
+    uint32_t last = r->heap[--r->heap_len];
+    uint32_t i = 0;
+    for (;;) {
+        uint32_t child = 2 * i + 1;
+        if (child >= r->heap_len) {
+            break;
+        }
+        if (child + 1 < r->heap_len && heap_before(r, r->heap[child + 1], r->heap[child])) {
+            child++;
+        }
+        if (!heap_before(r, r->heap[child], last)) {
+            break;
+        }
+        r->heap[i] = r->heap[child];
+        i = child;
+    }
+    if (r->heap_len > 0) {
+        r->heap[i] = last;
+    }
+    return top;
+}
+
+static uint32_t flow_hash(const struct sockaddr_in *addr) {
+    uint64_t key = ((uint64_t)addr->sin_addr.s_addr << 16) | addr->sin_port;
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 40) & (IMPAIR_FLOW_BUCKETS - 1);
+}
+
+/*
+* Finds the flow of a station's socket, opening a socket to the AP the first time it is seen.
+* Output: flow index, or -1 if the flow table is full or the socket cannot be opened
+*/
+static int flow_lookup(impair_t *r, const struct sockaddr_in *station) {
+    uint32_t b = flow_hash(station);
+    while (r->flow_buckets[b] >= 0) {
+        impair_flow_t *flow = &r->flows[r->flow_buckets[b]];
+        if (flow->station.sin_addr.s_addr == station->sin_addr.s_addr && flow->station.sin_port == station->sin_port) {
+            return r->flow_buckets[b];
+        }
+        b = (b + 1) & (IMPAIR_FLOW_BUCKETS - 1);
+    }
+    if (r->flow_count == IMPAIR_MAX_FLOWS) {
+        r->flows_refused++;
+        return -1;
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    int size = IMPAIR_SOCKET_BUFFER;
+    if (fd < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    if (connect(fd, (struct sockaddr *)&r->ap_addr, sizeof(r->ap_addr)) < 0) {
+        perror("connect failed");
+        close(fd);
+        return -1;
+    }
+    uint32_t index = r->flow_count;
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = index + 3 };
+    if (epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        perror("epoll_ctl failed");
+        close(fd);
+        return -1;
+    }
+    r->flows[index].station = *station;
+    r->flows[index].fd = fd;
+    r->flow_buckets[b] = (int32_t)index;
+    r->flow_count++;
+    if (r->verbose) {
+        printf("flow %u: station %s:%d\n", index, inet_ntoa(station->sin_addr), ntohs(station->sin_port));
+    }
+    return (int)index;
+}
+
+static void flush_tx(impair_t *r) {
+    int sent = 0;
+    while (sent < r->tx_count) {
+        int n = sendmmsg(r->tx_fd, r->tx_msgs + sent, r->tx_count - sent, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // A full socket buffer, or no AP behind a connected socket: that datagram is lost
+            r->dirs[r->tx_dir].send_drops++;
+            r->dirs[r->tx_dir].forwarded--;
+            n = 1;
+        }
+        sent += n;
+    }
+    for (int i = 0; i < r->tx_count; i++) {
+        r->free_slots[r->free_count++] = r->tx_slots[i];
+    }
+    r->tx_count = 0;
+}
+
+// Queues a held packet for sending, flushing first if the batch is full or goes to another socket
+static void queue_tx(impair_t *r, uint32_t slot) {
+    impair_packet_t *packet = &r->slots[slot];
+    impair_flow_t *flow = &r->flows[packet->flow];
+    int fd = packet->dir == DIR_UP ? flow->fd : r->listen_fd;
+    if (r->tx_count == IMPAIR_BATCH || (r->tx_count > 0 && fd != r->tx_fd)) {
+        flush_tx(r);
+    }
+    int i = r->tx_count++;
+    r->tx_fd = fd;
+    r->tx_dir = packet->dir;
+    r->tx_slots[i] = slot;
+    r->tx_iov[i].iov_base = packet->data;
+    r->tx_iov[i].iov_len = packet->len;
+    r->tx_msgs[i].msg_hdr.msg_name = packet->dir == DIR_DOWN ? &flow->station : NULL;
+    r->tx_msgs[i].msg_hdr.msg_namelen = packet->dir == DIR_DOWN ? sizeof(flow->station) : 0;
+}
+
+// Sends every held packet that is due
+static void release_due(impair_t *r, uint64_t now) {
+    while (r->heap_len > 0 && r->slots[r->heap[0]].due_ns <= now) {
+        queue_tx(r, heap_pop(r));
+    }
+    if (r->tx_count > 0) {
+        flush_tx(r);
+    }
+}
+
+/*
+* Runs one received datagram through the channel of its direction: the loss draw, then for each copy
+* (two when duplicated) the bit errors and the delay it is held for
+*/
+static void impair_packet(impair_t *r, int d, uint32_t flow, const uint8_t *data, size_t len, uint64_t now) {
+    impair_dir_t *dir = &r->dirs[d];
+    const impair_params_t *p = &r->params;
+    uint64_t number = dir->received++;
+    dir->bytes += len;
+    if (dir->enabled && channel_loses(dir, p)) {
+        if (r->verbose) {
+            printf("%s %lu len=%zu lost%s\n", dir->name, (unsigned long)number, len, dir->bad ? " (burst)" : "");
+        }
+        return;
+    }
+    int copies = dir->enabled && impair_chance(dir, p->duplicate) ? 2 : 1;
+    dir->duplicated += copies - 1;
+    for (int c = 0; c < copies; c++) {
+        uint64_t delay = dir->enabled ? p->delay_ns : 0;
+        if (dir->enabled && p->jitter_ns > 0) {
+            int64_t offset = (int64_t)(impair_uniform(dir) * (2.0 * p->jitter_ns)) - (int64_t)p->jitter_ns;
+            delay = offset < 0 && (uint64_t)-offset > delay ? 0 : delay + offset;
+        }
+        int held = dir->enabled && impair_chance(dir, p->reorder);
+        if (held) {
+            delay += p->reorder_ns;
+            dir->reordered++;
+        }
+        if (r->free_count == 0) {
+            dir->queue_drops++;
+            continue;
+        }
+        uint32_t slot = r->free_slots[--r->free_count];
+        impair_packet_t *packet = &r->slots[slot];
+        memcpy(packet->data, data, len);
+        unsigned flips = dir->enabled ? corrupt_bits(dir, p->ber, packet->data, len) : 0;
+        dir->corrupted += flips > 0;
+        dir->bit_flips += flips;
+        packet->len = (uint16_t)len;
+        packet->flow = flow;
+        packet->dir = (uint8_t)d;
+        packet->due_ns = now + delay;
+        packet->order = r->next_order++;
+        heap_push(r, slot);
+        dir->forwarded++;
+        dir->delay_total_ns += delay;
+        if (r->verbose) {
+            printf("%s %lu len=%zu %s delay=%.3fms%s%s flips=%u\n", dir->name, (unsigned long)number, len,
+                   c > 0 ? "duplicate" : "forward", delay / 1e6, held ? " reordered" : "",
+                   dir->bad ? " (burst)" : "", flips);
+        }
+    }
+    uint32_t held_now = r->heap_len;
+    if (held_now > r->peak_held) {
+        r->peak_held = held_now;
+    }
+}
+
+// Drains one socket: station datagrams from the listening socket, AP responses from a flow socket
+static void receive_from(impair_t *r, int fd, int d, int32_t flow) {
+    for (;;) {
+        for (int i = 0; i < IMPAIR_BATCH; i++) {
+            r->rx_msgs[i].msg_hdr.msg_name = d == DIR_UP ? &r->rx_addr[i] : NULL;
+            r->rx_msgs[i].msg_hdr.msg_namelen = d == DIR_UP ? sizeof(r->rx_addr[i]) : 0;
+        }
+        int n = recvmmsg(fd, r->rx_msgs, IMPAIR_BATCH, MSG_DONTWAIT, NULL);
+        if (n <= 0) {
+            return;
+        }
+        uint64_t now = now_ns();
+        for (int i = 0; i < n; i++) {
+            int32_t f = flow;
+            if (d == DIR_UP && (f = flow_lookup(r, &r->rx_addr[i])) < 0) {
+                continue;
+            }
+            impair_packet(r, d, (uint32_t)f, r->rx_data[i], r->rx_msgs[i].msg_len, now);
+        }
+        // Zero-delay copies go out with the batch that brought them
+        release_due(r, now);
+        if (n < IMPAIR_BATCH) {
+            return;
+        }
+    }
+}
+
+// Arms the timer for the earliest held packet
+static void arm_timer(impair_t *r) {
+    uint64_t due = r->heap_len > 0 ? r->slots[r->heap[0]].due_ns : 0;
+    if (due == r->timer_due_ns) {
+        return;
+    }
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = (time_t)(due / 1000000000ULL);
+    spec.it_value.tv_nsec = (long)(due % 1000000000ULL);
+    timerfd_settime(r->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+    r->timer_due_ns = due;
+}
+
+static void print_direction(const impair_dir_t *dir) {
+    printf("%s: received=%lu bytes=%lu forwarded=%lu lost=%lu lost_in_burst=%lu bursts=%lu duplicated=%lu "
+           "reordered=%lu corrupted=%lu bit_flips=%lu queue_drops=%lu send_drops=%lu mean_delay_ms=%.3f\n",
+           dir->name, (unsigned long)dir->received, (unsigned long)dir->bytes, (unsigned long)dir->forwarded,
+           (unsigned long)dir->lost, (unsigned long)dir->lost_bad, (unsigned long)dir->bursts,
+           (unsigned long)dir->duplicated, (unsigned long)dir->reordered, (unsigned long)dir->corrupted,
+           (unsigned long)dir->bit_flips, (unsigned long)dir->queue_drops, (unsigned long)dir->send_drops,
+           dir->forwarded > 0 ? dir->delay_total_ns / 1e6 / dir->forwarded : 0.0);
+}
+
+// Parses "a,b" into up to count doubles. Output: number parsed
+static int parse_doubles(const char *arg, double *out, int count) {
+    int n = 0;
+    char *end;
+    while (n < count) {
+        out[n] = strtod(arg, &end);
+        if (end == arg) {
+            break;
+        }
+        n++;
+        if (*end != ',') {
+            break;
+        }
+        arg = end + 1;
+    }
+    return *end == '\0' ? n : -1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-p port] [-l loss] [-g p,r[,bad_loss]] [-d ms] [-j ms] [-o prob[,ms]] [-u prob] "
+            "[-x ber] [-D up|down|both] [-q packets] [-S seed] [-t seconds] [-v]\n", prog);
+    fprintf(stderr, "  -p  port stations send to (default %d); the AP is %s:%d\n", DEFAULT_LISTEN_PORT, SERVER_IP, SERVER_PORT);
+    fprintf(stderr, "  -l  loss probability per packet (in the good state when -g is given)\n");
+    fprintf(stderr, "  -g  Gilbert-Elliott bursts: enter the bad state with probability p per packet, leave it with r,\n");
+    fprintf(stderr, "      and lose bad_loss of the packets sent in it (default 1)\n");
+    fprintf(stderr, "  -d  one-way delay; -j  jitter, uniform within +-ms of the delay\n");
+    fprintf(stderr, "  -o  hold this fraction of packets back by ms more (default 2), so later ones overtake them\n");
+    fprintf(stderr, "  -u  duplicate this fraction of packets; -x  flip bits at this bit error rate\n");
+    fprintf(stderr, "  -D  which direction is impaired (default both); -q  packets held at once (default %d)\n", DEFAULT_QUEUE);
+    fprintf(stderr, "  -S  seed (default 1); -t  stop after seconds (default: at SIGINT); -v  print every decision\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    impair_t *r = &relay;
+    impair_params_t *p = &r->params;
+    int listen_port = DEFAULT_LISTEN_PORT;
+    const char *directions = "both";
+    long queue = DEFAULT_QUEUE;
+    uint64_t seed = 1;
+    double seconds = 0;
+    double values[3];
+    int opt;
+
+    p->loss_bad = 1.0;
+    p->reorder_ns = 2000000;
+    while ((opt = getopt(argc, argv, "p:l:g:d:j:o:u:x:D:q:S:t:v")) != -1) {
+        switch (opt) {
+        case 'p':
+            listen_port = atoi(optarg);
+            break;
+        case 'l':
+            p->loss_good = atof(optarg);
+            break;
+        case 'g': {
+            int n = parse_doubles(optarg, values, 3);
+            if (n < 2) {
+                usage(argv[0]);
+            }
+            p->p_good_bad = values[0];
+            p->p_bad_good = values[1];
+            if (n == 3) {
+                p->loss_bad = values[2];
+            }
+            break;
+        }
+        case 'd':
+            p->delay_ns = (uint64_t)(atof(optarg) * 1e6);
+            break;
+        case 'j':
+            p->jitter_ns = (uint64_t)(atof(optarg) * 1e6);
+            break;
+        case 'o': {
+            int n = parse_doubles(optarg, values, 2);
+            if (n < 1) {
+                usage(argv[0]);
+            }
+            p->reorder = values[0];
+            if (n == 2) {
+                p->reorder_ns = (uint64_t)(values[1] * 1e6);
+            }
+            break;
+        }
+        case 'u':
+            p->duplicate = atof(optarg);
+            break;
+        case 'x':
+            p->ber = atof(optarg);
+            break;
+        case 'D':
+            directions = optarg;
+            break;
+        case 'q':
+            queue = atol(optarg);
+            break;
+        case 'S':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 't':
+            seconds = atof(optarg);
+            break;
+        case 'v':
+            r->verbose = 1;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (strcmp(directions, "up") != 0 && strcmp(directions, "down") != 0 && strcmp(directions, "both") != 0) {
+        usage(argv[0]);
+    }
+    if (optind != argc || listen_port <= 0 || listen_port > 65535 || queue < IMPAIR_BATCH || queue > (1 << 20) ||
+        p->loss_good < 0 || p->loss_good > 1 || p->loss_bad < 0 || p->loss_bad > 1 || p->p_good_bad < 0 ||
+        p->p_good_bad > 1 || p->p_bad_good < 0 || p->p_bad_good > 1 || p->reorder < 0 || p->reorder > 1 ||
+        p->duplicate < 0 || p->duplicate > 1 || p->ber < 0 || p->ber > 1 || seconds < 0) {
+        fprintf(stderr, "Probabilities must be between 0 and 1, the queue between %d and %d packets\n", IMPAIR_BATCH, 1 << 20);
+        exit(EXIT_FAILURE);
+    }
+
+    const char *names[2] = { "up", "down" };
+    for (int d = 0; d < 2; d++) {
+        impair_dir_t *dir = &r->dirs[d];
+        dir->name = names[d];
+        dir->enabled = strcmp(directions, "both") == 0 || strcmp(directions, names[d]) == 0;
+        dir->rng = (seed + 1) * 0x9E3779B97F4A7C15ULL ^ (uint64_t)(d + 1) * 0xD1B54A32D192ED03ULL;
+        dir->clean_bits = next_clean_bits(dir, p->ber);
+    }
+
+    r->slots = malloc((size_t)queue * sizeof(impair_packet_t));
+    r->free_slots = malloc((size_t)queue * sizeof(uint32_t));
+    r->heap = malloc((size_t)queue * sizeof(uint32_t));
+    if (!r->slots || !r->free_slots || !r->heap) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    for (long i = queue - 1; i >= 0; i--) {
+        r->free_slots[r->free_count++] = (uint32_t)i;
+    }
+    memset(r->flow_buckets, -1, sizeof(r->flow_buckets));
+    for (int i = 0; i < IMPAIR_BATCH; i++) {
+        r->rx_iov[i].iov_base = r->rx_data[i];
+        r->rx_iov[i].iov_len = MAX_BUFFER_SIZE;
+        r->rx_msgs[i].msg_hdr.msg_iov = &r->rx_iov[i];
+        r->rx_msgs[i].msg_hdr.msg_iovlen = 1;
+        r->tx_msgs[i].msg_hdr.msg_iov = &r->tx_iov[i];
+        r->tx_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    memset(&r->ap_addr, 0, sizeof(r->ap_addr));
+    r->ap_addr.sin_family = AF_INET;
+    r->ap_addr.sin_addr.s_addr = inet_addr(SERVER_IP);
+    r->ap_addr.sin_port = htons(SERVER_PORT);
+
+    struct sockaddr_in listen_addr;
+    memset(&listen_addr, 0, sizeof(listen_addr));
+    listen_addr.sin_family = AF_INET;
+    listen_addr.sin_addr.s_addr = INADDR_ANY;
+    listen_addr.sin_port = htons(listen_port);
+    int size = IMPAIR_SOCKET_BUFFER;
+    r->listen_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (r->listen_fd < 0 || bind(r->listen_fd, (struct sockaddr *)&listen_addr, sizeof(listen_addr)) < 0) {
+        perror("Binding failed");
+        exit(EXIT_FAILURE);
+    }
+    setsockopt(r->listen_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    setsockopt(r->listen_fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+    // SIGINT and SIGTERM arrive through a signalfd, so the loop stops between batches and still reports
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, NULL);
+    int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK);
+    r->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    int stop_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    r->epoll_fd = epoll_create1(0);
+    if (signal_fd < 0 || r->timer_fd < 0 || stop_fd < 0 || r->epoll_fd < 0) {
+        perror("Event setup failed");
+        exit(EXIT_FAILURE);
+    }
+    // epoll data: 0 = listening socket, 1 = delay timer, 2 = stop (signal or -t), 3 + i = flow i
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = 0 };
+    epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, r->listen_fd, &ev);
+    ev.data.u32 = 1;
+    epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, r->timer_fd, &ev);
+    ev.data.u32 = 2;
+    epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, signal_fd, &ev);
+    if (seconds > 0) {
+        struct itimerspec spec;
+        memset(&spec, 0, sizeof(spec));
+        spec.it_value.tv_sec = (time_t)seconds;
+        spec.it_value.tv_nsec = (long)((seconds - (double)(time_t)seconds) * 1e9);
+        timerfd_settime(stop_fd, 0, &spec, NULL);
+        epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, stop_fd, &ev);
+    }
+
+    printf("impair: port=%d ap=%s:%d seed=%lu impaired=%s loss=%g gilbert=%g,%g,%g delay_ms=%g jitter_ms=%g "
+           "reorder=%g,%gms duplicate=%g ber=%g queue=%ld\n",
+           listen_port, SERVER_IP, SERVER_PORT, (unsigned long)seed, directions, p->loss_good, p->p_good_bad,
+           p->p_bad_good, p->loss_bad, p->delay_ns / 1e6, p->jitter_ns / 1e6, p->reorder, p->reorder_ns / 1e6,
+           p->duplicate, p->ber, queue);
+    fflush(stdout);
+
+    struct epoll_event events[64];
+    uint64_t start = now_ns();
+    int running = 1;
+    while (running) {
+        int n = epoll_wait(r->epoll_fd, events, 64, -1);
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait failed");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            uint32_t key = events[i].data.u32;
+            if (key == 0) {
+                receive_from(r, r->listen_fd, DIR_UP, -1);
+            } else if (key == 1) {
+                uint64_t expirations;
+                if (read(r->timer_fd, &expirations, sizeof(expirations)) > 0) {
+                    r->timer_due_ns = 0;
+                }
+            } else if (key == 2) {
+                running = 0;
+            } else {
+                receive_from(r, r->flows[key - 3].fd, DIR_DOWN, (int32_t)(key - 3));
+            }
+        }
+        release_due(r, now_ns());
+        arm_timer(r);
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+
+    // Packets still held when the relay stops were never sent
+    print_direction(&r->dirs[DIR_UP]);
+    print_direction(&r->dirs[DIR_DOWN]);
+    uint64_t total = r->dirs[DIR_UP].received + r->dirs[DIR_DOWN].received;
+    printf("impair: %.3f s, flows=%u flows_refused=%lu peak_held=%u still_held=%u, %.0f packets/s relayed\n",
+           elapsed, r->flow_count, (unsigned long)r->flows_refused, r->peak_held, r->heap_len,
+           elapsed > 0 ? total / elapsed : 0.0);
+    return 0;
+}
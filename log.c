@@ -0,0 +1,253 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+log.c
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include "log.h"
+
+#define LOG_RING_SIZE 4096          // Records per thread, power of two
+#define LOG_MAX_THREADS 256
+#define LOG_IDLE_SLEEP_NS 1000000   // Background thread naps 1 ms when every ring is empty
+
+/*
+* Single-producer single-consumer ring owned by one logging thread. The producer only writes head and
+* the consumer only writes tail, each on its own cache line, so neither side takes a lock.
+*/
+typedef struct {
+    _Alignas(64) _Atomic uint64_t head;
+    _Alignas(64) _Atomic uint64_t tail;
+    _Alignas(64) uint64_t dropped;
+    log_record_t records[LOG_RING_SIZE];
+} log_ring_t;
+
+#define LOG_EVENT_FORMAT(name, level, flags, format) format,
+static const char *const log_event_formats[LOG_NUM_EVENTS] = { LOG_EVENTS(LOG_EVENT_FORMAT) };
+#define LOG_EVENT_FLAGS(name, level, flags, format) flags,
+static const uint8_t log_event_flags[LOG_NUM_EVENTS] = { LOG_EVENTS(LOG_EVENT_FLAGS) };
+
+int log_level = LOG_DEFAULT_LEVEL;
+
+static log_ring_t *log_rings[LOG_MAX_THREADS];
+static _Atomic uint32_t log_num_rings;
+static __thread log_ring_t *log_my_ring;
+static __thread uint32_t log_my_index;
+static pthread_mutex_t log_register_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t log_thread;
+static int log_running;
+static _Atomic int log_stop;
+static FILE *log_raw_file;
+
+static uint64_t log_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Formats one record as a line of text
+void log_format_record(FILE *out, const log_record_t *record) {
+    const unsigned long *a = record->args;
+    if (record->event >= LOG_NUM_EVENTS) {
+        fprintf(out, "<unknown log event %u>\n", record->event);
+        return;
+    }
+    const char *format = log_event_formats[record->event];
+    if (log_event_flags[record->event] == LOG_STR) {
+        fprintf(out, format, (const char *)a, a[LOG_MAX_ARGS - 1]);
+    } else {
+        fprintf(out, format, a[0], a[1], a[2], a[3], a[4], a[5]);
+    }
+    fputc('\n', out);
+}
+
+// Moves every queued record out of every ring. Output: number of records handled
+static size_t log_drain(void) {
+    size_t handled = 0;
+    uint32_t rings = atomic_load_explicit(&log_num_rings, memory_order_acquire);
+    for (uint32_t i = 0; i < rings; i++) {
+        log_ring_t *ring = log_rings[i];
+        uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        while (tail != head) {
+            const log_record_t *record = &ring->records[tail & (LOG_RING_SIZE - 1)];
+            if (log_raw_file) {
+                fwrite(record, sizeof(*record), 1, log_raw_file);
+            } else {
+                log_format_record(stdout, record);
+            }
+            tail++;
+            handled++;
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+    if (handled) {
+        fflush(log_raw_file ? log_raw_file : stdout);
+    }
+    return handled;
+}
+
+static void *log_thread_main(void *arg) {
+    (void)arg;
+    struct timespec idle = { 0, LOG_IDLE_SLEEP_NS };
+    while (!atomic_load(&log_stop)) {
+        if (log_drain() == 0) {
+            nanosleep(&idle, NULL);
+        }
+    }
+    log_drain();
+    return NULL;
+}
+
+// Gives the calling thread its own ring. Called automatically on a thread's first log record.
+void log_thread_register(void) {
+    if (log_my_ring) {
+        return;
+    }
+    log_ring_t *ring = aligned_alloc(64, sizeof(log_ring_t));
+    if (!ring) {
+        return;
+    }
+    memset(ring, 0, sizeof(*ring));
+
+    pthread_mutex_lock(&log_register_lock);
+    uint32_t index = atomic_load(&log_num_rings);
+    if (index >= LOG_MAX_THREADS) {
+        pthread_mutex_unlock(&log_register_lock);
+        free(ring);
+        return;
+    }
+    log_rings[index] = ring;
+    atomic_store_explicit(&log_num_rings, index + 1, memory_order_release);
+    pthread_mutex_unlock(&log_register_lock);
+
+    log_my_ring = ring;
+    log_my_index = index;
+}
+
+// Claims the next free record in the calling thread's ring, or NULL (and counts a drop) if it is full
+static log_record_t *log_claim(int event) {
+    if (!log_my_ring) {
+        log_thread_register();
+        if (!log_my_ring) {
+            return NULL;
+        }
+    }
+    log_ring_t *ring = log_my_ring;
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= LOG_RING_SIZE) {
+        ring->dropped++;
+        return NULL;
+    }
+    log_record_t *record = &ring->records[head & (LOG_RING_SIZE - 1)];
+    record->timestamp_ns = log_now_ns();
+    record->event = (uint16_t)event;
+    record->level = log_event_levels[event];
+    record->thread = log_my_index;
+    return record;
+}
+
+static void log_publish(void) {
+    log_ring_t *ring = log_my_ring;
+    atomic_store_explicit(&ring->head, atomic_load_explicit(&ring->head, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+// Queues a numeric event. Called through LOG() once the level check has passed.
+void log_emit(int event, const unsigned long *args, size_t nargs) {
+    log_record_t *record = log_claim(event);
+    if (!record) {
+        return;
+    }
+    if (nargs > LOG_MAX_ARGS) {
+        nargs = LOG_MAX_ARGS;
+    }
+    record->nargs = (uint8_t)nargs;
+    memcpy(record->args, args, nargs * sizeof(unsigned long));
+    log_publish();
+}
+
+// Queues a LOG_STR event. Called through LOG_S() once the level check has passed.
+void log_emit_str(int event, const char *text, const unsigned long *args, size_t nargs) {
+    log_record_t *record = log_claim(event);
+    if (!record) {
+        return;
+    }
+    char *inline_text = (char *)record->args;
+    strncpy(inline_text, text, LOG_TEXT_LEN - 1);
+    inline_text[LOG_TEXT_LEN - 1] = '\0';
+    record->args[LOG_MAX_ARGS - 1] = nargs > 0 ? args[0] : 0;
+    record->nargs = (uint8_t)(nargs > 0);
+    log_publish();
+}
+
+// Blocks until the background thread has written out everything the calling thread has logged
+void log_flush(void) {
+    if (!log_running || !log_my_ring) {
+        return;
+    }
+    struct timespec pause = { 0, 100000 };
+    uint64_t head = atomic_load_explicit(&log_my_ring->head, memory_order_relaxed);
+    while (atomic_load_explicit(&log_my_ring->tail, memory_order_acquire) < head) {
+        nanosleep(&pause, NULL);
+    }
+}
+
+/*
+* Sets the level and starts the background thread. Must run before any thread logs.
+* Output: 0 on success, -1 if the raw file or the thread could not be created
+*/
+int log_init(int level, const char *raw_path) {
+    log_level = level;
+    if (raw_path) {
+        log_raw_file = fopen(raw_path, "wb");
+        if (!log_raw_file) {
+            perror("Opening raw log file failed");
+            return -1;
+        }
+        log_raw_header_t header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, LOG_RAW_MAGIC, sizeof(LOG_RAW_MAGIC));
+        header.record_size = sizeof(log_record_t);
+        header.num_events = LOG_NUM_EVENTS;
+        fwrite(&header, sizeof(header), 1, log_raw_file);
+    }
+    if (pthread_create(&log_thread, NULL, log_thread_main, NULL) != 0) {
+        perror("Starting log thread failed");
+        return -1;
+    }
+    log_running = 1;
+    atexit(log_shutdown);
+    return 0;
+}
+
+// Drains every ring, reports dropped records and stops the background thread
+void log_shutdown(void) {
+    if (!log_running) {
+        return;
+    }
+    log_running = 0;
+    atomic_store(&log_stop, 1);
+    pthread_join(log_thread, NULL);
+
+    uint64_t dropped = 0;
+    uint32_t rings = atomic_load(&log_num_rings);
+    for (uint32_t i = 0; i < rings; i++) {
+        dropped += log_rings[i]->dropped;
+    }
+    if (dropped) {
+        fprintf(stderr, "log: %lu records dropped (ring full)\n", (unsigned long)dropped);
+    }
+    if (log_raw_file) {
+        fclose(log_raw_file);
+        log_raw_file = NULL;
+    }
+}
@@ -0,0 +1,135 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+log.h
+*/
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Log levels
+#define LOG_ERROR 0
+#define LOG_WARN 1
+#define LOG_INFO 2
+#define LOG_DEBUG 3
+#define LOG_DEFAULT_LEVEL LOG_INFO
+
+// Event flags
+#define LOG_NUM 0       // All arguments are numbers
+#define LOG_STR 1       // The first conversion is %s, filled from an inline copy of the string argument
+
+/*
+* Every log message is an event listed here: X(name, level, flags, format).
+* Numeric arguments are stored as unsigned long, so formats must use %lu, %ld or %lx for them.
+* Events with LOG_STR take one string (at most LOG_TEXT_LEN - 1 characters are kept) followed by
+* at most one number, and the %s must be the first conversion.
+*/
+#define LOG_EVENTS(X) \
+    X(EV_AP_RX_PACKET,      LOG_DEBUG, LOG_NUM, "\nReceived packet from %lu.%lu.%lu.%lu:%lu") \
+    X(EV_AP_BAD_ID,         LOG_INFO,  LOG_NUM, "Invalid frame identifiers, ignoring packet") \
+    X(EV_AP_BAD_LENGTH,     LOG_INFO,  LOG_NUM, "Invalid frame length (%lu bytes), ignoring packet") \
+    X(EV_AP_BAD_VERSION,    LOG_INFO,  LOG_NUM, "Unsupported protocol version: %lu") \
+    X(EV_AP_FCS_ERROR,      LOG_INFO,  LOG_NUM, "FCS (Frame Check Sequence) Error: Received=0x%08lX, Calculated=0x%08lX") \
+    X(EV_AP_NO_ADDR2,       LOG_INFO,  LOG_NUM, "Frame carries no transmitter address, ignoring packet") \
+    X(EV_AP_TABLE_FULL,     LOG_WARN,  LOG_NUM, "Station table full, ignoring packet") \
+    X(EV_AP_RX_ASSOC_REQ,   LOG_DEBUG, LOG_NUM, "Received Association Request") \
+    X(EV_AP_TX_ASSOC_RESP,  LOG_DEBUG, LOG_NUM, "Sending Association Response") \
+    X(EV_AP_RX_PROBE_REQ,   LOG_DEBUG, LOG_NUM, "Received Probe Request") \
+    X(EV_AP_TX_PROBE_RESP,  LOG_DEBUG, LOG_NUM, "Sending Probe Response") \
+    X(EV_AP_RX_RTS,         LOG_DEBUG, LOG_NUM, "Received RTS, duration_id=%lu") \
+    X(EV_AP_TX_CTS,         LOG_DEBUG, LOG_NUM, "Sending CTS, duration_id=%lu") \
+    X(EV_AP_RX_DATA,        LOG_DEBUG, LOG_NUM, "Received Data Frame, duration_id=%lu, more_fragments=%lu, seq_ctrl=%lu, payload=%lu bytes") \
+    X(EV_AP_TX_ACK,         LOG_DEBUG, LOG_NUM, "Sending ACK, duration_id=%lu") \
+    X(EV_AP_RX_MSDU,        LOG_DEBUG, LOG_NUM, "Reassembled MSDU seq=%lu, %lu bytes") \
+    X(EV_AP_BA_HELD,        LOG_DEBUG, LOG_NUM, "Recorded seq=%lu for Block Ack") \
+    X(EV_AP_RX_DUPLICATE,   LOG_DEBUG, LOG_NUM, "Received duplicate Data Frame, seq_ctrl=%lu, cached ACK=%lu") \
+    X(EV_AP_RX_BAR,         LOG_DEBUG, LOG_NUM, "Received Block Ack Request, start=%lu") \
+    X(EV_AP_TX_BA,          LOG_DEBUG, LOG_NUM, "Sending Block Ack, start=%lu, bitmap=0x%016lX") \
+    X(EV_AP_PS_DOZE,        LOG_DEBUG, LOG_NUM, "Station is dozing, buffering its responses") \
+    X(EV_AP_PS_WAKE,        LOG_DEBUG, LOG_NUM, "Station woke up, releasing %lu buffered frames") \
+    X(EV_AP_RX_PS_POLL,     LOG_DEBUG, LOG_NUM, "Received PS-Poll, aid=%lu, releasing %lu buffered frames") \
+    X(EV_AP_PS_BUFFER,      LOG_DEBUG, LOG_NUM, "Buffering response subtype %lu for dozing station (%lu queued)") \
+    X(EV_AP_TX_BUFFERED,    LOG_DEBUG, LOG_NUM, "Sending buffered frame subtype %lu, more_data=%lu") \
+    X(EV_AP_BAD_MGMT,       LOG_INFO,  LOG_NUM, "Unsupported management frame subtype: %lu") \
+    X(EV_AP_BAD_CTRL,       LOG_INFO,  LOG_NUM, "Unsupported control frame subtype: %lu") \
+    X(EV_AP_BAD_TYPE,       LOG_INFO,  LOG_NUM, "Unsupported frame type: %lu") \
+    X(EV_AP_RECV_ERROR,     LOG_ERROR, LOG_NUM, "Receive failed, errno=%lu") \
+    X(EV_AP_SEND_ERROR,     LOG_ERROR, LOG_NUM, "Send failed, errno=%lu") \
+    X(EV_CLIENT_TX,         LOG_DEBUG, LOG_STR, "Sending %s (Attempt %lu)") \
+    X(EV_CLIENT_RX_VALID,   LOG_DEBUG, LOG_STR, "Valid response received for %s") \
+    X(EV_CLIENT_BAD_ID,     LOG_INFO,  LOG_NUM, "Invalid frame identifiers in response") \
+    X(EV_CLIENT_BAD_LENGTH, LOG_INFO,  LOG_NUM, "Invalid frame length in response") \
+    X(EV_CLIENT_FCS_ERROR,  LOG_INFO,  LOG_NUM, "FCS Error in response") \
+    X(EV_CLIENT_TIMER,      LOG_INFO,  LOG_STR, "Timer expired waiting for response to %s (%lu us)") \
+    X(EV_CLIENT_RECV_ERROR, LOG_ERROR, LOG_NUM, "recvfrom failed, errno=%lu") \
+    X(EV_CLIENT_SEND_ERROR, LOG_ERROR, LOG_NUM, "sendto failed, errno=%lu") \
+    X(EV_CLIENT_NO_ACK,     LOG_INFO,  LOG_NUM, "No ACK received from AP.") \
+    X(EV_CLIENT_RX_BA,      LOG_DEBUG, LOG_NUM, "Block Ack received, start=%lu, bitmap=0x%016lX") \
+    X(EV_CLIENT_RETRANSMIT, LOG_DEBUG, LOG_NUM, "Retransmitting seq=%lu (Attempt %lu)") \
+    X(EV_CLIENT_GIVE_UP,    LOG_INFO,  LOG_NUM, "No Block Ack for seq=%lu after %lu attempts, giving up") \
+    X(EV_CLIENT_RTO,        LOG_DEBUG, LOG_NUM, "RTT sample %lu us: srtt=%lu us, rttvar=%lu us, rto=%lu us") \
+    X(EV_CLIENT_NO_BA,      LOG_INFO,  LOG_NUM, "No Block Ack received from AP.")
+
+#define LOG_EVENT_ENUM(name, level, flags, format) name,
+enum log_event {
+    LOG_EVENTS(LOG_EVENT_ENUM)
+    LOG_NUM_EVENTS
+};
+
+#define LOG_EVENT_LEVEL(name, level, flags, format) level,
+static const uint8_t log_event_levels[LOG_NUM_EVENTS] = { LOG_EVENTS(LOG_EVENT_LEVEL) };
+
+#define LOG_MAX_ARGS 6
+#define LOG_TEXT_LEN 40     // Inline string space for LOG_STR events (overlays args[0..4])
+
+// Fixed-size binary log record, one cache line
+typedef struct {
+    uint64_t timestamp_ns;  // CLOCK_MONOTONIC
+    uint16_t event;
+    uint8_t level;
+    uint8_t nargs;
+    uint32_t thread;        // Ring index of the thread that logged it
+    unsigned long args[LOG_MAX_ARGS];
+} log_record_t;
+
+// Header at the start of a raw log file, followed by log_record_t entries
+#define LOG_RAW_MAGIC "W11LOG1"
+typedef struct {
+    char magic[8];
+    uint32_t record_size;
+    uint32_t num_events;
+} log_raw_header_t;
+
+extern int log_level;
+
+// Hot-path logging. The level test is a compare against a constant, so disabled events cost one branch.
+#define LOG_NARGS(...) (sizeof((const unsigned long[]){0, ##__VA_ARGS__}) / sizeof(unsigned long) - 1)
+#define LOG(event, ...) \
+    do { \
+        if (log_event_levels[event] <= log_level) { \
+            log_emit((event), (const unsigned long[]){0, ##__VA_ARGS__} + 1, LOG_NARGS(__VA_ARGS__)); \
+        } \
+    } while (0)
+#define LOG_S(event, text, ...) \
+    do { \
+        if (log_event_levels[event] <= log_level) { \
+            log_emit_str((event), (text), (const unsigned long[]){0, ##__VA_ARGS__} + 1, LOG_NARGS(__VA_ARGS__)); \
+        } \
+    } while (0)
+
+// Logger lifecycle. raw_path == NULL formats records as text on stdout; otherwise they are written raw.
+int log_init(int level, const char *raw_path);
+void log_shutdown(void);
+void log_flush(void);
+void log_thread_register(void);
+
+void log_emit(int event, const unsigned long *args, size_t nargs);
+void log_emit_str(int event, const char *text, const unsigned long *args, size_t nargs);
+void log_format_record(FILE *out, const log_record_t *record);
+
+#endif
@@ -0,0 +1,48 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+logdump.c
+*/
+
+// Decodes a raw log file written with -L into text, one line per record with its timestamp and thread
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "log.h"
+
+static const char *level_names[] = { "ERROR", "WARN", "INFO", "DEBUG" };
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s raw_log_file\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    FILE *in = fopen(argv[1], "rb");
+    if (!in) {
+        perror("fopen failed");
+        exit(EXIT_FAILURE);
+    }
+
+    log_raw_header_t header;
+    if (fread(&header, sizeof(header), 1, in) != 1 || memcmp(header.magic, LOG_RAW_MAGIC, sizeof(LOG_RAW_MAGIC)) != 0 ||
+        header.record_size != sizeof(log_record_t)) {
+        fprintf(stderr, "%s is not a raw log file from this build\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+    if (header.num_events != LOG_NUM_EVENTS) {
+        fprintf(stderr, "warning: log has %u event types, this build knows %d\n", header.num_events, LOG_NUM_EVENTS);
+    }
+
+    log_record_t record;
+    while (fread(&record, sizeof(record), 1, in) == 1) {
+        printf("%lu.%09lu [%u] %-5s ", (unsigned long)(record.timestamp_ns / 1000000000ULL),
+               (unsigned long)(record.timestamp_ns % 1000000000ULL), record.thread,
+               record.level <= LOG_DEBUG ? level_names[record.level] : "?");
+        log_format_record(stdout, &record);
+    }
+
+    fclose(in);
+    return 0;
+}
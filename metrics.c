@@ -0,0 +1,156 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+metrics.c
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "frame.h"
+#include "metrics.h"
+
+static const char *drop_names[NUM_DROP_REASONS] = {
+    "bad_length", "bad_id", "bad_version", "fcs_error", "no_addr2", "table_full", "unsupported",
+    "no_send_slot"
+};
+
+static const char *reasm_names[NUM_REASM_COUNTERS] = {
+    "msdus", "msdu_bytes", "fragments", "duplicate_fragments", "evicted"
+};
+
+static const char *ps_names[NUM_PS_COUNTERS] = {
+    "dozes", "wakes", "polls", "buffered", "released", "dropped", "queue_full"
+};
+
+static const char *type_names[METRICS_TYPES] = { "mgmt", "ctrl", "data", "ext" };
+
+// Names for the subtypes this project uses; the rest are reported by number
+static const char *subtype_name(int type, int subtype) {
+    if (type == TYPE_MANAGEMENT) {
+        switch (subtype) {
+        case SUBTYPE_ASSOC_REQ: return "assoc_req";
+        case SUBTYPE_ASSOC_RESP: return "assoc_resp";
+        case SUBTYPE_PROBE_REQ: return "probe_req";
+        case SUBTYPE_PROBE_RESP: return "probe_resp";
+        }
+    } else if (type == TYPE_CONTROL) {
+        switch (subtype) {
+        case SUBTYPE_RTS: return "rts";
+        case SUBTYPE_CTS: return "cts";
+        case SUBTYPE_ACK: return "ack";
+        case SUBTYPE_BLOCK_ACK_REQ: return "block_ack_req";
+        case SUBTYPE_BLOCK_ACK: return "block_ack";
+        case SUBTYPE_PS_POLL: return "ps_poll";
+        }
+    } else if (type == TYPE_DATA && subtype == SUBTYPE_DATA) {
+        return "data";
+    } else if (type == TYPE_DATA && subtype == SUBTYPE_QOS_DATA) {
+        return "qos_data";
+    }
+    return NULL;
+}
+
+// Upper bound of a histogram bucket
+uint64_t hist_bucket_value(int bucket) {
+    if (bucket < HIST_SUB_BUCKETS) {
+        return (uint64_t)bucket;
+    }
+    int exponent = bucket / HIST_SUB_BUCKETS + 2;
+    uint64_t sub = (uint64_t)(bucket % HIST_SUB_BUCKETS);
+    return ((HIST_SUB_BUCKETS + sub + 1) << (exponent - 3)) - 1;
+}
+
+// Output: the bucket bound below which percentile% (0-100) of the count values fall
+uint64_t hist_percentile(const uint64_t *buckets, uint64_t count, double percentile) {
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)count);
+    if (rank >= count) {
+        rank = count - 1;
+    }
+    uint64_t seen = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen > rank) {
+            return hist_bucket_value(b);
+        }
+    }
+    return hist_bucket_value(HIST_BUCKETS - 1);
+}
+
+static inline uint64_t load(const uint64_t *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+// Adds one thread's counters into total; safe while that thread keeps counting
+void metrics_aggregate(ap_metrics_t *total, const ap_metrics_t *thread_metrics) {
+    for (int t = 0; t < METRICS_TYPES; t++) {
+        for (int s = 0; s < METRICS_SUBTYPES; s++) {
+            total->rx[t][s] += load(&thread_metrics->rx[t][s]);
+            total->tx[t][s] += load(&thread_metrics->tx[t][s]);
+        }
+    }
+    for (int d = 0; d < NUM_DROP_REASONS; d++) {
+        total->drops[d] += load(&thread_metrics->drops[d]);
+    }
+    for (int r = 0; r < NUM_REASM_COUNTERS; r++) {
+        total->reassembly[r] += load(&thread_metrics->reassembly[r]);
+    }
+    for (int p = 0; p < NUM_PS_COUNTERS; p++) {
+        total->powersave[p] += load(&thread_metrics->powersave[p]);
+    }
+    total->duplicates += load(&thread_metrics->duplicates);
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        total->service_ns[b] += load(&thread_metrics->service_ns[b]);
+    }
+    total->service_count += load(&thread_metrics->service_count);
+    total->service_total_ns += load(&thread_metrics->service_total_ns);
+    uint64_t max = load(&thread_metrics->service_max_ns);
+    if (max > total->service_max_ns) {
+        total->service_max_ns = max;
+    }
+}
+
+static void write_counters(FILE *out, const char *direction, const uint64_t counters[METRICS_TYPES][METRICS_SUBTYPES]) {
+    for (int t = 0; t < METRICS_TYPES; t++) {
+        for (int s = 0; s < METRICS_SUBTYPES; s++) {
+            const char *name = subtype_name(t, s);
+            if (name) {
+                fprintf(out, "%s.%s.%s %lu\n", direction, type_names[t], name, (unsigned long)counters[t][s]);
+            } else if (counters[t][s]) {
+                fprintf(out, "%s.%s.subtype%d %lu\n", direction, type_names[t], s, (unsigned long)counters[t][s]);
+            }
+        }
+    }
+}
+
+// Writes aggregated counters as "name value" lines
+void metrics_write_report(FILE *out, const ap_metrics_t *total) {
+    write_counters(out, "rx", total->rx);
+    write_counters(out, "tx", total->tx);
+    fprintf(out, "rx.duplicates %lu\n", (unsigned long)total->duplicates);
+    for (int d = 0; d < NUM_DROP_REASONS; d++) {
+        fprintf(out, "drop.%s %lu\n", drop_names[d], (unsigned long)total->drops[d]);
+    }
+    for (int r = 0; r < NUM_REASM_COUNTERS; r++) {
+        fprintf(out, "reassembly.%s %lu\n", reasm_names[r], (unsigned long)total->reassembly[r]);
+    }
+    for (int p = 0; p < NUM_PS_COUNTERS; p++) {
+        fprintf(out, "powersave.%s %lu\n", ps_names[p], (unsigned long)total->powersave[p]);
+    }
+    const uint64_t *ps = total->powersave;
+    fprintf(out, "powersave.held %lu\n", (unsigned long)(ps[PS_COUNT_BUFFERED] - ps[PS_COUNT_RELEASED] -
+                                                          ps[PS_COUNT_DROPPED] - ps[PS_COUNT_QUEUE_FULL]));
+
+    uint64_t count = total->service_count;
+    fprintf(out, "service_ns.count %lu\n", (unsigned long)count);
+    fprintf(out, "service_ns.mean %lu\n", (unsigned long)(count ? total->service_total_ns / count : 0));
+    fprintf(out, "service_ns.p50 %lu\n", (unsigned long)hist_percentile(total->service_ns, count, 50.0));
+    fprintf(out, "service_ns.p90 %lu\n", (unsigned long)hist_percentile(total->service_ns, count, 90.0));
+    fprintf(out, "service_ns.p99 %lu\n", (unsigned long)hist_percentile(total->service_ns, count, 99.0));
+    fprintf(out, "service_ns.p999 %lu\n", (unsigned long)hist_percentile(total->service_ns, count, 99.9));
+    fprintf(out, "service_ns.max %lu\n", (unsigned long)total->service_max_ns);
+}
@@ -0,0 +1,103 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+metrics.h
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Reasons the AP drops a frame without responding
+enum {
+    DROP_BAD_LENGTH,
+    DROP_BAD_ID,
+    DROP_BAD_VERSION,
+    DROP_FCS_ERROR,
+    DROP_NO_ADDR2,
+    DROP_TABLE_FULL,
+    DROP_UNSUPPORTED,
+    DROP_NO_SEND_SLOT,
+    NUM_DROP_REASONS
+};
+
+// Fragment reassembly counters
+enum {
+    REASM_COUNT_MSDUS,           // MSDUs delivered, fragmented or not
+    REASM_COUNT_BYTES,           // Bytes in those MSDUs
+    REASM_COUNT_FRAGMENTS,       // Fragments stored for reassembly
+    REASM_COUNT_DUPLICATES,      // Fragments already held
+    REASM_COUNT_EVICTED,         // Partial MSDUs dropped as stale or to free buffers
+    NUM_REASM_COUNTERS
+};
+
+// Power-save buffering counters
+enum {
+    PS_COUNT_DOZES,              // Stations that announced they are going to sleep
+    PS_COUNT_WAKES,              // Stations that woke up
+    PS_COUNT_POLLS,              // PS-Polls received
+    PS_COUNT_BUFFERED,           // Responses held for a dozing station
+    PS_COUNT_RELEASED,           // Buffered frames sent after a wake or poll
+    PS_COUNT_DROPPED,            // Oldest frames dropped because the memory budget ran out
+    PS_COUNT_QUEUE_FULL,         // Oldest frames dropped because their station's queue was full
+    NUM_PS_COUNTERS
+};
+
+/*
+* Log-linear (HDR-style) histogram buckets: values below 8 get their own bucket, and every power of two
+* above that is split into 8 sub-buckets, so any recorded value is within 12.5% of its bucket's bound.
+*/
+#define HIST_SUB_BUCKETS 8
+#define HIST_BUCKETS ((64 - 2) * HIST_SUB_BUCKETS)
+
+#define METRICS_TYPES 4
+#define METRICS_SUBTYPES 16
+
+/*
+* Counters for one worker thread. Only the owning thread writes them (METRIC_ADD), and readers
+* aggregate every thread's copy with relaxed loads, so counting never takes a lock or a locked instruction.
+*/
+typedef struct __attribute__((aligned(64))) {
+    uint64_t rx[METRICS_TYPES][METRICS_SUBTYPES];
+    uint64_t tx[METRICS_TYPES][METRICS_SUBTYPES];
+    uint64_t drops[NUM_DROP_REASONS];
+    uint64_t reassembly[NUM_REASM_COUNTERS];
+    uint64_t powersave[NUM_PS_COUNTERS];
+    uint64_t duplicates;                   // Retransmitted data frames already received, acknowledged again
+    uint64_t service_ns[HIST_BUCKETS];     // process_frame service time
+    uint64_t service_count;
+    uint64_t service_total_ns;
+    uint64_t service_max_ns;
+} ap_metrics_t;
+
+// Single-writer increment: a plain load/add/store made visible to concurrent readers without a lock prefix
+#define METRIC_ADD(counter, n) \
+    __atomic_store_n(&(counter), __atomic_load_n(&(counter), __ATOMIC_RELAXED) + (n), __ATOMIC_RELAXED)
+
+static inline int hist_bucket(uint64_t value) {
+    if (value < HIST_SUB_BUCKETS) {
+        return (int)value;
+    }
+    int exponent = 63 - __builtin_clzll(value);
+    int sub = (int)((value >> (exponent - 3)) & (HIST_SUB_BUCKETS - 1));
+    return (exponent - 2) * HIST_SUB_BUCKETS + sub;
+}
+
+static inline void metrics_record_service(ap_metrics_t *metrics, uint64_t ns) {
+    METRIC_ADD(metrics->service_ns[hist_bucket(ns)], 1);
+    METRIC_ADD(metrics->service_count, 1);
+    METRIC_ADD(metrics->service_total_ns, ns);
+    if (ns > metrics->service_max_ns) {
+        __atomic_store_n(&metrics->service_max_ns, ns, __ATOMIC_RELAXED);
+    }
+}
+
+uint64_t hist_bucket_value(int bucket);
+uint64_t hist_percentile(const uint64_t *buckets, uint64_t count, double percentile);
+void metrics_aggregate(ap_metrics_t *total, const ap_metrics_t *thread_metrics);
+void metrics_write_report(FILE *out, const ap_metrics_t *total);
+
+#endif
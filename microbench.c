@@ -0,0 +1,356 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+microbench.c
+*/
+
+// Microbenchmarks for the frame hot paths: the FCS over frame-sized and MTU-sized inputs, every frame
+// builder, process_frame() dispatch for each request type without sockets, and a loopback
+// request/response test against an in-process AP worker. Prints one JSON object per line.
+//
+// The AP is compiled into this file so the benchmarks can build a worker; the client's builders come
+// from client.c compiled with its main() and AP_MAC renamed (see the Makefile).
+
+#define main ap_main
+#include "server.c"
+#undef main
+
+#include <poll.h>
+
+#define BENCH_DEFAULT_MS 200            // Minimum run time of each benchmark
+#define BENCH_LOOPBACK_WINDOW 64        // Requests in flight in the loopback test
+#define BENCH_LOOPBACK_MS 1000
+
+// Client frame builders and state, from client.c
+extern const uint8_t CLIENT_MAC[6];
+extern uint8_t protocol_version;
+size_t create_association_request(uint8_t *buffer, const uint8_t *src_mac);
+size_t create_probe_request(uint8_t *buffer, const uint8_t *src_mac);
+size_t create_rts_frame(uint8_t *buffer, const uint8_t *src_mac, uint16_t duration_id);
+size_t create_data_frame(uint8_t *buffer, const uint8_t *src_mac, uint16_t duration_id, uint16_t seq_ctrl, int more_fragments);
+size_t create_qos_data_frame(uint8_t *buffer, const uint8_t *src_mac, uint16_t duration_id, uint16_t seq_ctrl,
+                             const void *payload, size_t payload_len);
+size_t create_block_ack_request(uint8_t *buffer, const uint8_t *src_mac, uint16_t duration_id, uint16_t start_seq_ctrl);
+size_t create_data_frame_bad_fcs(uint8_t *buffer, const uint8_t *src_mac, uint16_t duration_id, uint16_t seq_ctrl, int more_fragments);
+
+typedef void (*bench_fn_t)(void *ctx, uint64_t iterations);
+
+static uint64_t bench_min_ns = BENCH_DEFAULT_MS * 1000000ULL;
+static const char *bench_filter;
+static volatile size_t bench_sink;      // Results go here so the work cannot be optimised away
+
+// Keeps the compiler from merging the stores of successive iterations
+#define BENCH_CLOBBER() __asm__ volatile("" ::: "memory")
+
+/*
+* Runs fn with a doubling iteration count until one run lasts bench_min_ns, then reports that run.
+* bytes is the input size per operation (0 if throughput in bytes means nothing for it).
+*/
+static void bench_run(const char *name, bench_fn_t fn, void *ctx, size_t bytes) {
+    if (bench_filter && !strstr(name, bench_filter)) {
+        return;
+    }
+    uint64_t iterations = 1;
+    uint64_t elapsed;
+    fn(ctx, 1);                         // Warm caches and branch predictors
+    while (1) {
+        uint64_t start = now_ns();
+        fn(ctx, iterations);
+        elapsed = now_ns() - start;
+        if (elapsed >= bench_min_ns || iterations >= (1ULL << 40)) {
+            break;
+        }
+        // Aim just past the minimum, growing at most 100x from a run too short to time well
+        iterations = elapsed < bench_min_ns / 100 ? iterations * 100 : iterations * bench_min_ns / elapsed * 6 / 5 + 1;
+    }
+    double ns_per_op = (double)elapsed / iterations;
+    printf("{\"benchmark\": \"%s\", \"iterations\": %lu, \"ns_per_op\": %.2f, \"ops_per_s\": %.0f",
+           name, (unsigned long)iterations, ns_per_op, 1e9 / ns_per_op);
+    if (bytes > 0) {
+        printf(", \"bytes\": %zu, \"mb_per_s\": %.1f", bytes, bytes * 1e3 / ns_per_op);
+    }
+    printf("}\n");
+    fflush(stdout);
+}
+
+// FCS over a buffer of len bytes
+typedef struct {
+    int alg;
+    const uint8_t *data;
+    size_t len;
+} fcs_bench_t;
+
+static void bench_fcs(void *ctx, uint64_t iterations) {
+    const fcs_bench_t *b = ctx;
+    for (uint64_t i = 0; i < iterations; i++) {
+        bench_sink += fcs_compute(b->alg, b->data, b->len);
+    }
+}
+
+// fcs_verify_batch() over FCS_BATCH_MAX copies of one frame body; one operation checks one frame
+typedef struct {
+    int alg;
+    const uint8_t *bodies[FCS_BATCH_MAX];
+    size_t len;
+} fcs_batch_bench_t;
+
+static void bench_fcs_batch(void *ctx, uint64_t iterations) {
+    const fcs_batch_bench_t *b = ctx;
+    for (uint64_t i = 0; i < iterations; i += FCS_BATCH_MAX) {
+        bench_sink += fcs_verify_batch(b->alg, b->bodies, b->len, FCS_BATCH_MAX);
+    }
+}
+
+static void bench_get_checksum(void *ctx, uint64_t iterations) {
+    const fcs_bench_t *b = ctx;
+    for (uint64_t i = 0; i < iterations; i++) {
+        bench_sink += getCheckSumValue((void *)b->data, b->len, 0, 0);
+    }
+}
+
+// Frame builders, each writing into the buffer passed as ctx
+#define BUILDER_BENCH(fn_name, call) \
+    static void fn_name(void *ctx, uint64_t iterations) { \
+        uint8_t *buf = ctx; \
+        for (uint64_t i = 0; i < iterations; i++) { \
+            bench_sink += call; \
+            BENCH_CLOBBER(); \
+        } \
+    }
+
+static const uint8_t bench_payload[MAX_PAYLOAD_SIZE];
+static ap_worker_t *bench_worker;
+
+BUILDER_BENCH(bench_assoc_request, create_association_request(buf, CLIENT_MAC))
+BUILDER_BENCH(bench_probe_request, create_probe_request(buf, CLIENT_MAC))
+BUILDER_BENCH(bench_rts, create_rts_frame(buf, CLIENT_MAC, 4))
+BUILDER_BENCH(bench_data, create_data_frame(buf, CLIENT_MAC, 2, 0, 0))
+BUILDER_BENCH(bench_qos_data, create_qos_data_frame(buf, CLIENT_MAC, 2, 0, bench_payload, MAX_PAYLOAD_SIZE))
+BUILDER_BENCH(bench_bar, create_block_ack_request(buf, CLIENT_MAC, 2, 0))
+BUILDER_BENCH(bench_assoc_response, create_association_response(buf, CLIENT_MAC, PROTOCOL_VERSION))
+BUILDER_BENCH(bench_probe_response, create_probe_response(buf, CLIENT_MAC, PROTOCOL_VERSION))
+BUILDER_BENCH(bench_cts, create_cts_frame(buf, CLIENT_MAC, 3, PROTOCOL_VERSION))
+BUILDER_BENCH(bench_ack, create_ack_frame(buf, CLIENT_MAC, 1, PROTOCOL_VERSION))
+BUILDER_BENCH(bench_block_ack, create_block_ack(buf, CLIENT_MAC, 1, 0, 0, PROTOCOL_VERSION))
+BUILDER_BENCH(bench_patch_ack, patch_template(&bench_worker->templates[PROTOCOL_VERSION][TEMPLATE_ACK], buf, 1, CLIENT_MAC))
+
+// process_frame() on one pre-encoded request
+typedef struct {
+    ap_worker_t *worker;
+    uint8_t request[MAX_BUFFER_SIZE];
+    size_t len;
+} dispatch_bench_t;
+
+static void bench_dispatch(void *ctx, uint64_t iterations) {
+    dispatch_bench_t *b = ctx;
+    struct sockaddr_in src;
+    uint8_t send_buffer[MAX_BUFFER_SIZE];
+    const uint8_t *response;
+    memset(&src, 0, sizeof(src));
+    for (uint64_t i = 0; i < iterations; i++) {
+        bench_sink += process_frame(b->worker, b->request, b->len, &src, send_buffer, &response);
+        BENCH_CLOBBER();
+    }
+}
+
+// Sets up a worker the way main() in server.c does
+static void bench_worker_init(ap_worker_t *worker, int id) {
+    memset(worker, 0, sizeof(*worker));
+    worker->id = id;
+    worker->batch_size = DEFAULT_BATCH_SIZE;
+    build_templates(worker);
+    if (station_table_init(&worker->stations, DEFAULT_STATIONS) < 0 ||
+        reasm_init(&worker->reasm, (size_t)DEFAULT_REASSEMBLY_KB * 1024, deliver_msdu, worker,
+                   worker->metrics.reassembly) < 0 ||
+        ps_init(&worker->ps, (size_t)DEFAULT_POWERSAVE_KB * 1024, worker->stations.slots, worker->metrics.powersave) < 0) {
+        perror("Worker allocation failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+* Loopback request/response test: an AP worker runs the batched socket loop on an ephemeral port in
+* a thread of its own, and a connected socket keeps BENCH_LOOPBACK_WINDOW RTS frames in flight to it.
+*/
+static void bench_loopback(void) {
+    const char *name = "loopback_rts_cts";
+    if (bench_filter && !strstr(name, bench_filter)) {
+        return;
+    }
+    ap_worker_t *worker = aligned_alloc(64, sizeof(ap_worker_t));
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    if (!worker) {
+        perror("Worker allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    bench_worker_init(worker, 1);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    worker->socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (worker->socket_fd < 0 || fd < 0 || bind(worker->socket_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        getsockname(worker->socket_fd, (struct sockaddr *)&addr, &addr_len) < 0 ||
+        connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("Loopback socket setup failed");
+        exit(EXIT_FAILURE);
+    }
+    if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+        perror("pthread_create failed");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(worker->thread);     // Runs until the process exits
+
+    uint8_t request[MAX_BUFFER_SIZE];
+    uint8_t response[MAX_BUFFER_SIZE];
+    size_t len = create_rts_frame(request, CLIENT_MAC, 4);
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    unsigned long sent = 0, received = 0;
+    int in_flight = 0;
+    uint64_t start = now_ns();
+    uint64_t end = start + BENCH_LOOPBACK_MS * 1000000ULL;
+    while (now_ns() < end) {
+        while (in_flight < BENCH_LOOPBACK_WINDOW && send(fd, request, len, 0) == (ssize_t)len) {
+            sent++;
+            in_flight++;
+        }
+        if (poll(&pfd, 1, 100) == 0) {
+            in_flight = 0;              // Lost window: start over
+            continue;
+        }
+        while (recv(fd, response, sizeof(response), MSG_DONTWAIT) > 0) {
+            received++;
+            if (in_flight > 0) {
+                in_flight--;
+            }
+        }
+    }
+    double seconds = (now_ns() - start) / 1e9;
+    printf("{\"benchmark\": \"%s\", \"window\": %d, \"requests\": %lu, \"responses\": %lu, "
+           "\"responses_per_s\": %.0f}\n", name, BENCH_LOOPBACK_WINDOW, sent, received, received / seconds);
+    fflush(stdout);
+    close(fd);
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "t:")) != -1) {
+        switch (opt) {
+        case 't':
+            bench_min_ns = (uint64_t)atol(optarg) * 1000000ULL;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-t ms_per_benchmark] [name_filter]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (optind < argc) {
+        bench_filter = argv[optind];
+    }
+    if (bench_min_ns == 0) {
+        bench_min_ns = 1;
+    }
+    log_level = LOG_ERROR;              // Per-frame events stay a single branch, as on a quiet AP
+
+    // FCS: frame-sized and MTU-sized inputs, both algorithms
+    static const size_t fcs_sizes[] = { 24, 64, 256, 1064, 1500 };
+    uint8_t *fcs_data = malloc(1500);
+    for (int i = 0; i < 1500; i++) {
+        fcs_data[i] = (uint8_t)(i * 131 + 7);
+    }
+    for (size_t i = 0; i < sizeof(fcs_sizes) / sizeof(fcs_sizes[0]); i++) {
+        char name[64];
+        fcs_bench_t legacy = { FCS_ALG_LEGACY, fcs_data, fcs_sizes[i] };
+        fcs_bench_t crc = { FCS_ALG_CRC32, fcs_data, fcs_sizes[i] };
+        snprintf(name, sizeof(name), "fcs_legacy_%zu", fcs_sizes[i]);
+        bench_run(name, bench_fcs, &legacy, fcs_sizes[i]);
+        snprintf(name, sizeof(name), "fcs_crc32_%s_%zu", fcs_kernel_name(), fcs_sizes[i]);
+        bench_run(name, bench_fcs, &crc, fcs_sizes[i]);
+    }
+    // Batch verification of 1064-byte bodies, each followed by its FCS
+    static const int batch_algs[] = { FCS_ALG_LEGACY, FCS_ALG_CRC32 };
+    uint8_t *batch_data = malloc(FCS_BATCH_MAX * (1064 + FRAME_FCS_LEN));
+    for (size_t a = 0; a < sizeof(batch_algs) / sizeof(batch_algs[0]); a++) {
+        char name[64];
+        fcs_batch_bench_t batch = { batch_algs[a], { 0 }, 1064 };
+        for (int k = 0; k < FCS_BATCH_MAX; k++) {
+            uint8_t *body = batch_data + k * (1064 + FRAME_FCS_LEN);
+            memcpy(body, fcs_data, 1064);
+            uint32_t fcs = fcs_compute(batch_algs[a], body, 1064);
+            memcpy(body + 1064, &fcs, FRAME_FCS_LEN);
+            batch.bodies[k] = body;
+        }
+        snprintf(name, sizeof(name), "fcs_verify_batch%d_%s_%s_1064", FCS_BATCH_MAX,
+                 batch_algs[a] == FCS_ALG_LEGACY ? "legacy" : "crc32",
+                 batch_algs[a] == FCS_ALG_LEGACY ? fcs_batch_kernel_name() : fcs_kernel_name());
+        bench_run(name, bench_fcs_batch, &batch, 1064);
+    }
+    free(batch_data);
+
+    fcs_bench_t mtu = { FCS_ALG_LEGACY, fcs_data, 1500 };
+    bench_run("getCheckSumValue_1500", bench_get_checksum, &mtu, 1500);
+
+    // Frame builders
+    static ap_worker_t worker;
+    bench_worker_init(&worker, 0);
+    bench_worker = &worker;
+    uint8_t buffer[MAX_BUFFER_SIZE];
+    bench_run("build_association_request", bench_assoc_request, buffer, 0);
+    bench_run("build_probe_request", bench_probe_request, buffer, 0);
+    bench_run("build_rts", bench_rts, buffer, 0);
+    bench_run("build_data", bench_data, buffer, 0);
+    bench_run("build_qos_data_1024", bench_qos_data, buffer, 0);
+    bench_run("build_block_ack_request", bench_bar, buffer, 0);
+    bench_run("build_association_response", bench_assoc_response, buffer, 0);
+    bench_run("build_probe_response", bench_probe_response, buffer, 0);
+    bench_run("build_cts", bench_cts, buffer, 0);
+    bench_run("build_ack", bench_ack, buffer, 0);
+    bench_run("build_block_ack", bench_block_ack, buffer, 0);
+    bench_run("patch_template_ack", bench_patch_ack, buffer, 0);
+
+    // process_frame() dispatch, one request type at a time
+    static dispatch_bench_t dispatch;
+    dispatch.worker = &worker;
+    for (int version = PROTOCOL_VERSION; version <= PROTOCOL_VERSION_CRC32; version++) {
+        const char *suffix = version == PROTOCOL_VERSION ? "legacy" : "crc32";
+        char name[64];
+        protocol_version = (uint8_t)version;
+
+        dispatch.len = create_association_request(dispatch.request, CLIENT_MAC);
+        snprintf(name, sizeof(name), "process_association_request_%s", suffix);
+        bench_run(name, bench_dispatch, &dispatch, 0);
+        dispatch.len = create_probe_request(dispatch.request, CLIENT_MAC);
+        snprintf(name, sizeof(name), "process_probe_request_%s", suffix);
+        bench_run(name, bench_dispatch, &dispatch, 0);
+        dispatch.len = create_rts_frame(dispatch.request, CLIENT_MAC, 4);
+        snprintf(name, sizeof(name), "process_rts_%s", suffix);
+        bench_run(name, bench_dispatch, &dispatch, 0);
+        dispatch.len = create_data_frame(dispatch.request, CLIENT_MAC, 2, 0, 0);
+        snprintf(name, sizeof(name), "process_data_%s", suffix);
+        bench_run(name, bench_dispatch, &dispatch, 0);
+        dispatch.len = create_qos_data_frame(dispatch.request, CLIENT_MAC, 2, 0, bench_payload, MAX_PAYLOAD_SIZE);
+        snprintf(name, sizeof(name), "process_qos_data_1024_%s", suffix);
+        bench_run(name, bench_dispatch, &dispatch, dispatch.len);
+        dispatch.len = create_block_ack_request(dispatch.request, CLIENT_MAC, 2, 0);
+        snprintf(name, sizeof(name), "process_block_ack_request_%s", suffix);
+        bench_run(name, bench_dispatch, &dispatch, 0);
+        dispatch.len = create_data_frame_bad_fcs(dispatch.request, CLIENT_MAC, 2, 0, 0);
+        snprintf(name, sizeof(name), "process_bad_fcs_%s", suffix);
+        bench_run(name, bench_dispatch, &dispatch, 0);
+    }
+    protocol_version = PROTOCOL_VERSION;
+
+    // Traffic the AP drops: a datagram without frame identifiers, and a full-size legacy beacon it has no handler for
+    memset(dispatch.request, 0x5A, FRAME_MAX_WIRE_SIZE);
+    dispatch.len = FRAME_MAX_WIRE_SIZE;
+    bench_run("process_junk", bench_dispatch, &dispatch, 0);
+    dispatch.len = frame_build(dispatch.request, PROTOCOL_VERSION, TYPE_MANAGEMENT, 8, FC_FROM_DS, 0,
+                               CLIENT_MAC, CLIENT_MAC, CLIENT_MAC, 0, 0, bench_payload, MAX_PAYLOAD_SIZE);
+    bench_run("process_unsupported_beacon_1024_legacy", bench_dispatch, &dispatch, 0);
+
+    bench_loopback();
+    free(fcs_data);
+    return 0;
+}
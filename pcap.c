@@ -0,0 +1,236 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+pcap.c
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "pcap.h"
+
+#define PCAP_RING_SIZE 1024             // Frames per thread, power of two
+#define PCAP_MAX_THREADS 256
+#define PCAP_MAP_CHUNK (8 << 20)        // File is grown and mapped this many bytes at a time
+#define PCAP_IDLE_SLEEP_NS 1000000      // Writer naps 1 ms when every ring is empty
+
+// One captured frame waiting for the writer
+typedef struct {
+    uint64_t timestamp_ns;              // CLOCK_REALTIME
+    uint32_t len;
+    uint8_t flags;
+    uint8_t data[FRAME_MAX_WIRE_SIZE];
+} pcap_slot_t;
+
+// Single-producer single-consumer ring of captured frames, as in log.c
+typedef struct {
+    _Alignas(64) _Atomic uint64_t head;
+    _Alignas(64) _Atomic uint64_t tail;
+    _Alignas(64) uint64_t dropped;
+    pcap_slot_t slots[PCAP_RING_SIZE];
+} pcap_ring_t;
+
+int pcap_active;
+
+static pcap_ring_t *pcap_rings[PCAP_MAX_THREADS];
+static _Atomic uint32_t pcap_num_rings;
+static __thread pcap_ring_t *pcap_my_ring;
+static pthread_mutex_t pcap_register_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t pcap_thread;
+static _Atomic int pcap_stop;
+static int pcap_fd = -1;
+static uint8_t *pcap_map = MAP_FAILED;  // Window of the file the writer appends through
+static uint64_t pcap_map_start;         // File offset of pcap_map, page aligned
+static uint64_t pcap_offset;            // End of the data written so far
+static uint64_t pcap_write_errors;      // Frames the writer could not fit into the file
+
+// Maps the PCAP_MAP_CHUNK bytes of the file starting at the page holding pcap_offset, growing the file to cover them
+static int pcap_remap(void) {
+    long page = sysconf(_SC_PAGESIZE);
+    if (pcap_map != MAP_FAILED) {
+        munmap(pcap_map, PCAP_MAP_CHUNK);
+    }
+    pcap_map_start = pcap_offset & ~(uint64_t)(page - 1);
+    if (ftruncate(pcap_fd, pcap_map_start + PCAP_MAP_CHUNK) < 0) {
+        pcap_map = MAP_FAILED;
+        return -1;
+    }
+    pcap_map = mmap(NULL, PCAP_MAP_CHUNK, PROT_READ | PROT_WRITE, MAP_SHARED, pcap_fd, pcap_map_start);
+    return pcap_map == MAP_FAILED ? -1 : 0;
+}
+
+// Appends len bytes to the file through the mapping
+static int pcap_append(const void *data, size_t len) {
+    if (pcap_map == MAP_FAILED || pcap_offset + len > pcap_map_start + PCAP_MAP_CHUNK) {
+        if (pcap_remap() < 0) {
+            return -1;
+        }
+    }
+    memcpy(pcap_map + (pcap_offset - pcap_map_start), data, len);
+    pcap_offset += len;
+    return 0;
+}
+
+// Writes one captured frame as a pcap record: radiotap header, then the frame between its identifiers
+static int pcap_write_slot(const pcap_slot_t *slot) {
+    pcap_radiotap_t radiotap = { 0, 0, sizeof(pcap_radiotap_t), RADIOTAP_PRESENT_FLAGS, slot->flags };
+    uint32_t frame_len = slot->len - 2 * FRAME_ID_LEN;
+    pcap_record_header_t record;
+    record.ts_sec = (uint32_t)(slot->timestamp_ns / 1000000000ULL);
+    record.ts_frac = (uint32_t)(slot->timestamp_ns % 1000000000ULL);
+    record.caplen = sizeof(radiotap) + frame_len;
+    record.len = record.caplen;
+    if (pcap_append(&record, sizeof(record)) < 0 || pcap_append(&radiotap, sizeof(radiotap)) < 0 ||
+        pcap_append(slot->data + FRAME_ID_LEN, frame_len) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Moves every queued frame out of every ring into the file. Output: number of frames handled
+static size_t pcap_drain(void) {
+    size_t handled = 0;
+    uint32_t rings = atomic_load_explicit(&pcap_num_rings, memory_order_acquire);
+    for (uint32_t i = 0; i < rings; i++) {
+        pcap_ring_t *ring = pcap_rings[i];
+        uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        while (tail != head) {
+            if (pcap_write_slot(&ring->slots[tail & (PCAP_RING_SIZE - 1)]) < 0) {
+                pcap_write_errors++;
+            }
+            tail++;
+            handled++;
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+    return handled;
+}
+
+static void *pcap_thread_main(void *arg) {
+    (void)arg;
+    struct timespec idle = { 0, PCAP_IDLE_SLEEP_NS };
+    while (!atomic_load(&pcap_stop)) {
+        if (pcap_drain() == 0) {
+            nanosleep(&idle, NULL);
+        }
+    }
+    pcap_drain();
+    return NULL;
+}
+
+// Gives the calling thread its own ring. Called automatically on a thread's first capture.
+static void pcap_thread_register(void) {
+    pcap_ring_t *ring = aligned_alloc(64, sizeof(pcap_ring_t));
+    if (!ring) {
+        return;
+    }
+    memset(ring, 0, sizeof(*ring));
+
+    pthread_mutex_lock(&pcap_register_lock);
+    uint32_t index = atomic_load(&pcap_num_rings);
+    if (index >= PCAP_MAX_THREADS) {
+        pthread_mutex_unlock(&pcap_register_lock);
+        free(ring);
+        return;
+    }
+    pcap_rings[index] = ring;
+    atomic_store_explicit(&pcap_num_rings, index + 1, memory_order_release);
+    pthread_mutex_unlock(&pcap_register_lock);
+
+    pcap_my_ring = ring;
+}
+
+/*
+* Queues a copy of a datagram in the wire format of frame.h for the writer. Called through
+* PCAP_CAPTURE() on every frame sent or received; a full ring drops the frame rather than wait.
+*/
+void pcap_capture(const uint8_t *datagram, size_t len, int bad_fcs) {
+    if (len < FRAME_MIN_WIRE_SIZE || len > FRAME_MAX_WIRE_SIZE) {
+        return;
+    }
+    if (!pcap_my_ring) {
+        pcap_thread_register();
+        if (!pcap_my_ring) {
+            return;
+        }
+    }
+    pcap_ring_t *ring = pcap_my_ring;
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= PCAP_RING_SIZE) {
+        ring->dropped++;
+        return;
+    }
+    pcap_slot_t *slot = &ring->slots[head & (PCAP_RING_SIZE - 1)];
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    slot->timestamp_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    slot->len = (uint32_t)len;
+    slot->flags = RADIOTAP_F_FCS | (bad_fcs ? RADIOTAP_F_BADFCS : 0);
+    memcpy(slot->data, datagram, len);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/*
+* Creates the capture file, writes its header and starts the writer thread.
+* Output: 0 on success, -1 if the file or the thread could not be created
+*/
+int pcap_open(const char *path) {
+    pcap_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (pcap_fd < 0) {
+        perror("Opening capture file failed");
+        return -1;
+    }
+    pcap_file_header_t header = { PCAP_MAGIC_NS, PCAP_VERSION_MAJOR, PCAP_VERSION_MINOR, 0, 0,
+                                  PCAP_SNAPLEN, PCAP_LINKTYPE_RADIOTAP };
+    if (pcap_append(&header, sizeof(header)) < 0) {
+        perror("Mapping capture file failed");
+        close(pcap_fd);
+        pcap_fd = -1;
+        return -1;
+    }
+    if (pthread_create(&pcap_thread, NULL, pcap_thread_main, NULL) != 0) {
+        perror("Starting capture thread failed");
+        return -1;
+    }
+    pcap_active = 1;
+    atexit(pcap_close);
+    return 0;
+}
+
+// Writes out every queued frame, trims the file to what was written and reports dropped frames
+void pcap_close(void) {
+    if (!pcap_active) {
+        return;
+    }
+    pcap_active = 0;
+    atomic_store(&pcap_stop, 1);
+    pthread_join(pcap_thread, NULL);
+
+    uint64_t dropped = pcap_write_errors;
+    uint32_t rings = atomic_load(&pcap_num_rings);
+    for (uint32_t i = 0; i < rings; i++) {
+        dropped += pcap_rings[i]->dropped;
+    }
+    if (dropped) {
+        fprintf(stderr, "pcap: %lu frames dropped\n", (unsigned long)dropped);
+    }
+    if (pcap_map != MAP_FAILED) {
+        munmap(pcap_map, PCAP_MAP_CHUNK);
+        pcap_map = MAP_FAILED;
+    }
+    if (ftruncate(pcap_fd, pcap_offset) < 0) {
+        perror("Trimming capture file failed");
+    }
+    close(pcap_fd);
+    pcap_fd = -1;
+}
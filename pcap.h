@@ -0,0 +1,76 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+pcap.h
+*/
+
+#ifndef PCAP_H
+#define PCAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "frame.h"
+
+// pcap file format (nanosecond timestamps), readable by tcpdump and Wireshark
+#define PCAP_MAGIC_NS 0xA1B23C4D
+#define PCAP_MAGIC_US 0xA1B2C3D4
+#define PCAP_VERSION_MAJOR 2
+#define PCAP_VERSION_MINOR 4
+#define PCAP_SNAPLEN 65535
+#define PCAP_LINKTYPE_IEEE802_11 105            // 802.11 frame, no FCS
+#define PCAP_LINKTYPE_RADIOTAP 127              // Radiotap header, then the 802.11 frame
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+} pcap_file_header_t;
+
+typedef struct {
+    uint32_t ts_sec;
+    uint32_t ts_frac;                           // Nanoseconds, or microseconds with PCAP_MAGIC_US
+    uint32_t caplen;
+    uint32_t len;
+} pcap_record_header_t;
+
+/*
+* Every captured frame is the datagram between its frame identifiers: the 802.11 header and payload
+* (the wire format keeps the 802.11 field order) followed by the FCS. A minimal radiotap header in
+* front carries only the Flags field, saying the FCS is present and whether it was wrong.
+*/
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint8_t pad;
+    uint16_t len;
+    uint32_t present;
+    uint8_t flags;
+} pcap_radiotap_t;
+
+#define RADIOTAP_PRESENT_TSFT 0x00000001
+#define RADIOTAP_PRESENT_FLAGS 0x00000002
+#define RADIOTAP_PRESENT_EXT 0x80000000
+#define RADIOTAP_F_FCS 0x10                     // Frame ends with the FCS
+#define RADIOTAP_F_BADFCS 0x40                  // FCS check failed
+
+extern int pcap_active;
+
+// Hot-path capture. Without a capture file this is a single branch.
+#define PCAP_CAPTURE(datagram, len, bad_fcs) \
+    do { \
+        if (pcap_active) { \
+            pcap_capture((datagram), (len), (bad_fcs)); \
+        } \
+    } while (0)
+
+// Capture lifecycle. pcap_open() starts the thread that writes captured frames to path.
+int pcap_open(const char *path);
+void pcap_close(void);
+
+void pcap_capture(const uint8_t *datagram, size_t len, int bad_fcs);
+
+#endif
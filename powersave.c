@@ -0,0 +1,180 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+powersave.c
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "powersave.h"
+#include "metrics.h"
+
+/*
+* Carves the frame pool for a memory budget of budget bytes of buffered frames (at least PS_MIN_BUDGET,
+* so one full station queue always fits)
+* Output: 0 on success, -1 if the allocation failed
+*/
+int ps_init(ps_buffer_t *ps, size_t budget, station_t *stations, uint64_t *counters) {
+    if (budget < PS_MIN_BUDGET) {
+        budget = PS_MIN_BUDGET;
+    }
+    uint32_t num_frames = (uint32_t)(budget / PS_FRAME_SIZE);
+
+    memset(ps, 0, sizeof(*ps));
+    ps->frames = calloc(num_frames, sizeof(ps_frame_t));
+    ps->data = aligned_alloc(64, (size_t)num_frames * PS_FRAME_SIZE);
+    if (!ps->frames || !ps->data) {
+        ps_free(ps);
+        return -1;
+    }
+    for (uint32_t i = 0; i < num_frames; i++) {
+        ps->frames[i].next = i + 1 < num_frames ? i + 1 : PS_NONE;
+    }
+    ps->num_frames = num_frames;
+    ps->free_frame = 0;
+    ps->oldest = ps->newest = PS_NONE;
+    ps->release_head = ps->release_tail = PS_NONE;
+    ps->stations = stations;
+    ps->counters = counters;
+    return 0;
+}
+
+void ps_free(ps_buffer_t *ps) {
+    free(ps->frames);
+    free(ps->data);
+    memset(ps, 0, sizeof(*ps));
+}
+
+// Age list: every queued frame in the order it was buffered, oldest first
+static void age_unlink(ps_buffer_t *ps, uint32_t f) {
+    ps_frame_t *frame = &ps->frames[f];
+    if (frame->older != PS_NONE) {
+        ps->frames[frame->older].newer = frame->newer;
+    } else {
+        ps->oldest = frame->newer;
+    }
+    if (frame->newer != PS_NONE) {
+        ps->frames[frame->newer].older = frame->older;
+    } else {
+        ps->newest = frame->older;
+    }
+}
+
+static void age_append(ps_buffer_t *ps, uint32_t f) {
+    ps_frame_t *frame = &ps->frames[f];
+    frame->older = ps->newest;
+    frame->newer = PS_NONE;
+    if (ps->newest != PS_NONE) {
+        ps->frames[ps->newest].newer = f;
+    } else {
+        ps->oldest = f;
+    }
+    ps->newest = f;
+}
+
+// Drops the oldest frame of a station's queue
+static void drop_head(ps_buffer_t *ps, station_t *station) {
+    uint32_t f = station->ps_head;
+    age_unlink(ps, f);
+    station->ps_head = ps->frames[f].next;
+    station->ps_count--;
+    ps->frames[f].next = ps->free_frame;
+    ps->free_frame = f;
+}
+
+/*
+* Buffers a copy of frame (a complete datagram of at most PS_FRAME_SIZE bytes) at the tail of the station's
+* queue. A full queue drops its own oldest frame first; an empty pool drops the oldest frame of any queue.
+*/
+void ps_enqueue(ps_buffer_t *ps, station_t *station, const uint8_t *frame, size_t len) {
+    METRIC_ADD(ps->counters[PS_COUNT_BUFFERED], 1);
+    if (len > PS_FRAME_SIZE) {
+        METRIC_ADD(ps->counters[PS_COUNT_DROPPED], 1);     // Cannot happen with the AP's templates
+        return;
+    }
+    if (station->ps_count == PS_MAX_PER_STATION) {
+        drop_head(ps, station);
+        METRIC_ADD(ps->counters[PS_COUNT_QUEUE_FULL], 1);
+    }
+    if (ps->free_frame == PS_NONE) {
+        if (ps->oldest == PS_NONE) {
+            // Every frame is on the release chain, waiting to be sent
+            METRIC_ADD(ps->counters[PS_COUNT_DROPPED], 1);
+            return;
+        }
+        drop_head(ps, &ps->stations[ps->frames[ps->oldest].station]);
+        METRIC_ADD(ps->counters[PS_COUNT_DROPPED], 1);
+    }
+
+    uint32_t f = ps->free_frame;
+    ps_frame_t *entry = &ps->frames[f];
+    ps->free_frame = entry->next;
+    memcpy(ps->data + (size_t)f * PS_FRAME_SIZE, frame, len);
+    entry->len = (uint16_t)len;
+    entry->station = (uint32_t)(station - ps->stations);
+    entry->next = PS_NONE;
+    if (station->ps_count == 0) {
+        station->ps_head = f;
+    } else {
+        ps->frames[station->ps_tail].next = f;
+    }
+    station->ps_tail = f;
+    station->ps_count++;
+    age_append(ps, f);
+}
+
+/*
+* Moves every frame buffered for the station onto the release chain, in order
+* Output: number of frames released
+*/
+uint16_t ps_release(ps_buffer_t *ps, station_t *station) {
+    uint16_t count = station->ps_count;
+    if (count == 0) {
+        return 0;
+    }
+    for (uint32_t f = station->ps_head; f != PS_NONE; f = ps->frames[f].next) {
+        age_unlink(ps, f);
+    }
+    if (ps->release_tail == PS_NONE) {
+        ps->release_head = station->ps_head;
+    } else {
+        ps->frames[ps->release_tail].next = station->ps_head;
+    }
+    ps->release_tail = station->ps_tail;
+    station->ps_count = 0;
+    return count;
+}
+
+/*
+* Takes the next frame off the release chain into buffer. Every frame of a burst but the last gets
+* more_data set, and its FCS recomputed with the algorithm its protocol version selects.
+* Output: size of the frame and *station, the station it is for, or 0 if nothing is waiting
+*/
+size_t ps_next(ps_buffer_t *ps, uint8_t *buffer, station_t **station) {
+    uint32_t f = ps->release_head;
+    if (f == PS_NONE) {
+        return 0;
+    }
+    ps_frame_t *frame = &ps->frames[f];
+    size_t len = frame->len;
+    memcpy(buffer, ps->data + (size_t)f * PS_FRAME_SIZE, len);
+    if (frame->next != PS_NONE && ps->frames[frame->next].station == frame->station) {
+        uint8_t *body = buffer + FRAME_ID_LEN;
+        size_t body_len = len - FRAME_OVERHEAD;
+        body[1] |= FC_MORE_DATA;
+        uint32_t fcs = fcs_compute(body[0] & 0x03, body, body_len);
+        memcpy(body + body_len, &fcs, FRAME_FCS_LEN);
+    }
+    *station = &ps->stations[frame->station];
+
+    ps->release_head = frame->next;
+    if (ps->release_head == PS_NONE) {
+        ps->release_tail = PS_NONE;
+    }
+    frame->next = ps->free_frame;
+    ps->free_frame = f;
+    METRIC_ADD(ps->counters[PS_COUNT_RELEASED], 1);
+    return len;
+}
@@ -0,0 +1,62 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+powersave.h
+*/
+
+#ifndef POWERSAVE_H
+#define POWERSAVE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+#include "frame.h"
+#include "station.h"
+
+#define PS_FRAME_SIZE 64                        // Buffered frames are responses built from the AP's 64-byte templates
+#define PS_MAX_PER_STATION 32                   // A longer queue drops its own oldest frame
+#define PS_MIN_BUDGET (PS_MAX_PER_STATION * PS_FRAME_SIZE)
+#define PS_NONE UINT32_MAX
+
+// One buffered frame
+typedef struct {
+    uint32_t next;                            // Next in its station's queue or the release chain; links the free list too
+    uint32_t older, newer;                    // Age list over every station's queue
+    uint32_t station;                         // Slot of the station in the worker's station table
+    uint16_t len;
+    uint16_t reserved;
+} ps_frame_t;
+
+/*
+* Frames held for dozing stations, for one AP worker. The pool of PS_FRAME_SIZE buffers is carved out of
+* one allocation at startup and is the memory budget; each station's queue is a FIFO threaded through it
+* from the head and tail kept in the station record, so a station with nothing buffered costs nothing.
+* Queues fill in arrival order and only ever lose their head, so the oldest frame in the age list is always
+* at the head of its station's queue, and dropping it when the pool runs dry is O(1).
+* A station that wakes or polls has its whole queue moved onto the release chain, which the I/O loop
+* drains with ps_next(); the frames leave the age list then and can no longer be dropped.
+*/
+typedef struct {
+    ps_frame_t *frames;
+    uint8_t *data;                            // PS_FRAME_SIZE bytes per frame
+    uint32_t num_frames;
+    uint32_t free_frame;                      // Head of the free list
+    uint32_t oldest, newest;                  // Age list ends
+    uint32_t release_head, release_tail;
+    station_t *stations;                      // Station table slots the station numbers index
+    uint64_t *counters;                       // PS_COUNT_* counters, see metrics.h
+} ps_buffer_t;
+
+int ps_init(ps_buffer_t *ps, size_t budget, station_t *stations, uint64_t *counters);
+void ps_free(ps_buffer_t *ps);
+void ps_enqueue(ps_buffer_t *ps, station_t *station, const uint8_t *frame, size_t len);
+uint16_t ps_release(ps_buffer_t *ps, station_t *station);
+size_t ps_next(ps_buffer_t *ps, uint8_t *buffer, station_t **station);
+
+// Output: nonzero if ps_next() has a frame to send
+static inline int ps_pending(const ps_buffer_t *ps) {
+    return ps->release_head != PS_NONE;
+}
+
+#endif
@@ -0,0 +1,242 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+reassembly.c
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "reassembly.h"
+#include "metrics.h"
+
+#define REASM_KEY_USED (1ULL << 63)
+
+static inline uint64_t reasm_key(const uint8_t *station, uint16_t seq) {
+    uint64_t key = 0;
+    memcpy(&key, station, MAC_ADDR_LEN);
+    return key | ((uint64_t)seq << 48) | REASM_KEY_USED;
+}
+
+static inline uint32_t reasm_slot(const reasm_t *reasm, uint64_t key) {
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & reasm->mask;
+}
+
+/*
+* Carves the chunk pool, entries and index for a memory budget of budget bytes of fragment payload
+* (at least REASM_MIN_BUDGET, so one MSDU of the largest size always fits)
+* Output: 0 on success, -1 if the allocation failed
+*/
+int reasm_init(reasm_t *reasm, size_t budget, reasm_sink_t sink, void *user, uint64_t *counters) {
+    if (budget < REASM_MIN_BUDGET) {
+        budget = REASM_MIN_BUDGET;
+    }
+    uint32_t num_chunks = (uint32_t)(budget / REASM_CHUNK_SIZE);
+    uint32_t slots = 2;
+    while (slots < 2 * (uint64_t)num_chunks) {
+        slots <<= 1;
+    }
+
+    memset(reasm, 0, sizeof(*reasm));
+    reasm->keys = calloc(slots, sizeof(uint64_t));
+    reasm->slots = calloc(slots, sizeof(uint32_t));
+    reasm->entries = calloc(num_chunks, sizeof(reasm_entry_t));
+    reasm->chunks = aligned_alloc(64, (size_t)num_chunks * REASM_CHUNK_SIZE);
+    reasm->free_chunks = calloc(num_chunks, sizeof(uint32_t));
+    reasm->msdu = malloc(REASM_MAX_MSDU);
+    if (!reasm->keys || !reasm->slots || !reasm->entries || !reasm->chunks || !reasm->free_chunks || !reasm->msdu) {
+        reasm_free(reasm);
+        return -1;
+    }
+
+    reasm->mask = slots - 1;
+    reasm->num_entries = num_chunks;
+    reasm->num_chunks = num_chunks;
+    for (uint32_t i = 0; i < num_chunks; i++) {
+        reasm->entries[i].next = i + 1 < num_chunks ? i + 1 : REASM_NONE;
+        reasm->free_chunks[i] = num_chunks - 1 - i;
+    }
+    reasm->free_entry = 0;
+    reasm->free_count = num_chunks;
+    reasm->oldest = reasm->newest = REASM_NONE;
+    reasm->sink = sink;
+    reasm->user = user;
+    reasm->counters = counters;
+    return 0;
+}
+
+void reasm_free(reasm_t *reasm) {
+    free(reasm->keys);
+    free(reasm->slots);
+    free(reasm->entries);
+    free(reasm->chunks);
+    free(reasm->free_chunks);
+    free(reasm->msdu);
+    memset(reasm, 0, sizeof(*reasm));
+}
+
+// Output: index slot holding key, or the empty slot where it would go
+static uint32_t index_find(const reasm_t *reasm, uint64_t key) {
+    uint32_t i = reasm_slot(reasm, key);
+    while (reasm->keys[i] != 0 && reasm->keys[i] != key) {
+        i = (i + 1) & reasm->mask;
+    }
+    return i;
+}
+
+// Empties an index slot, shifting later entries of the probe run back so there are no tombstones
+static void index_remove(reasm_t *reasm, uint32_t i) {
+    uint32_t j = i;
+    reasm->keys[i] = 0;
+    for (;;) {
+        j = (j + 1) & reasm->mask;
+        if (reasm->keys[j] == 0) {
+            return;
+        }
+        uint32_t home = reasm_slot(reasm, reasm->keys[j]);
+        if ((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j))) {
+            reasm->keys[i] = reasm->keys[j];
+            reasm->slots[i] = reasm->slots[j];
+            reasm->keys[j] = 0;
+            i = j;
+        }
+    }
+}
+
+// Age list: entries ordered by their latest fragment, oldest first
+static void age_unlink(reasm_t *reasm, uint32_t e) {
+    reasm_entry_t *entry = &reasm->entries[e];
+    if (entry->prev != REASM_NONE) {
+        reasm->entries[entry->prev].next = entry->next;
+    } else {
+        reasm->oldest = entry->next;
+    }
+    if (entry->next != REASM_NONE) {
+        reasm->entries[entry->next].prev = entry->prev;
+    } else {
+        reasm->newest = entry->prev;
+    }
+}
+
+static void age_append(reasm_t *reasm, uint32_t e) {
+    reasm_entry_t *entry = &reasm->entries[e];
+    entry->prev = reasm->newest;
+    entry->next = REASM_NONE;
+    if (reasm->newest != REASM_NONE) {
+        reasm->entries[reasm->newest].next = e;
+    } else {
+        reasm->oldest = e;
+    }
+    reasm->newest = e;
+}
+
+// Returns an entry's chunks to the pool and the entry to the free list
+static void entry_release(reasm_t *reasm, uint32_t e) {
+    reasm_entry_t *entry = &reasm->entries[e];
+    for (int f = 0; f < REASM_MAX_FRAGMENTS; f++) {
+        if (entry->held & (1u << f)) {
+            reasm->free_chunks[reasm->free_count++] = entry->chunk[f];
+        }
+    }
+    index_remove(reasm, index_find(reasm, entry->key));
+    age_unlink(reasm, e);
+    entry->key = 0;
+    entry->held = 0;
+    entry->next = reasm->free_entry;
+    reasm->free_entry = e;
+}
+
+static void entry_evict(reasm_t *reasm, uint32_t e) {
+    entry_release(reasm, e);
+    METRIC_ADD(reasm->counters[REASM_COUNT_EVICTED], 1);
+}
+
+static void deliver(reasm_t *reasm, const uint8_t *station, uint16_t seq, const uint8_t *msdu, size_t len) {
+    METRIC_ADD(reasm->counters[REASM_COUNT_MSDUS], 1);
+    METRIC_ADD(reasm->counters[REASM_COUNT_BYTES], len);
+    reasm->sink(reasm->user, station, seq, msdu, len);
+}
+
+/*
+* Adds one data frame's payload. Unfragmented frames go straight to the sink without a copy. Fragments
+* are copied into pool chunks in any order; when fragments 0 through the one without more_frag are all
+* held, the MSDU is assembled and delivered and its buffers are released.
+* Output: REASM_PENDING, REASM_DELIVERED or REASM_DUPLICATE
+*/
+int reasm_add(reasm_t *reasm, const uint8_t *station, uint16_t seq_ctrl, int more_frag,
+              const uint8_t *payload, size_t len, uint64_t now_ns) {
+    uint16_t seq = SEQ_NUM(seq_ctrl);
+    int frag = SEQ_FRAG(seq_ctrl);
+
+    if (frag == 0 && !more_frag) {
+        deliver(reasm, station, seq, payload, len);
+        return REASM_DELIVERED;
+    }
+
+    // Drop partial MSDUs that outlived the receive lifetime
+    while (reasm->oldest != REASM_NONE && now_ns - reasm->entries[reasm->oldest].last_ns > REASM_LIFETIME_NS) {
+        entry_evict(reasm, reasm->oldest);
+    }
+
+    uint64_t key = reasm_key(station, seq);
+    uint32_t slot = index_find(reasm, key);
+    uint32_t e;
+    if (reasm->keys[slot] != 0) {
+        e = reasm->slots[slot];
+        if (reasm->entries[e].held & (1u << frag)) {
+            METRIC_ADD(reasm->counters[REASM_COUNT_DUPLICATES], 1);
+            return REASM_DUPLICATE;
+        }
+        age_unlink(reasm, e);
+    } else {
+        if (reasm->free_entry == REASM_NONE) {
+            entry_evict(reasm, reasm->oldest);
+            slot = index_find(reasm, key);
+        }
+        e = reasm->free_entry;
+        reasm->free_entry = reasm->entries[e].next;
+        reasm->entries[e].key = key;
+        reasm->entries[e].held = 0;
+        reasm->entries[e].last_frag = -1;
+        reasm->keys[slot] = key;
+        reasm->slots[slot] = e;
+    }
+    reasm_entry_t *entry = &reasm->entries[e];
+    entry->last_ns = now_ns;
+    age_append(reasm, e);
+
+    // Out of buffers: evict the oldest other partial MSDUs (this one is now the newest)
+    while (reasm->free_count == 0 && reasm->oldest != e) {
+        entry_evict(reasm, reasm->oldest);
+    }
+    if (reasm->free_count == 0) {
+        return REASM_PENDING;       // Cannot happen: one MSDU never needs more than the minimum budget
+    }
+
+    if (len > REASM_CHUNK_SIZE) {
+        len = REASM_CHUNK_SIZE;
+    }
+    uint32_t chunk = reasm->free_chunks[--reasm->free_count];
+    memcpy(reasm->chunks + (size_t)chunk * REASM_CHUNK_SIZE, payload, len);
+    entry->chunk[frag] = chunk;
+    entry->len[frag] = (uint16_t)len;
+    entry->held |= (uint16_t)(1u << frag);
+    if (!more_frag) {
+        entry->last_frag = (int8_t)frag;
+    }
+    METRIC_ADD(reasm->counters[REASM_COUNT_FRAGMENTS], 1);
+
+    if (entry->last_frag < 0 || entry->held != (uint16_t)((1u << (entry->last_frag + 1)) - 1)) {
+        return REASM_PENDING;
+    }
+
+    size_t msdu_len = 0;
+    for (int f = 0; f <= entry->last_frag; f++) {
+        memcpy(reasm->msdu + msdu_len, reasm->chunks + (size_t)entry->chunk[f] * REASM_CHUNK_SIZE, entry->len[f]);
+        msdu_len += entry->len[f];
+    }
+    entry_release(reasm, e);
+    deliver(reasm, station, seq, reasm->msdu, msdu_len);
+    return REASM_DELIVERED;
+}
@@ -0,0 +1,72 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+reassembly.h
+*/
+
+#ifndef REASSEMBLY_H
+#define REASSEMBLY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "frame.h"
+
+#define REASM_MAX_FRAGMENTS 16                          // Fragment numbers are 4 bits
+#define REASM_CHUNK_SIZE MAX_PAYLOAD_SIZE               // One pool buffer holds one fragment
+#define REASM_MAX_MSDU (REASM_MAX_FRAGMENTS * REASM_CHUNK_SIZE)
+#define REASM_MIN_BUDGET (REASM_MAX_FRAGMENTS * REASM_CHUNK_SIZE)
+#define REASM_LIFETIME_NS 524288000ULL                  // 512 TU, the default dot11MaxReceiveLifetime
+#define REASM_NONE UINT32_MAX
+
+// reasm_add() results
+#define REASM_PENDING 0          // Stored, MSDU still incomplete
+#define REASM_DELIVERED 1        // This fragment completed an MSDU, which went to the sink
+#define REASM_DUPLICATE 2        // Fragment already held, ignored
+
+// Receives each complete MSDU. msdu is only valid during the call.
+typedef void (*reasm_sink_t)(void *user, const uint8_t *station, uint16_t seq, const uint8_t *msdu, size_t len);
+
+// One partially received MSDU
+typedef struct {
+    uint64_t key;                             // Station MAC | sequence number << 48 | used bit
+    uint64_t last_ns;                         // Arrival of its latest fragment
+    uint32_t prev, next;                      // Age list (oldest first); next also links the free list
+    uint16_t held;                            // Bit n set = fragment n stored
+    int8_t last_frag;                         // Fragment number without more_frag, -1 until seen
+    uint8_t reserved;
+    uint16_t len[REASM_MAX_FRAGMENTS];
+    uint32_t chunk[REASM_MAX_FRAGMENTS];      // Pool buffer holding each fragment
+} reasm_entry_t;
+
+/*
+* Reassembly state for one AP worker. Every buffer is carved out of one allocation at startup: the pool
+* of fragment-sized chunks is the memory budget, and there is one entry per chunk since every partial
+* MSDU holds at least one. Entries are found through an open-addressing index keyed on station and
+* sequence number. Partial MSDUs older than REASM_LIFETIME_NS, or the oldest ones when the pool runs
+* dry, are evicted.
+*/
+typedef struct {
+    uint64_t *keys;                           // Index: entry key per slot, 0 = empty
+    uint32_t *slots;                          // Index: entry number per slot
+    uint32_t mask;
+    reasm_entry_t *entries;
+    uint32_t num_entries;
+    uint32_t free_entry;                      // Head of the free entry list
+    uint8_t *chunks;
+    uint32_t *free_chunks;                    // Stack of free chunk numbers
+    uint32_t free_count;
+    uint32_t num_chunks;
+    uint32_t oldest, newest;                  // Age list ends
+    uint8_t *msdu;                            // Scratch space an MSDU is assembled into
+    reasm_sink_t sink;
+    void *user;
+    uint64_t *counters;                       // REASM_COUNT_* counters, see metrics.h
+} reasm_t;
+
+int reasm_init(reasm_t *reasm, size_t budget, reasm_sink_t sink, void *user, uint64_t *counters);
+void reasm_free(reasm_t *reasm);
+int reasm_add(reasm_t *reasm, const uint8_t *station, uint16_t seq_ctrl, int more_frag,
+              const uint8_t *payload, size_t len, uint64_t now_ns);
+
+#endif
@@ -0,0 +1,335 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+replay.c
+*/
+
+// Replays the station-to-AP frames of a pcap capture (from -P, or any 802.11 capture in the same wire
+// layout) against a running AP, as fast as possible or at the recorded timing, and reports the rate.
+// Frames sent by the AP (from_ds set) are skipped; the AP answers the replayed ones as it did live.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "frame.h"
+#include "pcap.h"
+
+#define SERVER_IP "127.0.0.1"
+#define SERVER_PORT 8080
+#define MAX_BUFFER_SIZE 2500
+#define REPLAY_BATCH 64                 // Datagrams per sendmmsg
+#define REPLAY_LINGER_NS 200000000ULL   // How long to wait for late responses after the last frame
+
+// Capture decoded into ready-to-send datagrams
+typedef struct {
+    uint8_t *data;                      // Every datagram back to back
+    size_t *offset;                     // Datagram i is data[offset[i] .. offset[i + 1])
+    uint64_t *time_ns;                  // Capture timestamp of each datagram
+    size_t count;
+    size_t skipped;                     // Records that were not station-to-AP frames
+} replay_set_t;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Reads the radiotap Flags field, if present. Output: radiotap flags, 0 if the header has none
+static uint8_t radiotap_flags(const uint8_t *header, size_t len) {
+    uint32_t present;
+    size_t offset = 4;
+    memcpy(&present, header + 4, sizeof(present));
+    if (!(present & RADIOTAP_PRESENT_FLAGS)) {
+        return 0;
+    }
+    // Skip any extended presence bitmaps, then the TSFT field, which is 8-byte aligned
+    uint32_t word = present;
+    while (word & RADIOTAP_PRESENT_EXT) {
+        offset += 4;
+        if (offset + 4 > len) {
+            return 0;
+        }
+        memcpy(&word, header + offset, sizeof(word));
+    }
+    offset += 4;
+    if (present & RADIOTAP_PRESENT_TSFT) {
+        offset = ((offset + 7) & ~(size_t)7) + 8;
+    }
+    return offset < len ? header[offset] : 0;
+}
+
+/*
+* Turns one captured 802.11 frame back into a datagram at out: frame identifiers around it, and an
+* FCS computed with the algorithm its protocol version selects if the capture did not keep one.
+* Output: datagram length, or 0 if it is not a frame a station sends to the AP
+*/
+static size_t rebuild_datagram(uint8_t *out, const uint8_t *frame, size_t len, int has_fcs) {
+    uint16_t frame_id = START_FRAME_ID;
+    frame_view_t view;
+    if (len + 2 * FRAME_ID_LEN + (has_fcs ? 0 : FRAME_FCS_LEN) > FRAME_MAX_WIRE_SIZE || len < sizeof(frame_control_t)) {
+        return 0;
+    }
+    memcpy(out, &frame_id, FRAME_ID_LEN);
+    memcpy(out + FRAME_ID_LEN, frame, len);
+    size_t size = FRAME_ID_LEN + len;
+    if (!has_fcs) {
+        frame_control_t frame_control;
+        memcpy(&frame_control, frame, sizeof(frame_control));
+        uint32_t fcs = fcs_compute(frame_control.protocol_version, frame, len);
+        memcpy(out + size, &fcs, FRAME_FCS_LEN);
+        size += FRAME_FCS_LEN;
+    }
+    frame_id = END_FRAME_ID;
+    memcpy(out + size, &frame_id, FRAME_ID_LEN);
+    size += FRAME_ID_LEN;
+
+    if (frame_parse(out, size, &view) != FRAME_OK || !view.frame_control.to_ds || view.frame_control.from_ds) {
+        return 0;
+    }
+    return size;
+}
+
+// Maps the capture at path and decodes it. Output: 0, or -1 if it cannot be read
+static int load_capture(const char *path, replay_set_t *set) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(pcap_file_header_t)) {
+        fprintf(stderr, "%s is not a pcap file\n", path);
+        return -1;
+    }
+    uint8_t *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap failed");
+        return -1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    pcap_file_header_t header;
+    memcpy(&header, map, sizeof(header));
+    if ((header.magic != PCAP_MAGIC_NS && header.magic != PCAP_MAGIC_US) ||
+        (header.linktype != PCAP_LINKTYPE_RADIOTAP && header.linktype != PCAP_LINKTYPE_IEEE802_11)) {
+        fprintf(stderr, "%s is not a little-endian 802.11 or radiotap pcap file\n", path);
+        munmap(map, st.st_size);
+        return -1;
+    }
+    uint32_t frac_ns = header.magic == PCAP_MAGIC_NS ? 1 : 1000;
+
+    // A rebuilt datagram is never longer than the record it came from, so the file size bounds the space
+    size_t max_records = st.st_size / sizeof(pcap_record_header_t);
+    memset(set, 0, sizeof(*set));
+    set->data = malloc(st.st_size);
+    set->offset = malloc((max_records + 1) * sizeof(size_t));
+    set->time_ns = malloc(max_records * sizeof(uint64_t));
+    if (!set->data || !set->offset || !set->time_ns) {
+        perror("malloc failed");
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    size_t pos = sizeof(header);
+    size_t used = 0;
+    set->offset[0] = 0;
+    while (pos + sizeof(pcap_record_header_t) <= (size_t)st.st_size) {
+        pcap_record_header_t record;
+        memcpy(&record, map + pos, sizeof(record));
+        pos += sizeof(record);
+        if (record.caplen > (size_t)st.st_size - pos) {
+            break;                      // Truncated final record
+        }
+        const uint8_t *frame = map + pos;
+        size_t len = record.caplen;
+        int has_fcs = 0;
+        pos += record.caplen;
+        if (record.caplen < record.len) {
+            set->skipped++;
+            continue;
+        }
+        if (header.linktype == PCAP_LINKTYPE_RADIOTAP) {
+            uint16_t radiotap_len;
+            if (len < sizeof(pcap_radiotap_t) - 1) {
+                set->skipped++;
+                continue;
+            }
+            memcpy(&radiotap_len, frame + 2, sizeof(radiotap_len));
+            if (radiotap_len > len) {
+                set->skipped++;
+                continue;
+            }
+            has_fcs = (radiotap_flags(frame, radiotap_len) & RADIOTAP_F_FCS) != 0;
+            frame += radiotap_len;
+            len -= radiotap_len;
+        }
+        size_t size = rebuild_datagram(set->data + used, frame, len, has_fcs);
+        if (size == 0) {
+            set->skipped++;
+            continue;
+        }
+        used += size;
+        set->time_ns[set->count] = (uint64_t)record.ts_sec * 1000000000ULL + (uint64_t)record.ts_frac * frac_ns;
+        set->offset[++set->count] = used;
+    }
+    munmap(map, st.st_size);
+    return 0;
+}
+
+// When frame i is due, relative to the start of a pass. Writer threads can record slightly out of order.
+static uint64_t replay_due_ns(const replay_set_t *set, size_t i, double speed) {
+    return set->time_ns[i] > set->time_ns[0] ? (uint64_t)((set->time_ns[i] - set->time_ns[0]) / speed) : 0;
+}
+
+// Counts every response already queued on the socket
+static unsigned long drain_responses(int fd, uint8_t *buffer) {
+    unsigned long received = 0;
+    while (recv(fd, buffer, MAX_BUFFER_SIZE, MSG_DONTWAIT) > 0) {
+        received++;
+    }
+    return received;
+}
+
+int main(int argc, char *argv[]) {
+    int timed = 0;
+    double speed = 1.0;
+    int loops = 1;
+    const char *label = "replay";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "ts:n:l:")) != -1) {
+        switch (opt) {
+        case 't':
+            timed = 1;
+            break;
+        case 's':
+            speed = atof(optarg);
+            break;
+        case 'n':
+            loops = atoi(optarg);
+            break;
+        case 'l':
+            label = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-t [-s speed]] [-n loops] [-l label] capture.pcap\n", argv[0]);
+            fprintf(stderr, "  -t  keep the recorded gaps between frames, scaled down by speed (default 1)\n");
+            fprintf(stderr, "  -n  replay the capture this many times (default 1)\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (optind != argc - 1 || speed <= 0 || loops < 1) {
+        fprintf(stderr, "Usage: %s [-t [-s speed]] [-n loops] [-l label] capture.pcap\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    replay_set_t set;
+    if (load_capture(argv[optind], &set) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    if (set.count == 0) {
+        fprintf(stderr, "No station-to-AP frames in %s (%zu records skipped)\n", argv[optind], set.skipped);
+        exit(EXIT_FAILURE);
+    }
+
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = inet_addr(SERVER_IP);
+    server_addr.sin_port = htons(SERVER_PORT);
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+        perror("Socket setup failed");
+        exit(EXIT_FAILURE);
+    }
+
+    struct iovec iov[REPLAY_BATCH];
+    struct mmsghdr msgs[REPLAY_BATCH];
+    uint8_t recv_buffer[MAX_BUFFER_SIZE];
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < REPLAY_BATCH; i++) {
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    unsigned long sent = 0, received = 0, send_errors = 0;
+    uint64_t bytes = 0;
+    uint64_t start = now_ns();
+    uint64_t loop_start = start;
+    for (int loop = 0; loop < loops; loop++) {
+        size_t next = 0;
+        while (next < set.count) {
+            // Gather the frames that are due: everything left when unpaced, up to a batch either way
+            size_t batch = 0;
+            if (timed) {
+                uint64_t due = loop_start + replay_due_ns(&set, next, speed);
+                if (now_ns() < due) {
+                    struct timespec ts = { (time_t)(due / 1000000000ULL), (long)(due % 1000000000ULL) };
+                    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+                }
+                uint64_t now = now_ns();
+                while (batch < REPLAY_BATCH && next + batch < set.count &&
+                       loop_start + replay_due_ns(&set, next + batch, speed) <= now) {
+                    batch++;
+                }
+            } else {
+                batch = set.count - next < REPLAY_BATCH ? set.count - next : REPLAY_BATCH;
+            }
+            for (size_t i = 0; i < batch; i++) {
+                iov[i].iov_base = set.data + set.offset[next + i];
+                iov[i].iov_len = set.offset[next + i + 1] - set.offset[next + i];
+            }
+            int n = sendmmsg(fd, msgs, batch, 0);
+            if (n < 0) {
+                if (errno == ECONNREFUSED) {
+                    fprintf(stderr, "AP is not running on port %d\n", SERVER_PORT);
+                    exit(EXIT_FAILURE);
+                }
+                send_errors++;
+                n = 1;                  // Skip the frame that failed
+            } else {
+                sent += n;
+                bytes += set.offset[next + n] - set.offset[next];
+            }
+            next += n;
+            received += drain_responses(fd, recv_buffer);
+        }
+        loop_start = now_ns();
+    }
+    uint64_t elapsed_ns = now_ns() - start;
+
+    // Late responses still count, but not toward the send time
+    uint64_t linger_end = now_ns() + REPLAY_LINGER_NS;
+    while (now_ns() < linger_end) {
+        received += drain_responses(fd, recv_buffer);
+        struct timespec pause = { 0, 1000000 };
+        nanosleep(&pause, NULL);
+    }
+
+    double seconds = elapsed_ns / 1e9;
+    printf("%s: frames=%zu skipped=%zu loops=%d sent=%lu send_errors=%lu responses=%lu\n",
+           label, set.count, set.skipped, loops, sent, send_errors, received);
+    printf("%s: %.3f s, %.0f frames/s, %.2f MB/s, %.0f responses/s\n", label, seconds,
+           seconds > 0 ? sent / seconds : 0.0, seconds > 0 ? bytes / seconds / 1e6 : 0.0,
+           seconds > 0 ? received / seconds : 0.0);
+
+    close(fd);
+    free(set.data);
+    free(set.offset);
+    free(set.time_ns);
+    return 0;
+}
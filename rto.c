@@ -0,0 +1,61 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+rto.c
+*/
+
+#include <string.h>
+#include <stdint.h>
+#include "rto.h"
+
+void rto_init(rto_t *rto, uint64_t seed) {
+    memset(rto, 0, sizeof(*rto));
+    rto->rto_us = RTO_INITIAL_US;
+    rto->rng = seed ? seed : 0x9E3779B97F4A7C15ULL;
+}
+
+// Folds in the RTT of an exchange whose request was sent exactly once
+void rto_sample(rto_t *rto, uint32_t rtt_us) {
+    if (!rto->has_sample) {
+        rto->srtt_us = rtt_us;
+        rto->rttvar_us = rtt_us / 2;
+        rto->has_sample = 1;
+    } else {
+        uint32_t delta = rto->srtt_us > rtt_us ? rto->srtt_us - rtt_us : rtt_us - rto->srtt_us;
+        rto->rttvar_us = rto->rttvar_us - rto->rttvar_us / 4 + delta / 4;   // beta = 1/4
+        rto->srtt_us = rto->srtt_us - rto->srtt_us / 8 + rtt_us / 8;        // alpha = 1/8
+    }
+
+    uint64_t variance = 4ULL * rto->rttvar_us;
+    uint64_t timeout = rto->srtt_us + (variance > RTO_GRANULARITY_US ? variance : RTO_GRANULARITY_US);
+    if (timeout < RTO_MIN_US) {
+        timeout = RTO_MIN_US;
+    } else if (timeout > RTO_MAX_US) {
+        timeout = RTO_MAX_US;
+    }
+    rto->rto_us = (uint32_t)timeout;
+}
+
+/*
+* Input: backoff, the number of times this frame's timer has already expired
+* Output: how long to wait for the next response, in microseconds: the RTO doubled once per expiry,
+* capped at RTO_MAX_US, plus up to a quarter more of random jitter so that frames lost together
+* are not all retried together
+*/
+uint32_t rto_timeout_us(rto_t *rto, int backoff) {
+    if (backoff > RTO_MAX_BACKOFF) {
+        backoff = RTO_MAX_BACKOFF;
+    }
+    uint64_t timeout = (uint64_t)rto->rto_us << backoff;
+    if (timeout > RTO_MAX_US) {
+        timeout = RTO_MAX_US;
+    }
+
+    uint64_t x = rto->rng;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    rto->rng = x;
+    return (uint32_t)(timeout + x % (timeout / 4 + 1));
+}
@@ -0,0 +1,38 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+rto.h
+*/
+
+#ifndef RTO_H
+#define RTO_H
+
+#include <stdint.h>
+
+// Retransmission timeout bounds, in microseconds
+#define RTO_INITIAL_US 1000000      // Before the first RTT sample (RFC 6298)
+#define RTO_MIN_US 1000
+#define RTO_MAX_US 3000000          // Also the ceiling after backoff
+#define RTO_GRANULARITY_US 100      // Clock granularity G in RTO = SRTT + max(G, 4 * RTTVAR)
+#define RTO_MAX_BACKOFF 6           // Most doublings applied to one frame's timer
+
+/*
+* Retransmission timer state for one destination (RFC 6298 estimator). srtt and rttvar are only
+* meaningful once has_sample is set. Samples must come from frames that were sent once (Karn's rule).
+* Backoff is counted per frame by the caller, so one frame's losses do not stretch the timers of
+* other frames in flight to the same destination.
+*/
+typedef struct {
+    uint32_t srtt_us;
+    uint32_t rttvar_us;
+    uint32_t rto_us;
+    uint8_t has_sample;
+    uint64_t rng;                   // Jitter source
+} rto_t;
+
+void rto_init(rto_t *rto, uint64_t seed);
+void rto_sample(rto_t *rto, uint32_t rtt_us);
+uint32_t rto_timeout_us(rto_t *rto, int backoff);
+
+#endif
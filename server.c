@@ -5,216 +5,1056 @@ COEN 331 Winter 2025: Programming Assignment
 server.c
 */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/un.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include "frame.h"
+#include "station.h"
+#include "log.h"
+#include "metrics.h"
+#include "reassembly.h"
+#include "powersave.h"
+#include "pcap.h"
+#include "uring.h"
 
 #define SERVER_PORT 8080
 #define MAX_BUFFER_SIZE 2500
+#define DEFAULT_BATCH_SIZE 32
+#define MAX_BATCH_SIZE 1024
+#define MAX_WORKERS 256
+#define DEFAULT_STATIONS 65536
+#define DEFAULT_REASSEMBLY_KB 1024
+#define DEFAULT_POWERSAVE_KB 256
+#define DEFAULT_STATS_PATH "/tmp/wifi_ap_stats.sock"
+#define ACK_CACHE_SIZE 1024             // ACKs each worker keeps for duplicates, power of two
+#define ACK_CACHE_WIRE 24
+#define FCS_GROUPS 8                    // Frame lengths a receive batch collects for batch FCS checks at once
+
+// What the receive path already knows about a frame's FCS
+#define FCS_UNCHECKED 0
+#define FCS_VALID 1
+#define FCS_INVALID 2
+
+// io_uring backend
+#define URING_ENTRIES 256               // Submission queue size
+#define URING_CQ_ENTRIES 4096
+#define URING_RECV_BUFFERS 1024         // Registered receive buffers, power of two
+#ifndef URING_SEND_SLOTS
+#define URING_SEND_SLOTS 256            // Responses in flight (make test builds a server with 4)
+#endif
+#define URING_TAG_RECV UINT64_MAX       // user_data of the multishot receive; sends carry their slot index
+#define URING_TAG_STOP (UINT64_MAX - 1) // user_data of the poll on ap_stop_fd
 
 // MAC addresses
-const uint8_t CLIENT_MAC[6] = {0x12, 0x45, 0xCC, 0xDD, 0xEE, 0x88};
 const uint8_t AP_MAC[6] = {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xDD};
 
+// Responses that are built once per worker at startup, one set per protocol version
+enum {
+    TEMPLATE_ASSOC_RESP,
+    TEMPLATE_PROBE_RESP,
+    TEMPLATE_CTS,
+    TEMPLATE_ACK,
+    TEMPLATE_BLOCK_ACK,
+    NUM_TEMPLATES
+};
+#define NUM_VERSIONS (PROTOCOL_VERSION_CRC32 + 1)
+#define TEMPLATE_WIRE_SIZE 64
+
+// Pre-encoded response frame. fcs_prefix is the FCS state over the bytes ahead of duration_id, which
+// never change, so patching a response only re-hashes the fields from duration_id on.
+typedef struct __attribute__((aligned(64))) {
+    uint8_t wire[TEMPLATE_WIRE_SIZE];
+    size_t len;
+    fcs_ctx_t fcs_prefix;
+    uint16_t duration_id;             // duration_id the template was built with
+} response_template_t;
+
+// ACK last sent to a station, so a retransmission of the frame it answered gets a copy
+typedef struct {
+    uint32_t station;                 // Slot in the worker's station table + 1; 0 = empty
+    uint16_t seq_ctrl;                // seq_ctrl of the data frame it acknowledged
+    uint8_t version;
+    uint8_t len;
+    uint8_t wire[ACK_CACHE_WIRE];
+} ack_cache_t;
+
+// Per-thread AP worker. Each worker owns its socket, its buffers and any state hung off this struct,
+// so nothing on the packet path is shared between threads.
+typedef struct __attribute__((aligned(64))) {
+    response_template_t templates[NUM_VERSIONS][NUM_TEMPLATES];
+    station_table_t stations;         // Stations whose traffic the kernel steers to this worker
+    reasm_t reasm;                    // Partially received MSDUs from those stations
+    ps_buffer_t ps;                   // Responses held for those stations while they doze
+    ack_cache_t acks[ACK_CACHE_SIZE]; // Direct-mapped on the station slot
+    ap_metrics_t metrics;
+    int id;
+    int socket_fd;
+    int batch_size;
+    int use_uring;
+    pthread_t thread;
+} ap_worker_t;
+
+// Set by the shutdown thread; every receive loop returns once it sees it. ap_stop_fd is written at the
+// same time to wake io_uring workers, which a socket shutdown does not.
+static int ap_stop;
+static int ap_stop_fd = -1;
+
+static inline int ap_stopping(void) {
+    return __atomic_load_n(&ap_stop, __ATOMIC_RELAXED);
+}
+
 // Creates Association Response frame
-size_t create_association_response(uint8_t *buffer) {
-    ieee80211_frame frame;
-    memset(&frame, 0, sizeof(ieee80211_frame));
-    
-    frame.frame_control.protocol_version = 0;
-    frame.frame_control.type = 0;           // Management frame
-    frame.frame_control.subtype = 1;        // Association Response
-    frame.frame_control.to_ds = 0;
-    frame.frame_control.from_ds = 1;
-    
-    frame.duration_id = 0xABCD;
-    
-    memcpy(frame.addr1, CLIENT_MAC, 6);     // Receiver
-    memcpy(frame.addr2, AP_MAC, 6);         // Transmitter
-    memcpy(frame.addr3, AP_MAC, 6);         // BSSID
-    
-    frame.fcs = getCheckSumValue(&frame, sizeof(ieee80211_frame), 0, 4);
-    
-    udp_payload payload;
-    payload.start_frame_id = START_FRAME_ID;
-    memcpy(&payload.frame, &frame, sizeof(ieee80211_frame));
-    payload.end_frame_id = END_FRAME_ID;
-    
-    memcpy(buffer, &payload, sizeof(udp_payload));
-    
-    return sizeof(udp_payload);
+size_t create_association_response(uint8_t *buffer, const uint8_t *dest_mac, uint8_t version) {
+    // Receiver, transmitter, BSSID
+    return frame_build(buffer, version, TYPE_MANAGEMENT, SUBTYPE_ASSOC_RESP, FC_FROM_DS, 0xABCD,
+                       dest_mac, AP_MAC, AP_MAC, 0, 0, NULL, 0);
 }
 
 // Creates Probe Response frame
-size_t create_probe_response(uint8_t *buffer) {
-    ieee80211_frame frame;
-    memset(&frame, 0, sizeof(ieee80211_frame));
-    
-    frame.frame_control.protocol_version = 0;
-    frame.frame_control.type = 0;           // Management frame
-    frame.frame_control.subtype = 5;        // Probe Response
-    frame.frame_control.to_ds = 0;
-    frame.frame_control.from_ds = 1;
-    
-    frame.duration_id = 0x1234;
-    
-    memcpy(frame.addr1, CLIENT_MAC, 6);
-    memcpy(frame.addr2, AP_MAC, 6);
-    memcpy(frame.addr3, AP_MAC, 6);
-    
-    frame.fcs = getCheckSumValue(&frame, sizeof(ieee80211_frame), 0, 4);
-    
-    udp_payload payload;
-    payload.start_frame_id = START_FRAME_ID;
-    memcpy(&payload.frame, &frame, sizeof(ieee80211_frame));
-    payload.end_frame_id = END_FRAME_ID;
-    
-    memcpy(buffer, &payload, sizeof(udp_payload));
-    
-    return sizeof(udp_payload);
+size_t create_probe_response(uint8_t *buffer, const uint8_t *dest_mac, uint8_t version) {
+    return frame_build(buffer, version, TYPE_MANAGEMENT, SUBTYPE_PROBE_RESP, FC_FROM_DS, 0x1234,
+                       dest_mac, AP_MAC, AP_MAC, 0, 0, NULL, 0);
 }
 
 // Creates CTS frame
-size_t create_cts_frame(uint8_t *buffer, uint16_t duration_id) {
-    ieee80211_frame frame;
-    memset(&frame, 0, sizeof(ieee80211_frame));
+size_t create_cts_frame(uint8_t *buffer, const uint8_t *dest_mac, uint16_t duration_id, uint8_t version) {
+    // Duration one less than RTS
+    return frame_build(buffer, version, TYPE_CONTROL, SUBTYPE_CTS, FC_FROM_DS, duration_id - 1,
+                       dest_mac, NULL, NULL, 0, 0, NULL, 0);
+}
+
+// Creates ACK frame
+size_t create_ack_frame(uint8_t *buffer, const uint8_t *dest_mac, uint16_t duration_id, uint8_t version) {
+    // Duration one less than data frame
+    return frame_build(buffer, version, TYPE_CONTROL, SUBTYPE_ACK, FC_FROM_DS, duration_id - 1,
+                       dest_mac, NULL, NULL, 0, 0, NULL, 0);
+}
+
+// Creates Block Ack frame for the sequence numbers from start_seq_ctrl on; bit n of bitmap = start + n received
+size_t create_block_ack(uint8_t *buffer, const uint8_t *dest_mac, uint16_t duration_id,
+                        uint16_t start_seq_ctrl, uint64_t bitmap, uint8_t version) {
+    uint8_t body[BLOCK_ACK_BODY_LEN];
+    uint16_t ba_control = 0x0004;           // Compressed bitmap
+    memcpy(body, &ba_control, sizeof(uint16_t));
+    memcpy(body + 2, &start_seq_ctrl, sizeof(uint16_t));
+    memcpy(body + 4, &bitmap, sizeof(uint64_t));
     
-    frame.frame_control.protocol_version = 0;
-    frame.frame_control.type = 1;           // Control frame
-    frame.frame_control.subtype = 12;       // CTS
-    frame.frame_control.to_ds = 0;
-    frame.frame_control.from_ds = 1;
+    // Duration one less than Block Ack Request
+    return frame_build(buffer, version, TYPE_CONTROL, SUBTYPE_BLOCK_ACK, FC_FROM_DS, duration_id - 1,
+                       dest_mac, AP_MAC, NULL, 0, 0, body, sizeof(body));
+}
+
+// Builds every response template for a worker with the regular frame builders.
+// The receiver address is left zero; it is patched per station.
+void build_templates(ap_worker_t *worker) {
+    static const uint8_t no_mac[MAC_ADDR_LEN] = {0};
+    for (uint8_t version = 0; version < NUM_VERSIONS; version++) {
+        response_template_t *t = worker->templates[version];
+        t[TEMPLATE_ASSOC_RESP].len = create_association_response(t[TEMPLATE_ASSOC_RESP].wire, no_mac, version);
+        t[TEMPLATE_PROBE_RESP].len = create_probe_response(t[TEMPLATE_PROBE_RESP].wire, no_mac, version);
+        t[TEMPLATE_CTS].len = create_cts_frame(t[TEMPLATE_CTS].wire, no_mac, 1, version);
+        t[TEMPLATE_ACK].len = create_ack_frame(t[TEMPLATE_ACK].wire, no_mac, 1, version);
+        t[TEMPLATE_BLOCK_ACK].len = create_block_ack(t[TEMPLATE_BLOCK_ACK].wire, no_mac, 1, 0, 0, version);
+        
+        for (int k = 0; k < NUM_TEMPLATES; k++) {
+            memcpy(&t[k].duration_id, t[k].wire + FRAME_ID_LEN + sizeof(frame_control_t), sizeof(uint16_t));
+            fcs_init(&t[k].fcs_prefix, version);
+            fcs_update(&t[k].fcs_prefix, t[k].wire + FRAME_ID_LEN, sizeof(frame_control_t));
+        }
+    }
+}
+
+/*
+* Copies a template into buffer with a new duration_id, receiver address and, if body_len is not 0,
+* new contents for the last body_len bytes before the FCS, and fixes up its FCS from the cached prefix state
+* Output: size of the patched response
+*/
+size_t patch_template_body(const response_template_t *t, uint8_t *buffer, uint16_t duration_id,
+                           const uint8_t *addr1, const void *body, size_t body_len) {
+    const size_t duration_offset = FRAME_ID_LEN + sizeof(frame_control_t);
+    const size_t addr1_offset = duration_offset + sizeof(uint16_t);
+    size_t fcs_offset = t->len - FRAME_ID_LEN - FRAME_FCS_LEN;
+    fcs_ctx_t ctx = t->fcs_prefix;
     
-    frame.duration_id = duration_id - 1;    // One less than RTS
+    memcpy(buffer, t->wire, t->len);
+    memcpy(buffer + duration_offset, &duration_id, sizeof(uint16_t));
+    memcpy(buffer + addr1_offset, addr1, MAC_ADDR_LEN);
+    if (body_len > 0) {
+        memcpy(buffer + fcs_offset - body_len, body, body_len);
+    }
+    fcs_update(&ctx, buffer + duration_offset, fcs_offset - duration_offset);
+    uint32_t fcs = fcs_final(&ctx);
+    memcpy(buffer + fcs_offset, &fcs, FRAME_FCS_LEN);
+    return t->len;
+}
+
+// Copies a template into buffer with a new duration_id and receiver address
+size_t patch_template(const response_template_t *t, uint8_t *buffer, uint16_t duration_id, const uint8_t *addr1) {
+    return patch_template_body(t, buffer, duration_id, addr1, NULL, 0);
+}
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Reassembly sink: every complete MSDU a station sends ends up here
+static void deliver_msdu(void *user, const uint8_t *station, uint16_t seq, const uint8_t *msdu, size_t len) {
+    (void)user;
+    (void)station;
+    (void)msdu;
+    LOG(EV_AP_RX_MSDU, seq, len);
+}
+
+/*
+* Frame handlers: each acts on a request that passed every check in process_frame() and, if it gets
+* a response, builds it by patching one of the worker's templates into send_buffer.
+* Output: size of the response, or 0 if the frame gets none
+*/
+typedef size_t (*frame_handler_t)(ap_worker_t *worker, station_t *station, const frame_view_t *view,
+                                  const response_template_t *templates, uint8_t *send_buffer);
+
+static size_t handle_association_request(ap_worker_t *worker, station_t *station, const frame_view_t *view,
+                                         const response_template_t *templates, uint8_t *send_buffer) {
+    (void)worker;
+    (void)view;
+    LOG(EV_AP_RX_ASSOC_REQ);
+    station->state = STATION_ASSOCIATED;
+    station->ba_start = 0;              // A new association starts a new Block Ack session
+    station->ba_bitmap = 0;
+    station->dup_bitmap = 0;            // and new sequence numbers
+    size_t response_size = patch_template(&templates[TEMPLATE_ASSOC_RESP], send_buffer,
+                                          templates[TEMPLATE_ASSOC_RESP].duration_id, station->mac);
+    LOG(EV_AP_TX_ASSOC_RESP);
+    return response_size;
+}
+
+static size_t handle_probe_request(ap_worker_t *worker, station_t *station, const frame_view_t *view,
+                                   const response_template_t *templates, uint8_t *send_buffer) {
+    (void)worker;
+    (void)view;
+    LOG(EV_AP_RX_PROBE_REQ);
+    size_t response_size = patch_template(&templates[TEMPLATE_PROBE_RESP], send_buffer,
+                                          templates[TEMPLATE_PROBE_RESP].duration_id, station->mac);
+    LOG(EV_AP_TX_PROBE_RESP);
+    return response_size;
+}
+
+static size_t handle_rts(ap_worker_t *worker, station_t *station, const frame_view_t *view,
+                         const response_template_t *templates, uint8_t *send_buffer) {
+    (void)worker;
+    LOG(EV_AP_RX_RTS, view->duration_id);
+    size_t response_size = patch_template(&templates[TEMPLATE_CTS], send_buffer, view->duration_id - 1, station->mac);
+    LOG(EV_AP_TX_CTS, view->duration_id - 1);
+    return response_size;
+}
+
+static size_t handle_block_ack_request(ap_worker_t *worker, station_t *station, const frame_view_t *view,
+                                       const response_template_t *templates, uint8_t *send_buffer) {
+    (void)worker;
+    uint16_t start_seq_ctrl;
+    uint8_t ba_body[BLOCK_ACK_BODY_LEN - sizeof(uint16_t)];
+    memcpy(&start_seq_ctrl, view->payload + 2, sizeof(uint16_t));
+    LOG(EV_AP_RX_BAR, SEQ_NUM(start_seq_ctrl));
+    station_ba_request(station, SEQ_NUM(start_seq_ctrl));
     
-    memcpy(frame.addr1, CLIENT_MAC, 6);
-    memcpy(frame.addr2, AP_MAC, 6);
-    memcpy(frame.addr3, AP_MAC, 6);
+    // Answer with the scoreboard from its (possibly moved) start: starting seq_ctrl, then bitmap
+    uint16_t ba_seq_ctrl = SEQ_CTRL(station->ba_start, 0);
+    memcpy(ba_body, &ba_seq_ctrl, sizeof(uint16_t));
+    memcpy(ba_body + 2, &station->ba_bitmap, sizeof(uint64_t));
+    size_t response_size = patch_template_body(&templates[TEMPLATE_BLOCK_ACK], send_buffer, view->duration_id - 1,
+                                               station->mac, ba_body, sizeof(ba_body));
+    LOG(EV_AP_TX_BA, station->ba_start, station->ba_bitmap);
+    return response_size;
+}
+
+// A dozing station asks for what is buffered for it: the whole queue goes out as one burst, or an ACK if it is empty
+static size_t handle_ps_poll(ap_worker_t *worker, station_t *station, const frame_view_t *view,
+                             const response_template_t *templates, uint8_t *send_buffer) {
+    uint16_t released = ps_release(&worker->ps, station);
+    LOG(EV_AP_RX_PS_POLL, view->duration_id & 0x3FFF, released);
+    METRIC_ADD(worker->metrics.powersave[PS_COUNT_POLLS], 1);
+    if (released > 0) {
+        return 0;
+    }
+    size_t response_size = patch_template(&templates[TEMPLATE_ACK], send_buffer, 0, station->mac);
+    LOG(EV_AP_TX_ACK, 0);
+    return response_size;
+}
+
+static size_t handle_data(ap_worker_t *worker, station_t *station, const frame_view_t *view,
+                          const response_template_t *templates, uint8_t *send_buffer) {
+    LOG(EV_AP_RX_DATA, view->duration_id, view->frame_control.more_frag, view->seq_ctrl, view->payload_len);
+    reasm_add(&worker->reasm, station->mac, view->seq_ctrl, view->frame_control.more_frag,
+              view->payload, view->payload_len, now_ns());
+    if ((view->frame_control.subtype & SUBTYPE_QOS_DATA) &&
+        ((view->qos_ctrl >> QOS_ACK_POLICY_SHIFT) & 0x3) == QOS_ACK_BLOCK) {
+        // Block Ack policy: record it and acknowledge later, when the station sends a Block Ack Request
+        station_ba_record(station, SEQ_NUM(view->seq_ctrl));
+        LOG(EV_AP_BA_HELD, SEQ_NUM(view->seq_ctrl));
+        return 0;
+    }
+    size_t response_size = patch_template(&templates[TEMPLATE_ACK], send_buffer, view->duration_id - 1, station->mac);
+    LOG(EV_AP_TX_ACK, view->duration_id - 1);
+
+    uint32_t slot = (uint32_t)(station - worker->stations.slots);
+    ack_cache_t *cached = &worker->acks[slot & (ACK_CACHE_SIZE - 1)];
+    cached->station = slot + 1;
+    cached->seq_ctrl = view->seq_ctrl;
+    cached->version = view->frame_control.protocol_version;
+    cached->len = (uint8_t)response_size;
+    memcpy(cached->wire, send_buffer, response_size);
+    return response_size;
+}
+
+/*
+* A retransmitted data frame the station's duplicate scoreboard already holds (see station_rx_duplicate()).
+* Its payload was delivered the first time, so it is only acknowledged again: with a copy of the cached
+* ACK, or a freshly patched one if another station has taken the cache entry since. A Block Ack policy
+* frame is already in the Block Ack scoreboard and still gets nothing.
+*/
+static size_t handle_duplicate(ap_worker_t *worker, station_t *station, const frame_view_t *view,
+                               const response_template_t *templates, uint8_t *send_buffer) {
+    METRIC_ADD(worker->metrics.duplicates, 1);
+    if ((view->frame_control.subtype & SUBTYPE_QOS_DATA) &&
+        ((view->qos_ctrl >> QOS_ACK_POLICY_SHIFT) & 0x3) == QOS_ACK_BLOCK) {
+        LOG(EV_AP_RX_DUPLICATE, view->seq_ctrl, 0);
+        return 0;
+    }
+    uint32_t slot = (uint32_t)(station - worker->stations.slots);
+    const ack_cache_t *cached = &worker->acks[slot & (ACK_CACHE_SIZE - 1)];
+    if (cached->station == slot + 1 && cached->seq_ctrl == view->seq_ctrl &&
+        cached->version == view->frame_control.protocol_version) {
+        LOG(EV_AP_RX_DUPLICATE, view->seq_ctrl, 1);
+        memcpy(send_buffer, cached->wire, cached->len);
+        return cached->len;
+    }
+    LOG(EV_AP_RX_DUPLICATE, view->seq_ctrl, 0);
+    size_t response_size = patch_template(&templates[TEMPLATE_ACK], send_buffer, view->duration_id - 1, station->mac);
+    LOG(EV_AP_TX_ACK, view->duration_id - 1);
+    return response_size;
+}
+
+// Handler of every supported request, indexed by the first Frame Control byte (version, type, subtype).
+// Every data subtype is accepted; an empty slot is a version, type or subtype the AP drops.
+#define HANDLER(type, subtype, handler) \
+    [FC_FIRST_BYTE(PROTOCOL_VERSION, type, subtype)] = handler, \
+    [FC_FIRST_BYTE(PROTOCOL_VERSION_CRC32, type, subtype)] = handler
+static const frame_handler_t frame_handlers[256] = {
+    HANDLER(TYPE_MANAGEMENT, SUBTYPE_ASSOC_REQ, handle_association_request),
+    HANDLER(TYPE_MANAGEMENT, SUBTYPE_PROBE_REQ, handle_probe_request),
+    HANDLER(TYPE_CONTROL, SUBTYPE_RTS, handle_rts),
+    HANDLER(TYPE_CONTROL, SUBTYPE_BLOCK_ACK_REQ, handle_block_ack_request),
+    HANDLER(TYPE_CONTROL, SUBTYPE_PS_POLL, handle_ps_poll),
+    HANDLER(TYPE_DATA, 0, handle_data), HANDLER(TYPE_DATA, 1, handle_data),
+    HANDLER(TYPE_DATA, 2, handle_data), HANDLER(TYPE_DATA, 3, handle_data),
+    HANDLER(TYPE_DATA, 4, handle_data), HANDLER(TYPE_DATA, 5, handle_data),
+    HANDLER(TYPE_DATA, 6, handle_data), HANDLER(TYPE_DATA, 7, handle_data),
+    HANDLER(TYPE_DATA, 8, handle_data), HANDLER(TYPE_DATA, 9, handle_data),
+    HANDLER(TYPE_DATA, 10, handle_data), HANDLER(TYPE_DATA, 11, handle_data),
+    HANDLER(TYPE_DATA, 12, handle_data), HANDLER(TYPE_DATA, 13, handle_data),
+    HANDLER(TYPE_DATA, 14, handle_data), HANDLER(TYPE_DATA, 15, handle_data),
+};
+#undef HANDLER
+
+// Logs and counts a frame that has no handler
+static void drop_unsupported(ap_worker_t *worker, frame_control_t frame_control) {
+    if (frame_control.protocol_version > PROTOCOL_VERSION_CRC32) {
+        LOG(EV_AP_BAD_VERSION, frame_control.protocol_version);
+        METRIC_ADD(worker->metrics.drops[DROP_BAD_VERSION], 1);
+        return;
+    }
+    if (frame_control.type == TYPE_MANAGEMENT) {
+        LOG(EV_AP_BAD_MGMT, frame_control.subtype);
+    } else if (frame_control.type == TYPE_CONTROL) {
+        LOG(EV_AP_BAD_CTRL, frame_control.subtype);
+    } else {
+        LOG(EV_AP_BAD_TYPE, frame_control.type);
+    }
+    METRIC_ADD(worker->metrics.drops[DROP_UNSUPPORTED], 1);
+}
+
+/*
+* track_wake() and track_doze() follow the station's power management bit. Like last_seq, it is taken from management and data
+* frames only. A frame without it wakes a dozing station before the frame is handled, so its response
+* goes out directly, ahead of everything released from the station's queue. A frame with it puts the
+* station to sleep only once that frame's response is on its way, since the station stays awake for it.
+*/
+static void track_wake(ap_worker_t *worker, station_t *station, frame_control_t frame_control) {
+    if (frame_control.type == TYPE_CONTROL || frame_control.power_mgmt || !station->power_save) {
+        return;
+    }
+    station->power_save = 0;
+    uint16_t released = ps_release(&worker->ps, station);
+    LOG(EV_AP_PS_WAKE, released);
+    METRIC_ADD(worker->metrics.powersave[PS_COUNT_WAKES], 1);
+}
+
+static void track_doze(ap_worker_t *worker, station_t *station, frame_control_t frame_control) {
+    if (frame_control.type == TYPE_CONTROL || !frame_control.power_mgmt || station->power_save) {
+        return;
+    }
+    station->power_save = 1;
+    LOG(EV_AP_PS_DOZE);
+    METRIC_ADD(worker->metrics.powersave[PS_COUNT_DOZES], 1);
+}
+
+/*
+* Processes a received frame, updates the sending station's record and builds the response, if any.
+* Checks run cheapest first, so junk costs almost nothing to drop: length and frame identifiers
+* (frame_parse()), then the handler lookup on the Frame Control byte, which rejects unknown versions,
+* types and subtypes, and only then the FCS over the whole frame, unless fcs_state already says
+* whether it matches (see verify_batch_fcs()). Responses go to the station that sent the request (its addr2).
+* A data frame the station's duplicate scoreboard already holds goes to handle_duplicate() instead of its
+* handler; the scoreboard is only consulted once the FCS has vouched for seq_ctrl and the retry bit.
+* Management responses to a dozing station are buffered instead (see track_wake()); control
+* responses still go out, since they complete an exchange the station is awake for.
+* Input: received datagram, its exact length and source address, buffer of at least MAX_BUFFER_SIZE bytes
+* Output: size of the response and *response pointing at it, or 0 if the frame gets no response
+*/
+size_t process_checked_frame(ap_worker_t *worker, const uint8_t *recv_buffer, size_t recv_size,
+                             const struct sockaddr_in *src, uint8_t *send_buffer, const uint8_t **response,
+                             uint8_t fcs_state) {
+    frame_view_t view;
+    station_t *station;
+    
+    int status = frame_parse(recv_buffer, recv_size, &view);
+    if (status == FRAME_ERR_ID) {
+        LOG(EV_AP_BAD_ID);
+        METRIC_ADD(worker->metrics.drops[DROP_BAD_ID], 1);
+        return 0;
+    }
+    if (status != FRAME_OK) {
+        LOG(EV_AP_BAD_LENGTH, recv_size);
+        METRIC_ADD(worker->metrics.drops[DROP_BAD_LENGTH], 1);
+        return 0;
+    }
     
-    frame.fcs = getCheckSumValue(&frame, sizeof(ieee80211_frame), 0, 4);
+    frame_handler_t handler = frame_handlers[view.body[0]];
+    if (handler == NULL) {
+        // The capture still marks the FCS, but only pays for it when it is on
+        PCAP_CAPTURE(recv_buffer, recv_size, frame_fcs(&view) != view.fcs);
+        drop_unsupported(worker, view.frame_control);
+        return 0;
+    }
     
-    udp_payload payload;
-    payload.start_frame_id = START_FRAME_ID;
-    memcpy(&payload.frame, &frame, sizeof(ieee80211_frame));
-    payload.end_frame_id = END_FRAME_ID;
+    // Responses use the same protocol version (and so the same FCS algorithm) as the request
+    if (fcs_state == FCS_UNCHECKED) {
+        fcs_state = frame_fcs(&view) == view.fcs ? FCS_VALID : FCS_INVALID;
+    }
+    PCAP_CAPTURE(recv_buffer, recv_size, fcs_state == FCS_INVALID);
+    if (fcs_state == FCS_INVALID) {
+        LOG(EV_AP_FCS_ERROR, view.fcs, frame_fcs(&view));
+        METRIC_ADD(worker->metrics.drops[DROP_FCS_ERROR], 1);
+        return 0;  // Don't respond to FCS errors
+    }
+    METRIC_ADD(worker->metrics.rx[view.frame_control.type][view.frame_control.subtype], 1);
     
-    memcpy(buffer, &payload, sizeof(udp_payload));
+    if (view.addr2 == NULL) {
+        LOG(EV_AP_NO_ADDR2);
+        METRIC_ADD(worker->metrics.drops[DROP_NO_ADDR2], 1);
+        return 0;
+    }
+    station = station_find_or_add(&worker->stations, view.addr2);
+    if (station == NULL) {
+        LOG(EV_AP_TABLE_FULL);
+        METRIC_ADD(worker->metrics.drops[DROP_TABLE_FULL], 1);
+        return 0;
+    }
+    station->addr = *src;
+    station->rx_frames++;
+    station->rx_bytes += recv_size;
+    if (view.frame_control.type != TYPE_CONTROL) {
+        station->last_seq = view.seq_ctrl;
+    }
+    track_wake(worker, station, view.frame_control);
+    if (view.frame_control.type == TYPE_DATA &&
+        station_rx_duplicate(station, view.seq_ctrl, view.frame_control.retry)) {
+        handler = handle_duplicate;
+    }
     
-    return sizeof(udp_payload);
+    size_t response_size = handler(worker, station, &view, worker->templates[view.frame_control.protocol_version],
+                                   send_buffer);
+    if (response_size > 0) {
+        frame_control_t response_fc;
+        memcpy(&response_fc, send_buffer + FRAME_ID_LEN, sizeof(frame_control_t));
+        if (station->power_save && response_fc.type == TYPE_MANAGEMENT) {
+            ps_enqueue(&worker->ps, station, send_buffer, response_size);
+            LOG(EV_AP_PS_BUFFER, response_fc.subtype, station->ps_count);
+            response_size = 0;
+        } else {
+            *response = send_buffer;
+            METRIC_ADD(worker->metrics.tx[response_fc.type][response_fc.subtype], 1);
+            station->tx_frames++;
+            PCAP_CAPTURE(send_buffer, response_size, 0);
+        }
+    }
+    track_doze(worker, station, view.frame_control);
+    return response_size;
 }
 
-// Creates ACK frame
-size_t create_ack_frame(uint8_t *buffer, uint16_t duration_id) {
-    ieee80211_frame frame;
-    memset(&frame, 0, sizeof(ieee80211_frame));
-    
-    frame.frame_control.protocol_version = 0;
-    frame.frame_control.type = 1;           // Control frame
-    frame.frame_control.subtype = 13;       // ACK
-    frame.frame_control.to_ds = 0;
-    frame.frame_control.from_ds = 1;
-    
-    frame.duration_id = duration_id - 1;    // One less than data frame
+// Processes a received frame whose FCS has not been checked yet (see process_checked_frame())
+size_t process_frame(ap_worker_t *worker, const uint8_t *recv_buffer, size_t recv_size,
+                     const struct sockaddr_in *src, uint8_t *send_buffer, const uint8_t **response) {
+    return process_checked_frame(worker, recv_buffer, recv_size, src, send_buffer, response, FCS_UNCHECKED);
+}
+
+/*
+* Takes the next frame released from a power-save queue into buffer and counts it as sent
+* Output: size of the frame and *addr, where to send it, or 0 if nothing is waiting
+*/
+size_t next_released_frame(ap_worker_t *worker, uint8_t *buffer, struct sockaddr_in *addr) {
+    station_t *station;
+    size_t size = ps_next(&worker->ps, buffer, &station);
+    if (size == 0) {
+        return 0;
+    }
+    frame_control_t frame_control;
+    memcpy(&frame_control, buffer + FRAME_ID_LEN, sizeof(frame_control_t));
+    LOG(EV_AP_TX_BUFFERED, frame_control.subtype, frame_control.more_data);
+    METRIC_ADD(worker->metrics.tx[frame_control.type][frame_control.subtype], 1);
+    station->tx_frames++;
+    PCAP_CAPTURE(buffer, size, 0);
+    *addr = station->addr;
+    return size;
+}
+
+// Frames of one protocol version and length collected for one fcs_verify_batch() call
+typedef struct {
+    uint8_t version;
+    size_t body_len;
+    int count;
+    int index[FCS_BATCH_MAX];
+    const uint8_t *bodies[FCS_BATCH_MAX];
+} fcs_group_t;
+
+static void flush_fcs_group(fcs_group_t *group, uint8_t *fcs_state) {
+    if (group->count > 1) {
+        uint32_t valid = fcs_verify_batch(group->version, group->bodies, group->body_len, group->count);
+        for (int k = 0; k < group->count; k++) {
+            fcs_state[group->index[k]] = (valid >> k) & 1 ? FCS_VALID : FCS_INVALID;
+        }
+    }
+    group->count = 0;                   // A lone frame is left to process_checked_frame()
+}
+
+/*
+* Checks the FCS of a burst of received datagrams FCS_BATCH_MAX at a time before any of them is processed.
+* Only datagrams that will reach a handler are checked: the same cheap length, identifier and handler
+* checks as process_checked_frame() come first. They are grouped by protocol version and length, since
+* one fcs_verify_batch() call takes equal-length frames, with up to FCS_GROUPS groups filling at once.
+* Output: fcs_state[i] for each datagram, FCS_UNCHECKED where it was not checked here
+*/
+static void verify_batch_fcs(const uint8_t *const datagrams[], const size_t lens[], int count, uint8_t *fcs_state) {
+    fcs_group_t groups[FCS_GROUPS];
+    int num_groups = 0;
+    for (int i = 0; i < count; i++) {
+        const uint8_t *datagram = datagrams[i];
+        size_t len = lens[i];
+        uint16_t start_id, end_id;
+        fcs_state[i] = FCS_UNCHECKED;
+        if (len < FRAME_MIN_WIRE_SIZE || len > FRAME_MAX_WIRE_SIZE) {
+            continue;
+        }
+        memcpy(&start_id, datagram, FRAME_ID_LEN);
+        memcpy(&end_id, datagram + len - FRAME_ID_LEN, FRAME_ID_LEN);
+        if (start_id != START_FRAME_ID || end_id != END_FRAME_ID || frame_handlers[datagram[FRAME_ID_LEN]] == NULL) {
+            continue;
+        }
+
+        uint8_t version = datagram[FRAME_ID_LEN] & 0x03;
+        size_t body_len = len - FRAME_OVERHEAD;
+        int g = 0;
+        while (g < num_groups && (groups[g].version != version || groups[g].body_len != body_len)) {
+            g++;
+        }
+        if (g == num_groups) {
+            if (num_groups == FCS_GROUPS) {
+                g = i % FCS_GROUPS;     // Every group busy: check one early and reuse it
+                flush_fcs_group(&groups[g], fcs_state);
+            } else {
+                num_groups++;
+            }
+            groups[g].version = version;
+            groups[g].body_len = body_len;
+            groups[g].count = 0;
+        }
+        fcs_group_t *group = &groups[g];
+        group->index[group->count] = i;
+        group->bodies[group->count] = datagram + FRAME_ID_LEN;
+        if (++group->count == FCS_BATCH_MAX) {
+            flush_fcs_group(group, fcs_state);
+        }
+    }
+    for (int g = 0; g < num_groups; g++) {
+        flush_fcs_group(&groups[g], fcs_state);
+    }
+}
+
+// Logs the source of a received datagram without formatting it on the packet path
+static inline void log_rx_packet(const struct sockaddr_in *addr) {
+    uint32_t ip = ntohl(addr->sin_addr.s_addr);
+    LOG(EV_AP_RX_PACKET, ip >> 24, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF, ntohs(addr->sin_port));
+}
+
+// Receives and answers one datagram per recvfrom/sendto pair
+void run_single_loop(ap_worker_t *worker) {
+    int server_socket = worker->socket_fd;
+    struct sockaddr_in client_addr;
+    socklen_t client_addr_len;
+    uint8_t buffer[MAX_BUFFER_SIZE];
+    uint8_t send_buffer[MAX_BUFFER_SIZE];
+    ssize_t recv_len;
+    size_t response_size;
+    const uint8_t *response;
     
-    memcpy(frame.addr1, CLIENT_MAC, 6);
-    memcpy(frame.addr2, AP_MAC, 6);
-    memcpy(frame.addr3, AP_MAC, 6);
+    while (!ap_stopping()) {
+        client_addr_len = sizeof(client_addr);
+        recv_len = recvfrom(server_socket, buffer, MAX_BUFFER_SIZE, 0, 
+                          (struct sockaddr *)&client_addr, &client_addr_len);
+        
+        if (recv_len < 0) {
+            LOG(EV_AP_RECV_ERROR, errno);
+            continue;
+        }
+        
+        log_rx_packet(&client_addr);
+        
+        uint64_t start_ns = now_ns();
+        response_size = process_frame(worker, buffer, recv_len, &client_addr, send_buffer, &response);
+        metrics_record_service(&worker->metrics, now_ns() - start_ns);
+        if (response_size > 0 &&
+            sendto(server_socket, response, response_size, 0, 
+                   (struct sockaddr *)&client_addr, client_addr_len) < 0) {
+            LOG(EV_AP_SEND_ERROR, errno);
+        }
+        while ((response_size = next_released_frame(worker, send_buffer, &client_addr)) > 0) {
+            if (sendto(server_socket, send_buffer, response_size, 0,
+                       (struct sockaddr *)&client_addr, sizeof(client_addr)) < 0) {
+                LOG(EV_AP_SEND_ERROR, errno);
+            }
+        }
+    }
+}
+
+// Sends count prepared messages; sendmmsg may stop early, so it resumes from the first unsent one
+static void send_batch(int fd, struct mmsghdr *msgs, int count) {
+    int sent = 0;
+    while (sent < count) {
+        int n = sendmmsg(fd, msgs + sent, count - sent, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG(EV_AP_SEND_ERROR, errno);
+            break;
+        }
+        sent += n;
+    }
+}
+
+/*
+* Receives up to batch_size datagrams per recvmmsg into a ring of receive buffers, processes the whole
+* batch, then flushes every response with one sendmmsg. Each response slot points back at the address
+* its request came from, so one batch can answer many stations.
+*/
+void run_batch_loop(ap_worker_t *worker) {
+    int server_socket = worker->socket_fd;
+    int batch_size = worker->batch_size;
+    uint8_t (*recv_buffers)[MAX_BUFFER_SIZE] = calloc(batch_size, MAX_BUFFER_SIZE);
+    uint8_t (*send_buffers)[MAX_BUFFER_SIZE] = calloc(batch_size, MAX_BUFFER_SIZE);
+    struct sockaddr_in *addrs = calloc(batch_size, sizeof(struct sockaddr_in));
+    struct iovec *recv_iov = calloc(batch_size, sizeof(struct iovec));
+    struct iovec *send_iov = calloc(batch_size, sizeof(struct iovec));
+    struct mmsghdr *recv_msgs = calloc(batch_size, sizeof(struct mmsghdr));
+    struct mmsghdr *send_msgs = calloc(batch_size, sizeof(struct mmsghdr));
+    const uint8_t **datagrams = calloc(batch_size, sizeof(uint8_t *));
+    size_t *lens = calloc(batch_size, sizeof(size_t));
+    uint8_t *fcs_state = calloc(batch_size, sizeof(uint8_t));
     
-    frame.fcs = getCheckSumValue(&frame, sizeof(ieee80211_frame), 0, 4);
+    if (!recv_buffers || !send_buffers || !addrs || !recv_iov || !send_iov || !recv_msgs || !send_msgs ||
+        !datagrams || !lens || !fcs_state) {
+        perror("Batch buffer allocation failed");
+        exit(EXIT_FAILURE);
+    }
     
-    udp_payload payload;
-    payload.start_frame_id = START_FRAME_ID;
-    memcpy(&payload.frame, &frame, sizeof(ieee80211_frame));
-    payload.end_frame_id = END_FRAME_ID;
+    for (int i = 0; i < batch_size; i++) {
+        recv_iov[i].iov_base = recv_buffers[i];
+        recv_iov[i].iov_len = MAX_BUFFER_SIZE;
+        recv_msgs[i].msg_hdr.msg_iov = &recv_iov[i];
+        recv_msgs[i].msg_hdr.msg_iovlen = 1;
+        recv_msgs[i].msg_hdr.msg_name = &addrs[i];
+        datagrams[i] = recv_buffers[i];
+    }
     
-    memcpy(buffer, &payload, sizeof(udp_payload));
+    while (!ap_stopping()) {
+        for (int i = 0; i < batch_size; i++) {
+            recv_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        }
+        
+        // Block for the first datagram, then take whatever else is already queued
+        int received = recvmmsg(server_socket, recv_msgs, batch_size, MSG_WAITFORONE, NULL);
+        if (received < 0) {
+            if (errno != EINTR) {
+                LOG(EV_AP_RECV_ERROR, errno);
+            }
+            continue;
+        }
+        
+        // Check the FCS of the whole burst in vector lanes first, so processing knows which frames are bad
+        for (int i = 0; i < received; i++) {
+            lens[i] = recv_msgs[i].msg_len;
+        }
+        verify_batch_fcs(datagrams, lens, received, fcs_state);
+        
+        int responses = 0;
+        for (int i = 0; i < received; i++) {
+            log_rx_packet(&addrs[i]);
+            
+            const uint8_t *response;
+            uint64_t start_ns = now_ns();
+            size_t response_size = process_checked_frame(worker, recv_buffers[i], lens[i], &addrs[i],
+                                                         send_buffers[responses], &response, fcs_state[i]);
+            metrics_record_service(&worker->metrics, now_ns() - start_ns);
+            if (response_size == 0) {
+                continue;
+            }
+            send_iov[responses].iov_base = (void *)response;
+            send_iov[responses].iov_len = response_size;
+            memset(&send_msgs[responses].msg_hdr, 0, sizeof(struct msghdr));
+            send_msgs[responses].msg_hdr.msg_iov = &send_iov[responses];
+            send_msgs[responses].msg_hdr.msg_iovlen = 1;
+            send_msgs[responses].msg_hdr.msg_name = &addrs[i];
+            send_msgs[responses].msg_hdr.msg_namelen = recv_msgs[i].msg_hdr.msg_namelen;
+            responses++;
+        }
+        
+        send_batch(server_socket, send_msgs, responses);
+        
+        // Then the bursts of stations that woke up or polled, reusing the batch's buffers and addresses
+        while (ps_pending(&worker->ps)) {
+            int released = 0;
+            size_t size;
+            while (released < batch_size &&
+                   (size = next_released_frame(worker, send_buffers[released], &addrs[released])) > 0) {
+                send_iov[released].iov_base = send_buffers[released];
+                send_iov[released].iov_len = size;
+                memset(&send_msgs[released].msg_hdr, 0, sizeof(struct msghdr));
+                send_msgs[released].msg_hdr.msg_iov = &send_iov[released];
+                send_msgs[released].msg_hdr.msg_iovlen = 1;
+                send_msgs[released].msg_hdr.msg_name = &addrs[released];
+                send_msgs[released].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+                released++;
+            }
+            send_batch(server_socket, send_msgs, released);
+        }
+    }
     
-    return sizeof(udp_payload);
+    free(recv_buffers);
+    free(send_buffers);
+    free(addrs);
+    free(recv_iov);
+    free(send_iov);
+    free(recv_msgs);
+    free(send_msgs);
+    free(datagrams);
+    free(lens);
+    free(fcs_state);
 }
 
-// Processes received frames and sends appropriate responses
-void process_frame(int socket_fd, uint8_t *recv_buffer, size_t recv_size, 
-                  struct sockaddr_in *client_addr, socklen_t client_addr_len) {
-    udp_payload *payload = (udp_payload *)recv_buffer;
-    uint8_t send_buffer[MAX_BUFFER_SIZE];
-    size_t response_size;
+
+// A response waiting for its send to complete
+typedef struct {
+    uint8_t buffer[MAX_BUFFER_SIZE];
+    struct sockaddr_in addr;
+    struct iovec iov;
+    struct msghdr msg;
+} uring_send_slot_t;
+
+/*
+* Copies the completions waiting in the CQ to cqes[count...] (up to URING_CQ_ENTRIES in all) and hands
+* them back to the kernel, so the loop can wait for more while it still has some of these to handle.
+* Output: the new number of completions in cqes
+*/
+static unsigned uring_take_cqes(uring_t *ring, struct io_uring_cqe *cqes, unsigned count) {
+    unsigned head;
+    unsigned ready = uring_cq_ready(ring, &head);
+    if (ready > URING_CQ_ENTRIES - count) {
+        ready = URING_CQ_ENTRIES - count;
+    }
+    for (unsigned i = 0; i < ready; i++) {
+        cqes[count + i] = ring->cqes[(head + i) & ring->cq_mask];
+    }
+    uring_cq_advance(ring, ready);
+    return count + ready;
+}
+
+// Queues the multishot receive that fills the registered buffers until it runs out of them
+static int uring_arm_receive(uring_t *ring, struct msghdr *recv_msg, int fd) {
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)recv_msg;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = URING_TAG_RECV;
+    return 0;
+}
+
+/*
+* io_uring backend. One multishot RECVMSG stays posted against a ring of registered receive buffers,
+* so the kernel lands datagrams without a system call per packet; responses are queued as SENDMSG
+* SQEs from a pool of send slots and submitted together, and every io_uring_enter() both submits them
+* and waits for the next completions, which are then reaped as one batch. When every send slot is in
+* flight the loop waits for sends to complete before handling the next request, so, like the other
+* backends, it never processes a request and then loses its response.
+* Falls back to run_batch_loop() when the kernel has no io_uring or no buffer rings.
+*/
+void run_uring_loop(ap_worker_t *worker) {
+    int server_socket = worker->socket_fd;
+    uring_t ring;
+    uring_buf_ring_t bufs;
+    struct msghdr recv_msg;
     
-    if (payload->start_frame_id != START_FRAME_ID || payload->end_frame_id != END_FRAME_ID) {
-        printf("Invalid frame identifiers, ignoring packet\n");
+    if (uring_init(&ring, URING_ENTRIES, URING_CQ_ENTRIES) < 0) {
+        fprintf(stderr, "io_uring unavailable (%s), worker %d using recvmmsg/sendmmsg\n", strerror(errno), worker->id);
+        run_batch_loop(worker);
+        return;
+    }
+    if (uring_buf_ring_init(&ring, &bufs, 0, URING_RECV_BUFFERS, MAX_BUFFER_SIZE) < 0) {
+        fprintf(stderr, "io_uring buffer rings unavailable (%s), worker %d using recvmmsg/sendmmsg\n",
+                strerror(errno), worker->id);
+        uring_free(&ring);
+        run_batch_loop(worker);
         return;
     }
     
-    uint8_t frame_type = payload->frame.frame_control.type;
-    uint8_t frame_subtype = payload->frame.frame_control.subtype;
-    
-    uint32_t calculated_fcs = getCheckSumValue(&payload->frame, sizeof(ieee80211_frame), 0, 4);
-    if (calculated_fcs != payload->frame.fcs) {
-        printf("FCS (Frame Check Sequence) Error\n");
-        return;  // Don't respond to FCS errors
+    uring_send_slot_t *slots = calloc(URING_SEND_SLOTS, sizeof(uring_send_slot_t));
+    uint16_t *free_slots = calloc(URING_SEND_SLOTS, sizeof(uint16_t));
+    struct io_uring_cqe *cqes = calloc(URING_CQ_ENTRIES, sizeof(struct io_uring_cqe));
+    const uint8_t **datagrams = calloc(URING_CQ_ENTRIES, sizeof(uint8_t *));
+    size_t *lens = calloc(URING_CQ_ENTRIES, sizeof(size_t));
+    uint8_t *fcs_state = calloc(URING_CQ_ENTRIES, sizeof(uint8_t));
+    if (!slots || !free_slots || !cqes || !datagrams || !lens || !fcs_state) {
+        perror("Send slot allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    int num_free = URING_SEND_SLOTS;
+    for (int i = 0; i < URING_SEND_SLOTS; i++) {
+        free_slots[i] = (uint16_t)i;
+        slots[i].iov.iov_base = slots[i].buffer;
+        slots[i].msg.msg_iov = &slots[i].iov;
+        slots[i].msg.msg_iovlen = 1;
+        slots[i].msg.msg_name = &slots[i].addr;
+        slots[i].msg.msg_namelen = sizeof(struct sockaddr_in);
     }
     
-    // Process by frame type
-    if (frame_type == 0) {  // Management frame
-        if (frame_subtype == 0) {  // Association Request
-            printf("Received Association Request\n");
-            response_size = create_association_response(send_buffer);
-            printf("Sending Association Response\n");
-        } else if (frame_subtype == 4) {  // Probe Request
-            printf("Received Probe Request\n");
-            response_size = create_probe_response(send_buffer);
-            printf("Sending Probe Response\n");
-        } else {
-            printf("Unsupported management frame subtype: %d\n", frame_subtype);
-            return;
-        }
-    } else if (frame_type == 1) {  // Control frame
-        if (frame_subtype == 11) {  // RTS
-            printf("Received RTS, duration_id=%d\n", payload->frame.duration_id);
-            response_size = create_cts_frame(send_buffer, payload->frame.duration_id);
-            printf("Sending CTS, duration_id=%d\n", payload->frame.duration_id - 1);
-        } else {
-            printf("Unsupported control frame subtype: %d\n", frame_subtype);
-            return;
-        }
-    } else if (frame_type == 2) {  // Data frame
-        printf("Received Data Frame, duration_id=%d, more_fragments=%d, seq_ctrl=%d\n", 
-               payload->frame.duration_id, 
-               payload->frame.frame_control.more_frag,
-               payload->frame.seq_ctrl);
-        response_size = create_ack_frame(send_buffer, payload->frame.duration_id);
-        printf("Sending ACK, duration_id=%d\n", payload->frame.duration_id - 1);
-    } else {
-        printf("Unsupported frame type: %d\n", frame_type);
-        return;
+    // Only the name and payload lengths of recv_msg matter: they lay out every receive buffer
+    memset(&recv_msg, 0, sizeof(recv_msg));
+    recv_msg.msg_namelen = sizeof(struct sockaddr_in);
+    uring_arm_receive(&ring, &recv_msg, server_socket);
+    struct io_uring_sqe *stop_sqe = ap_stop_fd >= 0 ? uring_get_sqe(&ring) : NULL;
+    if (stop_sqe) {
+        stop_sqe->opcode = IORING_OP_POLL_ADD;
+        stop_sqe->fd = ap_stop_fd;
+        stop_sqe->poll32_events = POLLIN;
+        stop_sqe->user_data = URING_TAG_STOP;
     }
     
-    // Send response
-    if (sendto(socket_fd, send_buffer, response_size, 0, 
-              (struct sockaddr *)client_addr, client_addr_len) < 0) {
-        perror("sendto failed");
+    while (!ap_stopping()) {
+        if (uring_submit(&ring, 1) < 0 && errno != EINTR) {
+            LOG(EV_AP_RECV_ERROR, errno);
+        }
+        
+        // Completions outstanding at once are bounded: a receive holding each registered buffer, a send
+        // per slot and a few without either (the receive ending, the stop poll), so they all fit in cqes
+        unsigned ready = uring_take_cqes(&ring, cqes, 0);
+        int rearm = 0;
+        
+        // Check the FCS of every datagram these completions carry in vector lanes first; the rest get length 0
+        for (unsigned n = 0; n < ready; n++) {
+            const struct io_uring_cqe *cqe = &cqes[n];
+            lens[n] = 0;
+            if (cqe->user_data == URING_TAG_RECV && cqe->res >= 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+                const uint8_t *buffer = bufs.buffers + (size_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT) * bufs.buf_size;
+                const struct io_uring_recvmsg_out *out = (const struct io_uring_recvmsg_out *)buffer;
+                if (!(out->flags & MSG_TRUNC)) {
+                    datagrams[n] = buffer + sizeof(*out) + recv_msg.msg_namelen;
+                    lens[n] = out->payloadlen;
+                }
+            }
+        }
+        verify_batch_fcs(datagrams, lens, (int)ready, fcs_state);
+        
+        for (unsigned n = 0; n < ready; n++) {
+            const struct io_uring_cqe *cqe = &cqes[n];
+            
+            if (cqe->user_data == URING_TAG_STOP) {
+                continue;               // Shutting down: the loop ends after this round
+            }
+            if (cqe->user_data != URING_TAG_RECV) {
+                // A send finished: its slot is free again
+                if (cqe->res < 0) {
+                    LOG(EV_AP_SEND_ERROR, -cqe->res);
+                }
+                free_slots[num_free++] = (uint16_t)cqe->user_data;
+                continue;
+            }
+            if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                rearm = 1;              // Out of buffers or an error ended the multishot receive
+            }
+            if (cqe->res < 0) {
+                if (cqe->res != -ENOBUFS) {
+                    LOG(EV_AP_RECV_ERROR, -cqe->res);
+                }
+                continue;
+            }
+            if (!(cqe->flags & IORING_CQE_F_BUFFER)) {
+                continue;
+            }
+            
+            uint16_t bid = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+            uint8_t *buffer = bufs.buffers + (size_t)bid * bufs.buf_size;
+            const struct io_uring_recvmsg_out *out = (const struct io_uring_recvmsg_out *)buffer;
+            const uint8_t *payload = buffer + sizeof(*out) + recv_msg.msg_namelen;
+            struct sockaddr_in client_addr;
+            memcpy(&client_addr, buffer + sizeof(*out), sizeof(client_addr));
+            if (out->flags & MSG_TRUNC) {
+                METRIC_ADD(worker->metrics.drops[DROP_BAD_LENGTH], 1);
+                uring_buf_recycle(&bufs, bid);
+                continue;
+            }
+            
+            log_rx_packet(&client_addr);
+            
+            // Every slot in flight: push the queued sends out and take completions until one frees a slot.
+            // Receives completing meanwhile go behind the ones still to be handled, FCS unchecked, after
+            // the handled ones are dropped from cqes, so it only ever holds completions still outstanding.
+            if (num_free == 0 && n > 0) {
+                ready -= n;
+                memmove(cqes, cqes + n, ready * sizeof(*cqes));
+                memmove(fcs_state, fcs_state + n, ready);
+                n = 0;
+            }
+            while (num_free == 0 && ready < URING_CQ_ENTRIES) {
+                if (uring_submit(&ring, 1) < 0 && errno != EINTR) {
+                    LOG(EV_AP_SEND_ERROR, errno);
+                    break;
+                }
+                unsigned taken = uring_take_cqes(&ring, cqes, ready);
+                for (unsigned k = ready; k < taken; k++) {
+                    if (cqes[k].user_data == URING_TAG_RECV || cqes[k].user_data == URING_TAG_STOP) {
+                        fcs_state[ready] = FCS_UNCHECKED;
+                        cqes[ready++] = cqes[k];
+                        continue;
+                    }
+                    if (cqes[k].res < 0) {
+                        LOG(EV_AP_SEND_ERROR, -cqes[k].res);
+                    }
+                    free_slots[num_free++] = (uint16_t)cqes[k].user_data;
+                }
+            }
+            
+            // Only if waiting failed is the frame processed without a slot, and its response dropped
+            uint8_t scratch[MAX_BUFFER_SIZE];
+            uring_send_slot_t *slot = num_free > 0 ? &slots[free_slots[num_free - 1]] : NULL;
+            const uint8_t *response;
+            uint64_t start_ns = now_ns();
+            size_t response_size = process_checked_frame(worker, payload, out->payloadlen, &client_addr,
+                                                         slot ? slot->buffer : scratch, &response, fcs_state[n]);
+            metrics_record_service(&worker->metrics, now_ns() - start_ns);
+            uring_buf_recycle(&bufs, bid);
+            if (response_size == 0) {
+                continue;
+            }
+            struct io_uring_sqe *sqe = slot ? uring_get_sqe(&ring) : NULL;
+            if (slot && !sqe && uring_submit(&ring, 0) >= 0) {
+                sqe = uring_get_sqe(&ring);
+            }
+            if (!sqe) {
+                LOG(EV_AP_SEND_ERROR, ENOBUFS);
+                METRIC_ADD(worker->metrics.drops[DROP_NO_SEND_SLOT], 1);
+                continue;
+            }
+            if (response != slot->buffer) {
+                memcpy(slot->buffer, response, response_size);
+            }
+            slot->addr = client_addr;
+            slot->iov.iov_len = response_size;
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = server_socket;
+            sqe->addr = (uint64_t)(uintptr_t)&slot->msg;
+            sqe->user_data = free_slots[--num_free];
+        }
+        
+        // Released power-save bursts take whatever send slots are left; the rest wait for the next round
+        while (num_free > 0 && ps_pending(&worker->ps)) {
+            struct io_uring_sqe *sqe = uring_get_sqe(&ring);
+            if (!sqe) {
+                break;
+            }
+            uring_send_slot_t *slot = &slots[free_slots[num_free - 1]];
+            slot->iov.iov_len = next_released_frame(worker, slot->buffer, &slot->addr);
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = server_socket;
+            sqe->addr = (uint64_t)(uintptr_t)&slot->msg;
+            sqe->user_data = free_slots[--num_free];
+        }
+        if (rearm && uring_arm_receive(&ring, &recv_msg, server_socket) < 0) {
+            // Submission queue full of responses: push them out, then post the receive again
+            uring_submit(&ring, 0);
+            uring_arm_receive(&ring, &recv_msg, server_socket);
+        }
     }
+    
+    uring_buf_ring_free(&ring, &bufs);
+    uring_free(&ring);
+    free(slots);
+    free(free_slots);
+    free(cqes);
+    free(datagrams);
+    free(lens);
+    free(fcs_state);
 }
 
-int main() {
-    int server_socket;
-    struct sockaddr_in server_addr, client_addr;
-    socklen_t client_addr_len = sizeof(client_addr);
-    uint8_t buffer[MAX_BUFFER_SIZE];
-    ssize_t recv_len;
-    
-    // Create and set up socket
-    server_socket = socket(AF_INET, SOCK_DGRAM, 0);
+// Opens a UDP socket bound to the AP port. With more than one worker every socket sets SO_REUSEPORT,
+// and the kernel hashes each client's address onto one of them.
+int open_server_socket(int reuse_port) {
+    struct sockaddr_in server_addr;
+    int server_socket = socket(AF_INET, SOCK_DGRAM, 0);
     if (server_socket < 0) {
         perror("Socket creation failed");
         exit(EXIT_FAILURE);
     }
     
+    if (reuse_port) {
+        int one = 1;
+        if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+            perror("setsockopt SO_REUSEPORT failed");
+            close(server_socket);
+            exit(EXIT_FAILURE);
+        }
+    }
+    
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = INADDR_ANY;
@@ -225,26 +1065,331 @@ int main() {
         close(server_socket);
         exit(EXIT_FAILURE);
     }
+    return server_socket;
+}
+
+// Worker thread entry point: pins itself to one core and runs its receive loop until shutdown
+void *worker_main(void *arg) {
+    ap_worker_t *worker = (ap_worker_t *)arg;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
     
-    printf("UDP Server (Access Point) started. Listening on port %d\n", SERVER_PORT);
+    log_thread_register();
     
-    // Main loop
-    while(1) {
-        recv_len = recvfrom(server_socket, buffer, MAX_BUFFER_SIZE, 0, 
-                          (struct sockaddr *)&client_addr, &client_addr_len);
-        
-        if (recv_len < 0) {
-            perror("recvfrom failed");
+    if (cores > 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(worker->id % cores, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+    
+    if (worker->use_uring) {
+        run_uring_loop(worker);
+    } else if (worker->batch_size == 1) {
+        run_single_loop(worker);
+    } else {
+        run_batch_loop(worker);
+    }
+    return NULL;
+}
+
+/*
+* Stats socket: every connection to the UNIX stream socket gets one report of all workers' counters,
+* aggregated at the moment of the request, e.g.  nc -U /tmp/wifi_ap_stats.sock
+*/
+typedef struct {
+    int listen_fd;
+    ap_worker_t *workers;
+    int num_workers;
+    pthread_t thread;
+} stats_server_t;
+
+void *stats_thread_main(void *arg) {
+    stats_server_t *stats = (stats_server_t *)arg;
+    while (1) {
+        int fd = accept(stats->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (ap_stopping()) {
+                return NULL;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("stats accept failed");
+            return NULL;
+        }
+        FILE *out = fdopen(fd, "w");
+        if (!out) {
+            close(fd);
             continue;
         }
         
-        printf("\nReceived packet from %s:%d\n", 
-               inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
-        
-        process_frame(server_socket, buffer, recv_len, &client_addr, client_addr_len);
+        ap_metrics_t total;
+        memset(&total, 0, sizeof(total));
+        uint64_t stations = 0;
+        for (int i = 0; i < stats->num_workers; i++) {
+            metrics_aggregate(&total, &stats->workers[i].metrics);
+            stations += __atomic_load_n(&stats->workers[i].stations.count, __ATOMIC_RELAXED);
+        }
+        fprintf(out, "workers %d\n", stats->num_workers);
+        fprintf(out, "stations %lu\n", (unsigned long)stations);
+        metrics_write_report(out, &total);
+        fclose(out);
+    }
+}
+
+// Binds the stats socket and starts the thread that answers it
+void start_stats_server(stats_server_t *stats, const char *path) {
+    struct sockaddr_un addr;
+    
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Stats socket path too long\n");
+        exit(EXIT_FAILURE);
+    }
+    stats->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (stats->listen_fd < 0) {
+        perror("Stats socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(stats->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(stats->listen_fd, 8) < 0) {
+        perror("Stats socket bind failed");
+        exit(EXIT_FAILURE);
+    }
+    if (pthread_create(&stats->thread, NULL, stats_thread_main, stats) != 0) {
+        perror("pthread_create failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Wakes the stats thread out of accept(), waits for it and removes the socket
+void stop_stats_server(stats_server_t *stats, const char *path) {
+    shutdown(stats->listen_fd, SHUT_RDWR);
+    pthread_join(stats->thread, NULL);
+    close(stats->listen_fd);
+    unlink(path);
+}
+
+typedef struct {
+    sigset_t signals;
+    ap_worker_t *workers;
+    int num_workers;
+} shutdown_t;
+
+/*
+* Waits for SIGINT or SIGTERM, which every other thread blocks, then stops the workers: it sets ap_stop,
+* shuts the read side of every worker socket, which wakes a worker blocked in its receive, and writes
+* ap_stop_fd for the io_uring workers. main() joins them before it flushes the logger and the capture
+* writer, so nothing produces into their rings while they drain. The write side stays open for responses
+* already on their way.
+*/
+void *shutdown_thread_main(void *arg) {
+    shutdown_t *stop = (shutdown_t *)arg;
+    int sig;
+    sigwait(&stop->signals, &sig);
+    __atomic_store_n(&ap_stop, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < stop->num_workers; i++) {
+        shutdown(stop->workers[i].socket_fd, SHUT_RD);
+    }
+    uint64_t one = 1;
+    if (write(ap_stop_fd, &one, sizeof(one)) < 0) {
+        perror("Waking the io_uring workers failed");
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    int batch_size = DEFAULT_BATCH_SIZE;
+    int num_workers = 1;
+    long station_capacity = DEFAULT_STATIONS;
+    long reassembly_kb = DEFAULT_REASSEMBLY_KB;
+    long powersave_kb = DEFAULT_POWERSAVE_KB;
+    int level = LOG_DEFAULT_LEVEL;
+    const char *raw_log_path = NULL;
+    const char *stats_path = DEFAULT_STATS_PATH;
+    const char *pcap_path = NULL;
+    int use_uring = 0;
+    int opt;
+    
+    while ((opt = getopt(argc, argv, "b:uw:s:r:p:vqL:P:S:")) != -1) {
+        switch (opt) {
+        case 'b':
+            batch_size = atoi(optarg);
+            if (batch_size < 1 || batch_size > MAX_BATCH_SIZE) {
+                fprintf(stderr, "Batch size must be between 1 and %d\n", MAX_BATCH_SIZE);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'u':
+            use_uring = 1;
+            break;
+        case 'w':
+            num_workers = atoi(optarg);
+            if (num_workers == 0) {
+                num_workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+            }
+            if (num_workers < 1 || num_workers > MAX_WORKERS) {
+                fprintf(stderr, "Worker count must be between 1 and %d (0 = one per core)\n", MAX_WORKERS);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 's':
+            station_capacity = atol(optarg);
+            if (station_capacity < 1 || station_capacity > (1L << 24)) {
+                fprintf(stderr, "Station capacity must be between 1 and %ld\n", 1L << 24);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'r':
+            reassembly_kb = atol(optarg);
+            if (reassembly_kb < REASM_MIN_BUDGET / 1024 || reassembly_kb > (1L << 22)) {
+                fprintf(stderr, "Reassembly memory must be between %d and %ld KB\n", REASM_MIN_BUDGET / 1024, 1L << 22);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'p':
+            powersave_kb = atol(optarg);
+            if (powersave_kb < PS_MIN_BUDGET / 1024 || powersave_kb > (1L << 22)) {
+                fprintf(stderr, "Power-save buffer memory must be between %d and %ld KB\n", PS_MIN_BUDGET / 1024, 1L << 22);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'v':
+            level = LOG_DEBUG;
+            break;
+        case 'q':
+            level = LOG_WARN;
+            break;
+        case 'L':
+            raw_log_path = optarg;
+            break;
+        case 'P':
+            pcap_path = optarg;
+            break;
+        case 'S':
+            stats_path = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-b batch_size | -u] [-w workers] [-s stations] [-r reassembly_kb] [-p powersave_kb] [-v | -q] [-L raw_log] [-P capture] [-S stats_socket]\n",
+                    argv[0]);
+            fprintf(stderr, "  -b  datagrams per recvmmsg/sendmmsg, 1 for one recvfrom/sendto per packet (default %d)\n",
+                    DEFAULT_BATCH_SIZE);
+            fprintf(stderr, "  -u  io_uring I/O: a multishot receive over registered buffers, responses sent asynchronously\n");
+            fprintf(stderr, "  -w  worker threads, each with its own SO_REUSEPORT socket; 0 = one per core (default 1)\n");
+            fprintf(stderr, "  -s  stations each worker can track (default %d)\n", DEFAULT_STATIONS);
+            fprintf(stderr, "  -r  fragment reassembly buffer memory per worker in KB (default %d)\n", DEFAULT_REASSEMBLY_KB);
+            fprintf(stderr, "  -p  memory per worker in KB for responses held for dozing stations (default %d)\n",
+                    DEFAULT_POWERSAVE_KB);
+            fprintf(stderr, "  -v  log every frame; -q  log only warnings and errors\n");
+            fprintf(stderr, "  -L  write binary log records to raw_log instead of text (decode with logdump)\n");
+            fprintf(stderr, "  -P  write every frame received and sent to a pcap capture file (replay it with ./replay)\n");
+            fprintf(stderr, "  -S  UNIX socket that serves runtime stats, \"\" to disable (default %s)\n", DEFAULT_STATS_PATH);
+            exit(EXIT_FAILURE);
+        }
+    }
+    
+    // Bind every socket up front so a port clash is reported before any worker starts
+    ap_worker_t *workers = aligned_alloc(64, num_workers * sizeof(ap_worker_t));
+    if (!workers) {
+        perror("Worker allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    memset(workers, 0, num_workers * sizeof(ap_worker_t));
+    for (int i = 0; i < num_workers; i++) {
+        workers[i].id = i;
+        build_templates(&workers[i]);
+        if (station_table_init(&workers[i].stations, (uint32_t)station_capacity) < 0) {
+            perror("Station table allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        if (reasm_init(&workers[i].reasm, (size_t)reassembly_kb * 1024, deliver_msdu, &workers[i],
+                       workers[i].metrics.reassembly) < 0) {
+            perror("Reassembly buffer allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        if (ps_init(&workers[i].ps, (size_t)powersave_kb * 1024, workers[i].stations.slots,
+                    workers[i].metrics.powersave) < 0) {
+            perror("Power-save buffer allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        workers[i].batch_size = batch_size;
+        workers[i].use_uring = use_uring;
+        workers[i].socket_fd = open_server_socket(num_workers > 1);
+    }
+    
+    printf("UDP Server (Access Point) started. Listening on port %d\n", SERVER_PORT);
+    printf("CRC-32 FCS kernel: %s, legacy batch FCS kernel: %s\n", fcs_kernel_name(), fcs_batch_kernel_name());
+    if (use_uring) {
+        printf("I/O: io_uring, workers: %d\n", num_workers);
+    } else {
+        printf("Batch size: %d, workers: %d\n", batch_size, num_workers);
+    }
+    fflush(stdout);
+    
+    // SIGINT and SIGTERM go to the shutdown thread alone; threads started from here on inherit the mask
+    shutdown_t stop = { .workers = workers, .num_workers = num_workers };
+    pthread_t shutdown_thread;
+    sigemptyset(&stop.signals);
+    sigaddset(&stop.signals, SIGINT);
+    sigaddset(&stop.signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop.signals, NULL);
+    ap_stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (ap_stop_fd < 0) {
+        perror("eventfd failed");
+        exit(EXIT_FAILURE);
+    }
+    if (pthread_create(&shutdown_thread, NULL, shutdown_thread_main, &stop) != 0) {
+        perror("pthread_create failed");
+        exit(EXIT_FAILURE);
+    }
+    
+    if (log_init(level, raw_log_path) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    if (pcap_path && pcap_open(pcap_path) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    
+    stats_server_t stats = { -1, workers, num_workers, 0 };
+    if (stats_path[0] != '\0') {
+        start_stats_server(&stats, stats_path);
+        printf("Stats socket: %s\n", stats_path);
+        fflush(stdout);
     }
     
-    close(server_socket);
+    // Main loop
+    if (num_workers == 1) {
+        worker_main(&workers[0]);
+    } else {
+        for (int i = 0; i < num_workers; i++) {
+            if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) != 0) {
+                perror("pthread_create failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+        for (int i = 0; i < num_workers; i++) {
+            pthread_join(workers[i].thread, NULL);
+        }
+    }
+    
+    // Every worker has stopped: nothing logs or captures any more, so both can drain and close
+    pthread_join(shutdown_thread, NULL);
+    close(ap_stop_fd);
+    if (stats_path[0] != '\0') {
+        stop_stats_server(&stats, stats_path);
+    }
+    log_shutdown();
+    pcap_close();
+    
+    for (int i = 0; i < num_workers; i++) {
+        close(workers[i].socket_fd);
+        station_table_free(&workers[i].stations);
+        reasm_free(&workers[i].reasm);
+        ps_free(&workers[i].ps);
+    }
+    free(workers);
     
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,603 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+sim.c
+*/
+
+// Discrete-event simulation of 802.11 DCF: the stations of a BSS contend for one shared medium with
+// CSMA/CA and binary exponential backoff, honour the NAV carried in duration_id, use RTS/CTS above a
+// threshold, and retry until an ACK arrives or the retry limit is reached, all on a virtual clock.
+// Stations build their frames with frame_build(), and the AP is process_frame() from server.c with no
+// sockets, so every CTS and ACK (and the duration_id that sets everyone else's NAV) comes from the AP
+// code itself. Independent BSSs run in parallel on a pool of threads.
+//
+// Every station hears every other one (no hidden nodes), so physical carrier sense is shared; the
+// NAV is kept per station, since a transmitter does not set it from its own exchange. The AP gives its
+// CTS and ACK server.c's duration_id (the request's minus one), so the NAV they set runs past the end of
+// the exchange, as it would against this AP.
+
+#define main ap_main
+#include "server.c"
+#undef main
+
+#include <math.h>
+#include <stdatomic.h>
+
+// OFDM (802.11a/g) timing
+#define SIM_SLOT_NS 9000
+#define SIM_SIFS_NS 16000
+#define SIM_DIFS_NS (SIM_SIFS_NS + 2 * SIM_SLOT_NS)
+#define SIM_PREAMBLE_NS 20000
+#define SIM_CW_MIN 15
+#define SIM_CW_MAX 1023
+#define SIM_RETRY_LIMIT 7
+#define SIM_QUEUE_LEN 64                // Frames a station holds; arrivals beyond it are dropped
+
+#define SIM_DEFAULT_STATIONS 10
+#define SIM_DEFAULT_SECONDS 10.0
+#define SIM_DEFAULT_RATE_MBPS 54.0
+#define SIM_DEFAULT_RTS_THRESHOLD 512   // Payloads longer than this go out after an RTS/CTS exchange
+#define SIM_AP_REASSEMBLY_KB 256
+
+typedef struct {
+    int stations;                       // Per BSS
+    int bss_count;
+    int threads;
+    double seconds;                     // Simulated time per BSS
+    size_t payload_len;
+    double rate_mbps;
+    double offered;                     // Frames/s per station; 0 = saturated
+    int rts_threshold;
+    double loss;                        // Probability that any one frame is garbled on the air
+    uint8_t version;
+    uint64_t seed;
+} sim_config_t;
+
+typedef struct {
+    uint8_t mac[MAC_ADDR_LEN];
+    uint16_t seq;
+    int backoff;                        // Slots left; -1 = none drawn yet for the head frame
+    int cw;
+    int retries;                        // Of the head frame
+    uint64_t nav_until;                 // Virtual carrier sense, also covering the station's own response timeout
+    uint64_t ready_at;                  // When the head frame reached the front of the queue
+    uint64_t tx_at;                     // When the station transmits if nothing else happens first
+    uint64_t next_arrival;
+    uint64_t queue[SIM_QUEUE_LEN];      // Arrival times
+    int q_head;
+    int q_len;
+    uint64_t delivered;
+    uint64_t delay_ns;
+} sim_station_t;
+
+typedef struct {
+    uint64_t delivered;
+    uint64_t attempts;                  // Transmission attempts, collided ones included
+    uint64_t collisions;                // Slots in which two or more stations started at once
+    uint64_t lost;                      // Frames garbled on the air
+    uint64_t retransmissions;
+    uint64_t retry_drops;
+    uint64_t queue_drops;
+    double throughput_mbps;
+    double delay_us;                    // Mean from arrival to ACK
+    double fairness;                    // Jain's index over the stations' delivered frames
+    uint64_t ap_rx_data;
+    uint64_t ap_fcs_errors;
+} sim_result_t;
+
+typedef struct {
+    const sim_config_t *cfg;
+    sim_station_t *stations;
+    ap_worker_t *ap;
+    uint64_t rng;
+    uint64_t now;
+    uint64_t end;
+    uint64_t busy_until;                // Physical carrier sense: end of the last transmission
+    int eifs;                           // The last transmission could not be decoded
+    uint64_t cts_air;
+    uint64_t ack_air;
+    uint64_t eifs_ns;
+    sim_result_t *result;
+    struct sockaddr_in src;
+    uint8_t frame[MAX_BUFFER_SIZE];
+    uint8_t response[MAX_BUFFER_SIZE];
+    uint8_t garbled[MAX_BUFFER_SIZE];
+    uint8_t payload[MAX_PAYLOAD_SIZE];
+} sim_bss_t;
+
+static sim_config_t sim_config;
+static sim_result_t *sim_results;
+static _Atomic int sim_next_bss;
+
+// xorshift64*
+static uint64_t sim_rand(sim_bss_t *bss) {
+    uint64_t x = bss->rng;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    bss->rng = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static double sim_uniform(sim_bss_t *bss) {
+    return (double)(sim_rand(bss) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static uint64_t sim_exponential_ns(sim_bss_t *bss, double rate) {
+    return (uint64_t)(-log(1.0 - sim_uniform(bss)) / rate * 1e9);
+}
+
+// Time on the air of a datagram: preamble, then frame_control through the FCS at the PHY rate
+static uint64_t sim_airtime(const sim_bss_t *bss, size_t wire_len) {
+    double bits = (double)(wire_len - 2 * FRAME_ID_LEN) * 8;
+    return SIM_PREAMBLE_NS + (uint64_t)ceil(bits * 1000.0 / bss->cfg->rate_mbps);
+}
+
+static uint16_t sim_duration_us(uint64_t ns) {
+    return (uint16_t)((ns + 999) / 1000);
+}
+
+static int sim_has_frame(const sim_bss_t *bss, const sim_station_t *st) {
+    return bss->cfg->offered <= 0 || st->q_len > 0;
+}
+
+static void sim_draw_backoff(sim_bss_t *bss, sim_station_t *st) {
+    st->backoff = (int)(sim_rand(bss) % (uint64_t)(st->cw + 1));
+}
+
+// When the station's backoff countdown starts: the medium idle to both carrier senses for DIFS (EIFS
+// after a garbled frame), and not before its frame is ready
+static uint64_t sim_idle_from(const sim_bss_t *bss, const sim_station_t *st) {
+    uint64_t start = bss->busy_until > st->nav_until ? bss->busy_until : st->nav_until;
+    start += bss->eifs ? bss->eifs_ns : SIM_DIFS_NS;
+    return start > st->ready_at ? start : st->ready_at;
+}
+
+// Sets the NAV of every station but the transmitter from a frame that ended at end
+static void sim_set_nav(sim_bss_t *bss, int sender, uint64_t end, uint16_t duration_id) {
+    uint64_t until = end + (uint64_t)duration_id * 1000;
+    for (int i = 0; i < bss->cfg->stations; i++) {
+        if (i != sender && bss->stations[i].nav_until < until) {
+            bss->stations[i].nav_until = until;
+        }
+    }
+}
+
+// Hands the AP a garbled copy of a frame, which its FCS check throws away
+static void sim_garble(sim_bss_t *bss, const uint8_t *frame, size_t len) {
+    const uint8_t *response;
+    memcpy(bss->garbled, frame, len);
+    bss->garbled[FRAME_ID_LEN + 4 + sim_rand(bss) % (len - FRAME_OVERHEAD - 4)] ^= 0x10;
+    process_frame(bss->ap, bss->garbled, len, &bss->src, bss->response, &response);
+}
+
+/*
+* Puts a frame from station sender on the air at start, lets the AP answer it a SIFS later and carries
+* the answer back, applying channel loss to both. Whoever decodes a frame sets its NAV from duration_id.
+* When the answer does not come back the sender waits out its response timeout in its NAV.
+* Output: 1 if the sender got the AP's answer, 0 if not; *end = end of the last transmission
+*/
+static int sim_frame_exchange(sim_bss_t *bss, int sender, size_t len, uint64_t response_air, uint64_t start,
+                              uint64_t *end) {
+    sim_station_t *st = &bss->stations[sender];
+    const uint8_t *response;
+    frame_view_t view;
+    uint64_t tx_end = start + sim_airtime(bss, len);
+    uint64_t timeout = tx_end + SIM_SIFS_NS + response_air + SIM_SLOT_NS;
+
+    bss->result->attempts++;
+    bss->busy_until = tx_end;
+    *end = tx_end;
+    if (sim_uniform(bss) < bss->cfg->loss) {
+        bss->result->lost++;
+        bss->eifs = 1;
+        sim_garble(bss, bss->frame, len);
+        st->nav_until = timeout;
+        return 0;
+    }
+    frame_parse(bss->frame, len, &view);
+    sim_set_nav(bss, sender, tx_end, view.duration_id);
+
+    size_t response_len = process_frame(bss->ap, bss->frame, len, &bss->src, bss->response, &response);
+    if (response_len == 0) {
+        st->nav_until = timeout;
+        return 0;
+    }
+    uint64_t response_end = tx_end + SIM_SIFS_NS + sim_airtime(bss, response_len);
+    bss->busy_until = response_end;
+    *end = response_end;
+    if (sim_uniform(bss) < bss->cfg->loss) {
+        bss->result->lost++;
+        bss->eifs = 1;
+        st->nav_until = response_end + SIM_SLOT_NS;
+        return 0;
+    }
+    if (frame_parse(response, response_len, &view) != FRAME_OK || memcmp(view.addr1, st->mac, MAC_ADDR_LEN) != 0) {
+        st->nav_until = response_end + SIM_SLOT_NS;
+        return 0;
+    }
+    sim_set_nav(bss, sender, response_end, view.duration_id);
+    return 1;
+}
+
+// Removes the head frame and readies the next one
+static void sim_next_frame(sim_bss_t *bss, sim_station_t *st, uint64_t now) {
+    if (st->q_len > 0) {
+        st->q_head = (st->q_head + 1) % SIM_QUEUE_LEN;
+        st->q_len--;
+    }
+    st->seq = (uint16_t)((st->seq + 1) & (SEQ_MODULO - 1));
+    st->retries = 0;
+    st->cw = SIM_CW_MIN;
+    st->ready_at = now;
+    if (sim_has_frame(bss, st)) {
+        sim_draw_backoff(bss, st);      // Post-transmission backoff
+    } else {
+        st->backoff = -1;
+    }
+}
+
+// A failed attempt: double the contention window, or give the frame up at the retry limit
+static void sim_failed(sim_bss_t *bss, sim_station_t *st, uint64_t now) {
+    if (++st->retries > SIM_RETRY_LIMIT) {
+        bss->result->retry_drops++;
+        sim_next_frame(bss, st, now);
+        return;
+    }
+    bss->result->retransmissions++;
+    st->cw = st->cw * 2 + 1 > SIM_CW_MAX ? SIM_CW_MAX : st->cw * 2 + 1;
+    sim_draw_backoff(bss, st);
+}
+
+// Builds station sender's head frame into bss->frame: the RTS if rts is set, else the data frame
+static size_t sim_build(sim_bss_t *bss, int sender, int rts, uint64_t data_air) {
+    sim_station_t *st = &bss->stations[sender];
+    uint8_t flags = FC_TO_DS | (st->retries > 0 ? FC_RETRY : 0);
+    if (rts) {
+        uint16_t duration = sim_duration_us(3 * SIM_SIFS_NS + bss->cts_air + data_air + bss->ack_air);
+        return frame_build(bss->frame, bss->cfg->version, TYPE_CONTROL, SUBTYPE_RTS, flags, duration,
+                           AP_MAC, st->mac, NULL, 0, 0, NULL, 0);
+    }
+    return frame_build(bss->frame, bss->cfg->version, TYPE_DATA, SUBTYPE_DATA, flags,
+                       sim_duration_us(SIM_SIFS_NS + bss->ack_air), AP_MAC, st->mac, AP_MAC,
+                       SEQ_CTRL(st->seq, 0), 0, bss->payload, bss->cfg->payload_len);
+}
+
+// One station has the medium to itself: RTS/CTS if the payload calls for it, then data and ACK
+static void sim_transmit(sim_bss_t *bss, int sender) {
+    sim_station_t *st = &bss->stations[sender];
+    int rts = (int)bss->cfg->payload_len > bss->cfg->rts_threshold;
+    uint64_t data_air = sim_airtime(bss, sim_build(bss, sender, 0, 0));
+    uint64_t start = bss->now;
+    uint64_t end;
+
+    if (rts) {
+        size_t len = sim_build(bss, sender, 1, data_air);
+        if (!sim_frame_exchange(bss, sender, len, bss->cts_air, start, &end)) {
+            sim_failed(bss, st, end);
+            return;
+        }
+        start = end + SIM_SIFS_NS;
+    }
+    size_t len = sim_build(bss, sender, 0, 0);
+    if (!sim_frame_exchange(bss, sender, len, bss->ack_air, start, &end)) {
+        sim_failed(bss, st, end);
+        return;
+    }
+    uint64_t arrival = bss->cfg->offered > 0 ? st->queue[st->q_head] : st->ready_at;
+    st->delivered++;
+    st->delay_ns += end - arrival;
+    sim_next_frame(bss, st, end);
+}
+
+// Two or more stations started in the same slot: nothing can be decoded, and every one of them times out
+static void sim_collide(sim_bss_t *bss, const int *senders, int count) {
+    int rts = (int)bss->cfg->payload_len > bss->cfg->rts_threshold;
+    uint64_t busy = bss->now;
+    bss->result->collisions++;
+    for (int k = 0; k < count; k++) {
+        sim_station_t *st = &bss->stations[senders[k]];
+        uint64_t data_air = sim_airtime(bss, sim_build(bss, senders[k], 0, 0));
+        size_t len = sim_build(bss, senders[k], rts, data_air);
+        uint64_t tx_end = bss->now + sim_airtime(bss, len);
+        st->nav_until = tx_end + SIM_SIFS_NS + (rts ? bss->cts_air : bss->ack_air) + SIM_SLOT_NS;
+        if (tx_end > busy) {
+            busy = tx_end;
+        }
+        bss->result->attempts++;
+        if (k == 0) {
+            sim_garble(bss, bss->frame, len);   // What reaches the AP fails its FCS check
+        }
+    }
+    bss->busy_until = busy;
+    bss->eifs = 1;
+    for (int k = 0; k < count; k++) {
+        sim_failed(bss, &bss->stations[senders[k]], busy);
+    }
+}
+
+// A frame arrives at station st's queue
+static void sim_arrival(sim_bss_t *bss, sim_station_t *st) {
+    st->next_arrival = bss->now + sim_exponential_ns(bss, bss->cfg->offered);
+    if (st->q_len == SIM_QUEUE_LEN) {
+        bss->result->queue_drops++;
+        return;
+    }
+    st->queue[(st->q_head + st->q_len) % SIM_QUEUE_LEN] = bss->now;
+    if (st->q_len++ > 0) {
+        return;
+    }
+    // A frame finding the medium idle for DIFS goes out at once; otherwise it backs off
+    st->ready_at = bss->now;
+    uint64_t medium_free = bss->busy_until > st->nav_until ? bss->busy_until : st->nav_until;
+    if (bss->now >= medium_free + (bss->eifs ? bss->eifs_ns : SIM_DIFS_NS)) {
+        st->backoff = 0;
+    } else {
+        sim_draw_backoff(bss, st);
+    }
+}
+
+/*
+* Runs one BSS until its virtual clock reaches the configured time. Each step either delivers the next
+* arrival or resolves the next contention: every backlogged station's transmit time is the end of DIFS
+* plus its remaining backoff slots, the earliest wins, everyone else freezes its counter with the slots
+* that went by, and stations tied for the earliest slot collide.
+*/
+static void sim_run_bss(int index, sim_result_t *result) {
+    const sim_config_t *cfg = &sim_config;
+    sim_bss_t *bss = aligned_alloc(64, sizeof(sim_bss_t));
+    int *senders = malloc(cfg->stations * sizeof(int));
+    if (!bss || !senders) {
+        perror("Simulator allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    memset(bss, 0, sizeof(*bss));
+    memset(result, 0, sizeof(*result));
+    bss->cfg = cfg;
+    bss->result = result;
+    bss->rng = (cfg->seed + 1) * 0x9E3779B97F4A7C15ULL ^ (uint64_t)(index + 1) * 0xD1B54A32D192ED03ULL;
+    bss->end = (uint64_t)(cfg->seconds * 1e9);
+    bss->stations = calloc(cfg->stations, sizeof(sim_station_t));
+    bss->ap = aligned_alloc(64, sizeof(ap_worker_t));
+    if (!bss->stations || !bss->ap) {
+        perror("Simulator allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    memset(bss->ap, 0, sizeof(ap_worker_t));
+    bss->ap->id = index;
+    build_templates(bss->ap);
+    if (station_table_init(&bss->ap->stations, cfg->stations) < 0 ||
+        reasm_init(&bss->ap->reasm, (size_t)SIM_AP_REASSEMBLY_KB * 1024, deliver_msdu, bss->ap,
+                   bss->ap->metrics.reassembly) < 0 ||
+        ps_init(&bss->ap->ps, PS_MIN_BUDGET, bss->ap->stations.slots, bss->ap->metrics.powersave) < 0) {
+        perror("AP allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    bss->cts_air = sim_airtime(bss, bss->ap->templates[cfg->version][TEMPLATE_CTS].len);
+    bss->ack_air = sim_airtime(bss, bss->ap->templates[cfg->version][TEMPLATE_ACK].len);
+    bss->eifs_ns = SIM_SIFS_NS + bss->ack_air + SIM_DIFS_NS;
+    for (size_t i = 0; i < cfg->payload_len; i++) {
+        bss->payload[i] = (uint8_t)sim_rand(bss);
+    }
+
+    for (int i = 0; i < cfg->stations; i++) {
+        sim_station_t *st = &bss->stations[i];
+        uint8_t mac[MAC_ADDR_LEN] = { 0x02, 0x00, (uint8_t)(index >> 8), (uint8_t)index, (uint8_t)(i >> 8), (uint8_t)i };
+        memcpy(st->mac, mac, MAC_ADDR_LEN);
+        st->cw = SIM_CW_MIN;
+        st->backoff = -1;
+        st->next_arrival = cfg->offered > 0 ? sim_exponential_ns(bss, cfg->offered) : UINT64_MAX;
+    }
+
+    while (bss->now < bss->end) {
+        uint64_t next_tx = UINT64_MAX;
+        uint64_t next_arrival = UINT64_MAX;
+        sim_station_t *arriving = NULL;
+        for (int i = 0; i < cfg->stations; i++) {
+            sim_station_t *st = &bss->stations[i];
+            if (st->next_arrival < next_arrival) {
+                next_arrival = st->next_arrival;
+                arriving = st;
+            }
+            if (!sim_has_frame(bss, st)) {
+                continue;
+            }
+            if (st->backoff < 0) {
+                sim_draw_backoff(bss, st);
+            }
+            st->tx_at = sim_idle_from(bss, st) + (uint64_t)st->backoff * SIM_SLOT_NS;
+            if (st->tx_at < next_tx) {
+                next_tx = st->tx_at;
+            }
+        }
+        if (next_arrival <= next_tx) {
+            if (next_arrival >= bss->end) {
+                break;
+            }
+            bss->now = next_arrival;
+            sim_arrival(bss, arriving);
+            continue;
+        }
+        if (next_tx >= bss->end) {
+            break;
+        }
+
+        bss->now = next_tx;
+        int count = 0;
+        for (int i = 0; i < cfg->stations; i++) {
+            sim_station_t *st = &bss->stations[i];
+            if (!sim_has_frame(bss, st)) {
+                continue;
+            }
+            if (st->tx_at == next_tx) {
+                senders[count++] = i;
+                continue;
+            }
+            uint64_t idle_from = st->tx_at - (uint64_t)st->backoff * SIM_SLOT_NS;
+            if (bss->now > idle_from) {
+                st->backoff -= (int)((bss->now - idle_from) / SIM_SLOT_NS);
+            }
+        }
+        bss->eifs = 0;
+        if (count == 1) {
+            sim_transmit(bss, senders[0]);
+        } else {
+            sim_collide(bss, senders, count);
+        }
+    }
+
+    double sum = 0, sum_sq = 0, delay = 0;
+    for (int i = 0; i < cfg->stations; i++) {
+        sim_station_t *st = &bss->stations[i];
+        result->delivered += st->delivered;
+        delay += (double)st->delay_ns;
+        sum += (double)st->delivered;
+        sum_sq += (double)st->delivered * st->delivered;
+    }
+    result->throughput_mbps = result->delivered * cfg->payload_len * 8 / cfg->seconds / 1e6;
+    result->delay_us = result->delivered ? delay / result->delivered / 1000 : 0;
+    result->fairness = sum_sq > 0 ? sum * sum / (cfg->stations * sum_sq) : 0;
+    result->ap_rx_data = bss->ap->metrics.rx[TYPE_DATA][SUBTYPE_DATA];
+    result->ap_fcs_errors = bss->ap->metrics.drops[DROP_FCS_ERROR];
+
+    station_table_free(&bss->ap->stations);
+    reasm_free(&bss->ap->reasm);
+    ps_free(&bss->ap->ps);
+    free(bss->ap);
+    free(bss->stations);
+    free(senders);
+    free(bss);
+}
+
+static void *sim_thread_main(void *arg) {
+    (void)arg;
+    int index;
+    while ((index = atomic_fetch_add(&sim_next_bss, 1)) < sim_config.bss_count) {
+        sim_run_bss(index, &sim_results[index]);
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    sim_config_t *cfg = &sim_config;
+    int opt;
+    cfg->stations = SIM_DEFAULT_STATIONS;
+    cfg->bss_count = 1;
+    cfg->threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    cfg->seconds = SIM_DEFAULT_SECONDS;
+    cfg->payload_len = MAX_PAYLOAD_SIZE;
+    cfg->rate_mbps = SIM_DEFAULT_RATE_MBPS;
+    cfg->rts_threshold = SIM_DEFAULT_RTS_THRESHOLD;
+    cfg->version = PROTOCOL_VERSION_CRC32;
+    cfg->seed = 1;
+
+    while ((opt = getopt(argc, argv, "s:b:j:t:l:R:r:T:e:LS:")) != -1) {
+        switch (opt) {
+        case 's':
+            cfg->stations = atoi(optarg);
+            break;
+        case 'b':
+            cfg->bss_count = atoi(optarg);
+            break;
+        case 'j':
+            cfg->threads = atoi(optarg);
+            break;
+        case 't':
+            cfg->seconds = atof(optarg);
+            break;
+        case 'l':
+            cfg->payload_len = (size_t)atol(optarg);
+            break;
+        case 'R':
+            cfg->rate_mbps = atof(optarg);
+            break;
+        case 'r':
+            cfg->offered = atof(optarg);
+            break;
+        case 'T':
+            cfg->rts_threshold = atoi(optarg);
+            break;
+        case 'e':
+            cfg->loss = atof(optarg);
+            break;
+        case 'L':
+            cfg->version = PROTOCOL_VERSION;
+            break;
+        case 'S':
+            cfg->seed = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-s stations] [-b bss] [-j threads] [-t seconds] [-l payload_bytes] [-R mbps]\n"
+                            "          [-r frames_per_s] [-T rts_threshold] [-e loss] [-L] [-S seed]\n", argv[0]);
+            fprintf(stderr, "  -s  stations per BSS (default %d); -b  independent BSSs, run in parallel (default 1)\n",
+                    SIM_DEFAULT_STATIONS);
+            fprintf(stderr, "  -j  threads (default one per core); -t  simulated seconds per BSS (default %.0f)\n",
+                    SIM_DEFAULT_SECONDS);
+            fprintf(stderr, "  -l  data payload (default %d); -R  PHY rate in Mb/s (default %.0f)\n",
+                    MAX_PAYLOAD_SIZE, SIM_DEFAULT_RATE_MBPS);
+            fprintf(stderr, "  -r  offered frames/s per station, Poisson (default saturated)\n");
+            fprintf(stderr, "  -T  RTS/CTS for payloads longer than this (default %d, -1 = always)\n", SIM_DEFAULT_RTS_THRESHOLD);
+            fprintf(stderr, "  -e  probability that a frame is garbled on the air (default 0)\n");
+            fprintf(stderr, "  -L  legacy checksum FCS instead of CRC-32; -S  random seed (default 1)\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (cfg->stations < 1 || cfg->bss_count < 1 || cfg->bss_count > 65536 || cfg->stations > 65536 ||
+        cfg->seconds <= 0 || cfg->rate_mbps <= 0 || cfg->loss < 0 || cfg->loss >= 1 ||
+        cfg->payload_len < 1 || cfg->payload_len > MAX_PAYLOAD_SIZE) {
+        fprintf(stderr, "Invalid simulation parameters\n");
+        exit(EXIT_FAILURE);
+    }
+    if (cfg->threads < 1) {
+        cfg->threads = 1;
+    }
+    if (cfg->threads > cfg->bss_count) {
+        cfg->threads = cfg->bss_count;
+    }
+    log_level = LOG_ERROR;              // The AP's per-frame events stay a single branch
+
+    sim_results = calloc(cfg->bss_count, sizeof(sim_result_t));
+    pthread_t *threads = calloc(cfg->threads, sizeof(pthread_t));
+    if (!sim_results || !threads) {
+        perror("Simulator allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    printf("sim: %d BSS x %d stations, %.1f s each, %zu-byte payloads at %.0f Mb/s, %s, RTS above %d bytes, "
+           "loss %.3f, FCS %s, %d threads\n",
+           cfg->bss_count, cfg->stations, cfg->seconds, cfg->payload_len, cfg->rate_mbps,
+           cfg->offered > 0 ? "Poisson arrivals" : "saturated", cfg->rts_threshold, cfg->loss,
+           cfg->version == PROTOCOL_VERSION ? "legacy" : "CRC-32", cfg->threads);
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < cfg->threads; i++) {
+        if (pthread_create(&threads[i], NULL, sim_thread_main, NULL) != 0) {
+            perror("Starting simulator thread failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int i = 0; i < cfg->threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double wall = (now_ns() - start) / 1e9;
+
+    double throughput = 0;
+    uint64_t delivered = 0;
+    for (int i = 0; i < cfg->bss_count; i++) {
+        const sim_result_t *r = &sim_results[i];
+        printf("bss %d: delivered=%lu throughput=%.2f Mb/s attempts=%lu collisions=%lu lost=%lu retransmissions=%lu "
+               "retry_drops=%lu queue_drops=%lu delay=%.1f us fairness=%.3f ap_rx_data=%lu ap_fcs_errors=%lu\n",
+               i, (unsigned long)r->delivered, r->throughput_mbps, (unsigned long)r->attempts,
+               (unsigned long)r->collisions, (unsigned long)r->lost, (unsigned long)r->retransmissions,
+               (unsigned long)r->retry_drops, (unsigned long)r->queue_drops, r->delay_us, r->fairness,
+               (unsigned long)r->ap_rx_data, (unsigned long)r->ap_fcs_errors);
+        throughput += r->throughput_mbps;
+        delivered += r->delivered;
+    }
+    printf("sim: %lu frames delivered, mean %.2f Mb/s per BSS, %.3f s wall for %.0f simulated BSS-seconds "
+           "(%.0fx real time)\n", (unsigned long)delivered, throughput / cfg->bss_count, wall,
+           cfg->seconds * cfg->bss_count, cfg->seconds * cfg->bss_count / wall);
+    free(threads);
+    free(sim_results);
+    return 0;
+}
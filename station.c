@@ -0,0 +1,166 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+station.c
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "station.h"
+
+// Packs a MAC address into a 64-bit key. The top bit is always set so a zero key marks an empty slot.
+static inline uint64_t station_key(const uint8_t *mac) {
+    uint64_t key = 0;
+    memcpy(&key, mac, MAC_ADDR_LEN);
+    return key | STATION_KEY_USED;
+}
+
+// Fibonacci hashing: the high bits of key * 2^64/phi are well mixed even for sequential MACs
+static inline uint32_t station_slot(const station_table_t *table, uint64_t key) {
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> table->shift);
+}
+
+/*
+* Allocates a table that can hold capacity stations
+* Output: 0 on success, -1 if the allocation failed
+*/
+int station_table_init(station_table_t *table, uint32_t capacity) {
+    uint32_t slots = 2;
+    uint32_t bits = 1;
+    while (slots < 2 * (uint64_t)capacity) {
+        slots <<= 1;
+        bits++;
+    }
+
+    memset(table, 0, sizeof(*table));
+    table->keys = aligned_alloc(64, (size_t)slots * sizeof(uint64_t));
+    table->slots = aligned_alloc(64, (size_t)slots * sizeof(station_t));
+    if (!table->keys || !table->slots) {
+        station_table_free(table);
+        return -1;
+    }
+    memset(table->keys, 0, (size_t)slots * sizeof(uint64_t));
+    memset(table->slots, 0, (size_t)slots * sizeof(station_t));
+    table->mask = slots - 1;
+    table->shift = 64 - bits;
+    table->capacity = capacity;
+    return 0;
+}
+
+void station_table_free(station_table_t *table) {
+    free(table->keys);
+    free(table->slots);
+    table->keys = NULL;
+    table->slots = NULL;
+}
+
+// Output: the station with this MAC, or NULL if it has never been seen
+station_t *station_lookup(const station_table_t *table, const uint8_t *mac) {
+    uint64_t key = station_key(mac);
+    uint32_t i = station_slot(table, key);
+    while (table->keys[i] != 0) {
+        if (table->keys[i] == key) {
+            return &table->slots[i];
+        }
+        i = (i + 1) & table->mask;
+    }
+    return NULL;
+}
+
+// Output: the station with this MAC, added in STATION_UNASSOCIATED state if new, or NULL if the table is full
+station_t *station_find_or_add(station_table_t *table, const uint8_t *mac) {
+    uint64_t key = station_key(mac);
+    uint32_t i = station_slot(table, key);
+    while (table->keys[i] != 0) {
+        if (table->keys[i] == key) {
+            return &table->slots[i];
+        }
+        i = (i + 1) & table->mask;
+    }
+    if (table->count >= table->capacity) {
+        return NULL;
+    }
+
+    station_t *station = &table->slots[i];
+    table->keys[i] = key;
+    memcpy(station->mac, mac, MAC_ADDR_LEN);
+    station->state = STATION_UNASSOCIATED;
+    table->count++;
+    return station;
+}
+
+// Slides the Block Ack scoreboard forward so it starts at sequence number start
+static void station_ba_slide(station_t *station, uint16_t start) {
+    uint16_t shift = (uint16_t)((start - station->ba_start) & (SEQ_MODULO - 1));
+    station->ba_bitmap = shift < BLOCK_ACK_WINDOW ? station->ba_bitmap >> shift : 0;
+    station->ba_start = start;
+}
+
+/*
+* Marks sequence number seq received in the station's Block Ack scoreboard. A frame past the end of
+* the window slides it forward so that frame becomes its last bit; frames behind the window (more than
+* half the sequence space back) are old duplicates and are ignored.
+*/
+void station_ba_record(station_t *station, uint16_t seq) {
+    uint16_t offset = (uint16_t)((seq - station->ba_start) & (SEQ_MODULO - 1));
+    if (offset >= SEQ_MODULO / 2) {
+        return;
+    }
+    if (offset >= BLOCK_ACK_WINDOW) {
+        station_ba_slide(station, (uint16_t)((seq - (BLOCK_ACK_WINDOW - 1)) & (SEQ_MODULO - 1)));
+        offset = BLOCK_ACK_WINDOW - 1;
+    }
+    station->ba_bitmap |= 1ULL << offset;
+}
+
+/*
+* Applies a Block Ack Request: the sender no longer needs anything before sequence number start.
+* A start just behind the window is a delayed request and is ignored; any other start moves the
+* window there, which also resynchronises with a sender that restarted its sequence numbers.
+*/
+void station_ba_request(station_t *station, uint16_t start) {
+    uint16_t behind = (uint16_t)((station->ba_start - start) & (SEQ_MODULO - 1));
+    if (behind == 0 || behind <= BLOCK_ACK_WINDOW) {
+        return;
+    }
+    station_ba_slide(station, start);
+}
+
+/*
+* Duplicate detection on the station's data frames, keyed on seq_ctrl and the retry bit. The scoreboard
+* is a sliding bitmap of the DUP_WINDOW sequence numbers up to the newest one received, so a retransmission
+* is caught even after later frames got through (Block Ack windows, reordering). Fragments of one MSDU go
+* out in order, so within the newest sequence number any fragment up to the last one seen is a duplicate.
+* Only a frame with retry set can be a duplicate; anything else is recorded, like a frame that is not one.
+* Output: 1 if the frame was already received, 0 if it is new (and now recorded)
+*/
+int station_rx_duplicate(station_t *station, uint16_t seq_ctrl, int retry) {
+    uint16_t behind = (uint16_t)((SEQ_NUM(station->dup_last) - SEQ_NUM(seq_ctrl)) & (SEQ_MODULO - 1));
+    if (station->dup_bitmap == 0) {
+        station->dup_last = seq_ctrl;
+        station->dup_bitmap = 1;
+        return 0;
+    }
+    if (behind == 0) {
+        if (retry && SEQ_FRAG(seq_ctrl) <= SEQ_FRAG(station->dup_last)) {
+            return 1;
+        }
+        station->dup_last = seq_ctrl;
+    } else if (behind < SEQ_MODULO / 2) {
+        // Older sequence number: in the window it is either a duplicate or a late first copy
+        if (behind < DUP_WINDOW) {
+            if (retry && (station->dup_bitmap >> behind) & 1) {
+                return 1;
+            }
+            station->dup_bitmap |= 1U << behind;
+        }
+    } else {
+        uint16_t ahead = (uint16_t)(SEQ_MODULO - behind);
+        station->dup_bitmap = ahead < DUP_WINDOW ? station->dup_bitmap << ahead : 0;
+        station->dup_bitmap |= 1;
+        station->dup_last = seq_ctrl;
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+station.h
+*/
+
+#ifndef STATION_H
+#define STATION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+#include "frame.h"
+
+// Station association states
+#define STATION_UNASSOCIATED 0
+#define STATION_ASSOCIATED 1
+
+#define DUP_WINDOW 32                 // Sequence numbers the duplicate scoreboard remembers
+
+// Per-station record, one cache line each
+typedef struct __attribute__((aligned(64))) {
+    struct sockaddr_in addr;          // Where the station's last request came from
+    uint8_t mac[MAC_ADDR_LEN];
+    uint8_t state;                    // STATION_UNASSOCIATED or STATION_ASSOCIATED
+    uint8_t power_save;               // Dozing: its management responses wait in its power-save queue
+    uint16_t last_seq;                // seq_ctrl of the last management or data frame
+    uint16_t ba_start;                // Block Ack scoreboard: sequence number of bit 0
+    uint32_t rx_frames;
+    uint32_t tx_frames;
+    uint32_t rx_bytes;
+    uint64_t ba_bitmap;               // Block Ack scoreboard: bit n set = ba_start + n received
+    uint32_t ps_head;                 // Power-save queue (see powersave.h): first and last buffered frame
+    uint32_t ps_tail;
+    uint16_t ps_count;                // Frames buffered; head and tail mean nothing while it is 0
+    uint16_t dup_last;                // Duplicate scoreboard: seq_ctrl of the newest data frame received
+    uint32_t dup_bitmap;              // Duplicate scoreboard: bit n set = SEQ_NUM(dup_last) - n received; 0 = empty
+} station_t;
+
+#define STATION_KEY_USED (1ULL << 63)
+
+// Open-addressing (linear probing) table keyed on the transmitter MAC. Keys live in their own dense
+// array (eight per cache line) so probing never drags station records through the cache; a hit then
+// touches exactly one station line. Both arrays are allocated once at startup and kept at most half
+// full, so lookups never allocate.
+typedef struct {
+    uint64_t *keys;                   // MAC address (low 48 bits) | STATION_KEY_USED; 0 = empty slot
+    station_t *slots;
+    uint32_t mask;                    // Slot count - 1 (slot count is a power of two)
+    uint32_t shift;                   // 64 - log2(slot count), for the multiplicative hash
+    uint32_t count;
+    uint32_t capacity;                // Maximum number of stations
+} station_table_t;
+
+int station_table_init(station_table_t *table, uint32_t capacity);
+void station_table_free(station_table_t *table);
+station_t *station_lookup(const station_table_t *table, const uint8_t *mac);
+station_t *station_find_or_add(station_table_t *table, const uint8_t *mac);
+void station_ba_record(station_t *station, uint16_t seq);
+void station_ba_request(station_t *station, uint16_t start);
+int station_rx_duplicate(station_t *station, uint16_t seq_ctrl, int retry);
+
+#endif
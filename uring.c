@@ -0,0 +1,213 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+uring.c
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "uring.h"
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/*
+* Creates a ring with entries SQEs and cq_entries CQEs and maps its queues. Completion work is
+* deferred to the owning thread where the kernel supports it, so it runs inside uring_submit().
+* Output: 0, or -1 with errno set (ENOSYS or EPERM when io_uring is unavailable)
+*/
+int uring_init(uring_t *ring, unsigned entries, unsigned cq_entries) {
+    struct io_uring_params params;
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    params.cq_entries = cq_entries;
+    ring->fd = sys_io_uring_setup(entries, &params);
+    if (ring->fd < 0 && errno == EINVAL) {
+        // Kernels before 6.1 know neither flag
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = cq_entries;
+        ring->fd = sys_io_uring_setup(entries, &params);
+    }
+    if (ring->fd < 0) {
+        return -1;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        goto fail;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            goto fail;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        goto fail;
+    }
+
+    uint8_t *sq = ring->sq_ring;
+    uint8_t *cq = ring->cq_ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    // SQE i always sits in array slot i, so the index array is filled once
+    for (unsigned i = 0; i < ring->sq_entries; i++) {
+        ring->sq_array[i] = i;
+    }
+    return 0;
+
+fail:
+    {
+        int saved = errno;
+        uring_free(ring);
+        errno = saved;
+    }
+    return -1;
+}
+
+void uring_free(uring_t *ring) {
+    if (ring->sqes && ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring && ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring && ring->sq_ring != MAP_FAILED) {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+    }
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+// Next free SQE, cleared, or NULL if the submission queue is full until the next uring_submit()
+struct io_uring_sqe *uring_get_sqe(uring_t *ring) {
+    unsigned tail = *ring->sq_tail + ring->sq_pending;
+    if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries) {
+        return NULL;
+    }
+    ring->sq_pending++;
+    struct io_uring_sqe *sqe = &ring->sqes[tail & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+/*
+* Publishes every SQE filled since the last call and, if wait_nr > 0, blocks until that many completions
+* are ready. Output: number of SQEs the kernel consumed, or -1 with errno set
+*/
+int uring_submit(uring_t *ring, unsigned wait_nr) {
+    unsigned pending = ring->sq_pending;
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + pending, __ATOMIC_RELEASE);
+    ring->sq_pending = 0;
+    int ret;
+    do {
+        ret = sys_io_uring_enter(ring->fd, pending, wait_nr, wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0);
+    } while (ret < 0 && errno == EINTR && wait_nr == 0);
+    return ret;
+}
+
+/*
+* Registers entries receive buffers of buf_size bytes each as provided buffer group group.
+* Output: 0, or -1 with errno set (EINVAL before Linux 5.19, which has no buffer rings)
+*/
+int uring_buf_ring_init(uring_t *ring, uring_buf_ring_t *bufs, uint16_t group, uint32_t entries, uint32_t buf_size) {
+    struct io_uring_buf_reg reg;
+    memset(bufs, 0, sizeof(*bufs));
+    bufs->ring_size = entries * sizeof(struct io_uring_buf);
+    bufs->ring = mmap(NULL, bufs->ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (bufs->ring == MAP_FAILED) {
+        bufs->ring = NULL;
+        return -1;
+    }
+    bufs->buffers = aligned_alloc(64, (size_t)entries * buf_size);
+    if (!bufs->buffers) {
+        munmap(bufs->ring, bufs->ring_size);
+        bufs->ring = NULL;
+        return -1;
+    }
+    bufs->entries = entries;
+    bufs->buf_size = buf_size;
+    bufs->group = group;
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)bufs->ring;
+    reg.ring_entries = entries;
+    reg.bgid = group;
+    if (sys_io_uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        int saved = errno;
+        free(bufs->buffers);
+        munmap(bufs->ring, bufs->ring_size);
+        memset(bufs, 0, sizeof(*bufs));
+        errno = saved;
+        return -1;
+    }
+    for (uint32_t i = 0; i < entries; i++) {
+        uring_buf_recycle(bufs, (uint16_t)i);
+    }
+    return 0;
+}
+
+void uring_buf_ring_free(uring_t *ring, uring_buf_ring_t *bufs) {
+    if (!bufs->ring) {
+        return;
+    }
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.bgid = bufs->group;
+    sys_io_uring_register(ring->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    free(bufs->buffers);
+    munmap(bufs->ring, bufs->ring_size);
+    memset(bufs, 0, sizeof(*bufs));
+}
+
+// Gives buffer bid back to the kernel
+void uring_buf_recycle(uring_buf_ring_t *bufs, uint16_t bid) {
+    struct io_uring_buf *buf = &bufs->ring->bufs[bufs->tail & (bufs->entries - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(bufs->buffers + (size_t)bid * bufs->buf_size);
+    buf->len = bufs->buf_size;
+    buf->bid = bid;
+    bufs->tail++;
+    __atomic_store_n(&bufs->ring->tail, bufs->tail, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,74 @@
+/*
+Justin Chung
+COEN 331 Winter 2025: Programming Assignment
+3/9/2025
+uring.h
+*/
+
+#ifndef URING_H
+#define URING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+/*
+* Minimal io_uring wrapper over the raw system calls (no liburing). One ring belongs to one thread:
+* SQEs are filled in place and published together by uring_submit(), and completions are read
+* straight out of the mapped completion queue.
+*/
+typedef struct {
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_pending;              // SQEs filled since the last submit
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;                    // Same mapping as sq_ring with IORING_FEAT_SINGLE_MMAP
+    size_t cq_ring_size;
+    size_t sqes_size;
+} uring_t;
+
+/*
+* Provided buffer ring: receive buffers registered with the kernel once, which picks one for each
+* datagram a multishot receive completes. The CQE names the buffer, and it goes back with uring_buf_recycle().
+*/
+typedef struct {
+    struct io_uring_buf_ring *ring;
+    size_t ring_size;
+    uint8_t *buffers;
+    uint32_t entries;                 // Power of two
+    uint32_t buf_size;
+    uint16_t group;
+    uint16_t tail;
+} uring_buf_ring_t;
+
+int uring_init(uring_t *ring, unsigned entries, unsigned cq_entries);
+void uring_free(uring_t *ring);
+struct io_uring_sqe *uring_get_sqe(uring_t *ring);
+int uring_submit(uring_t *ring, unsigned wait_nr);
+
+int uring_buf_ring_init(uring_t *ring, uring_buf_ring_t *bufs, uint16_t group, uint32_t entries, uint32_t buf_size);
+void uring_buf_ring_free(uring_t *ring, uring_buf_ring_t *bufs);
+void uring_buf_recycle(uring_buf_ring_t *bufs, uint16_t bid);
+
+// Completions waiting in the queue: entries cq_head .. cq_tail - 1 (masked) are ready to read
+static inline unsigned uring_cq_ready(const uring_t *ring, unsigned *head) {
+    *head = *ring->cq_head;
+    return __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) - *head;
+}
+
+// Hands n read completions back to the kernel
+static inline void uring_cq_advance(uring_t *ring, unsigned n) {
+    __atomic_store_n(ring->cq_head, *ring->cq_head + n, __ATOMIC_RELEASE);
+}
+
+#endif